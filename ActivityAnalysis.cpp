@@ -0,0 +1,195 @@
+#include "ActivityAnalysis.h"
+
+const int ActivityAnalysis::UNKNOWN_INDEX = -1;
+
+ActivityAnalysis::ActivityAnalysis(std::shared_ptr<Function> function, const std::vector<std::shared_ptr<Variable>> &inputs) {
+    inputCount = inputs.size();
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        inputIndexes[inputs[i]->symbol] = i;
+    }
+    while (propagate(function->block));
+}
+
+ActivityAnalysis::Inputs ActivityAnalysis::dependenciesOf(std::shared_ptr<Expression> expression) {
+    Inputs result(inputCount, false);
+    switch (expression->getType()) {
+        case Expression::VARIABLE: {
+            Symbol symbol = std::dynamic_pointer_cast<Variable>(expression)->symbol;
+            auto input = inputIndexes.find(symbol);
+            if (input != inputIndexes.end()) {
+                result[input->second] = true;
+            }
+            merge(result, dependencies[symbol]);
+            for (auto &element: elements[symbol]) {
+                merge(result, element.second);
+            }
+            break;
+        }
+        case Expression::UNARY_OPERATOR:
+            result = dependenciesOf(std::dynamic_pointer_cast<UnaryOperator>(expression)->expr);
+            break;
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(op->left);
+            std::shared_ptr<Number> index = std::dynamic_pointer_cast<Number>(op->right);
+            if (op->op == BinaryOperator::INDEXING && variable != nullptr && index != nullptr &&
+                    inputIndexes.count(variable->symbol) == 0) {
+                result = dependenciesOf(variable->symbol, (int) index->value);
+            } else {
+                // The index is not differentiated
+                result = dependenciesOf(op->left);
+                if (op->op != BinaryOperator::INDEXING) {
+                    merge(result, dependenciesOf(op->right));
+                }
+            }
+            break;
+        }
+        case Expression::CALL:
+            for (std::shared_ptr<Expression> &arg: std::dynamic_pointer_cast<Call>(expression)->args) {
+                merge(result, dependenciesOf(arg));
+            }
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+ActivityAnalysis::Inputs ActivityAnalysis::dependenciesOf(Symbol variable, int index) {
+    Inputs result(inputCount, false);
+    std::unordered_map<int, Inputs> &variableElements = elements[variable];
+    merge(result, dependencies[variable]);
+    merge(result, variableElements[index]);
+    merge(result, variableElements[UNKNOWN_INDEX]);
+    return result;
+}
+
+int ActivityAnalysis::elementCount(Symbol variable) {
+    int result = 0;
+    for (auto &element: elements[variable]) {
+        result = std::max(result, element.first + 1);
+    }
+    return result;
+}
+
+bool ActivityAnalysis::isIndexed(Symbol variable) {
+    return indexed.count(variable) != 0;
+}
+
+bool ActivityAnalysis::isActive(Symbol variable, Symbol input) {
+    auto index = inputIndexes.find(input);
+    if (index == inputIndexes.end()) {
+        return true;
+    }
+    if (variable == input) {
+        return true;
+    }
+    if (dependencies[variable].size() > index->second && dependencies[variable][index->second]) {
+        return true;
+    }
+    for (auto &element: elements[variable]) {
+        if (element.second.size() > index->second && element.second[index->second]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ActivityAnalysis::isActive(Symbol variable, int index, Symbol input) {
+    auto inputIndex = inputIndexes.find(input);
+    if (inputIndex == inputIndexes.end() || inputIndexes.count(variable)) {
+        return true;
+    }
+    return dependenciesOf(variable, index)[inputIndex->second];
+}
+
+bool ActivityAnalysis::propagate(std::shared_ptr<Statement> statement) {
+    bool changed = false;
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            changed = propagate(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr);
+            break;
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                changed = propagate(inner) || changed;
+            }
+            break;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            changed = propagate(conditional->statement);
+            if (conditional->elseStatement != nullptr) {
+                changed = propagate(conditional->elseStatement) || changed;
+            }
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                changed = propagate(loop->definition);
+            }
+            if (loop->expr != nullptr) {
+                changed = propagate(loop->expr) || changed;
+            }
+            changed = propagate(loop->statement) || changed;
+            break;
+        }
+        default:
+            break;
+    }
+    return changed;
+}
+
+bool ActivityAnalysis::propagate(std::shared_ptr<Expression> expression) {
+    std::shared_ptr<Variable> declared = std::dynamic_pointer_cast<Variable>(expression);
+    if (declared != nullptr && declared->declaration) {
+        if (declared->type.name == "std::vector" || declared->type.name == "std::array") {
+            indexed.insert(declared->symbol);
+        }
+        if (declared->constructorCall != nullptr) {
+            return merge(dependencies[declared->symbol], dependenciesOf(declared->constructorCall));
+        }
+        return false;
+    }
+
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    if (op == nullptr || op->op < BinaryOperator::EQUALS || op->op > BinaryOperator::DIVIDE_EQUALS) {
+        return false;
+    }
+    bool changed = propagate(op->left);
+
+    Inputs value = dependenciesOf(op->right);
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(op->left);
+    std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(op->left);
+    if (variable != nullptr) {
+        changed = merge(dependencies[variable->symbol], value) || changed;
+    } else if (indexing != nullptr && indexing->op == BinaryOperator::INDEXING) {
+        // The elements of nested arrays, as m[i][j], are not tracked separately
+        std::shared_ptr<Number> index = std::dynamic_pointer_cast<Number>(indexing->right);
+        std::shared_ptr<BinaryOperator> inner;
+        while ((inner = std::dynamic_pointer_cast<BinaryOperator>(indexing->left)) != nullptr &&
+                inner->op == BinaryOperator::INDEXING) {
+            indexing = inner;
+            index = nullptr;
+        }
+        variable = std::dynamic_pointer_cast<Variable>(indexing->left);
+        if (variable != nullptr) {
+            indexed.insert(variable->symbol);
+            int element = index == nullptr ? UNKNOWN_INDEX : (int) index->value;
+            changed = merge(elements[variable->symbol][element], value) || changed;
+        }
+    }
+    return changed;
+}
+
+bool ActivityAnalysis::merge(Inputs &target, const Inputs &source) {
+    bool changed = false;
+    target.resize(inputCount, false);
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (source[i] && !target[i]) {
+            target[i] = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
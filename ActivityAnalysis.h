@@ -0,0 +1,48 @@
+#ifndef FINAL_PROJECT_ACTIVITY_ANALYSIS_H
+#define FINAL_PROJECT_ACTIVITY_ANALYSIS_H
+
+#include "SyntaxTreeNode.h"
+#include <unordered_map>
+#include <unordered_set>
+
+// Finds the inputs (the differentiated parameters) of a function each of its variables may depend on, so that the
+// derivatives that are always zero can be skipped. Elements of indexed variables written with a number index are
+// tracked separately.
+// The analysis ignores the order of the statements: a variable depends on everything assigned to it anywhere.
+class ActivityAnalysis {
+public:
+    typedef std::vector<bool> Inputs;
+
+    // Index of the elements written with an index that is not a number
+    static const int UNKNOWN_INDEX;
+
+protected:
+    size_t inputCount;
+    std::unordered_map<Symbol, size_t> inputIndexes;
+    std::unordered_map<Symbol, Inputs> dependencies;
+    std::unordered_map<Symbol, std::unordered_map<int, Inputs>> elements;
+    std::unordered_set<Symbol> indexed;
+
+public:
+    ActivityAnalysis(std::shared_ptr<Function> function, const std::vector<std::shared_ptr<Variable>> &inputs);
+
+    Inputs dependenciesOf(std::shared_ptr<Expression> expression);
+    // Dependencies of the element at index of the variable
+    Inputs dependenciesOf(Symbol variable, int index);
+    // Number of elements of the variable written with a number index
+    int elementCount(Symbol variable);
+    bool isIndexed(Symbol variable);
+
+    // Whether the variable (any of its elements) or its element at index may depend on the input.
+    // Variables that are not inputs of the function are always active.
+    bool isActive(Symbol variable, Symbol input);
+    bool isActive(Symbol variable, int index, Symbol input);
+
+protected:
+    // Propagates the dependencies through the statement, returns whether any of them changed
+    bool propagate(std::shared_ptr<Statement> statement);
+    bool propagate(std::shared_ptr<Expression> expression);
+    bool merge(Inputs &target, const Inputs &source);
+};
+
+#endif //FINAL_PROJECT_ACTIVITY_ANALYSIS_H
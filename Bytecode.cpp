@@ -0,0 +1,664 @@
+#include "Bytecode.h"
+#include "Diff.h"
+#include <cmath>
+#include <stdexcept>
+
+static const std::unordered_map<std::string, Bytecode::Op> UNARY_FUNCTIONS = {
+        {"std::sin", Bytecode::SIN}, {"std::cos", Bytecode::COS}, {"std::exp", Bytecode::EXP},
+        {"std::log", Bytecode::LOG}, {"std::abs", Bytecode::ABS}};
+
+static bool isIntegerType(const Type &type) {
+    return type.name == "int" || type.name == "long" || type.name == "size_t" || type.name == "bool";
+}
+
+Bytecode Bytecode::compile(std::shared_ptr<Function> function) {
+    BytecodeCompiler compiler;
+    return compiler.compile(std::move(function));
+}
+
+std::unordered_map<std::string, Bytecode> Bytecode::compile(std::shared_ptr<FileNode> file) {
+    std::unordered_map<std::string, Bytecode> result;
+    for (std::shared_ptr<Statement> &statement: file->statements) {
+        if (statement->getType() != Statement::FUNCTION) {
+            continue;
+        }
+        std::shared_ptr<Function> function = std::dynamic_pointer_cast<Function>(statement);
+        try {
+            result.emplace(function->declaration->name, compile(function));
+        } catch (DiffException &) {
+            // Left to the compiled functions
+        }
+    }
+    return result;
+}
+
+void Bytecode::run(const double *inputs, double *outputs, std::vector<double> &slots) const {
+    double *s = slots.data();
+    std::copy(inputs, inputs + inputCount, s);
+    const Instruction *instructions = code.data();
+    size_t size = code.size();
+    for (size_t pc = 0; pc < size; ++pc) {
+        const Instruction &i = instructions[pc];
+        switch (i.op) {
+            case MOVE: s[i.dst] = s[i.a]; break;
+            case FILL: std::fill(s + i.dst, s + i.dst + i.b, s[i.a]); break;
+            case ADD: s[i.dst] = s[i.a] + s[i.b]; break;
+            case SUBTRACT: s[i.dst] = s[i.a] - s[i.b]; break;
+            case MULTIPLY: s[i.dst] = s[i.a] * s[i.b]; break;
+            case DIVIDE: s[i.dst] = s[i.a] / s[i.b]; break;
+            case INTEGER_DIVIDE: s[i.dst] = std::trunc(s[i.a] / s[i.b]); break;
+            case NEGATE: s[i.dst] = -s[i.a]; break;
+            case NOT: s[i.dst] = s[i.a] == 0; break;
+            case TRUNCATE: s[i.dst] = std::trunc(s[i.a]); break;
+            case LESS: s[i.dst] = s[i.a] < s[i.b]; break;
+            case MORE: s[i.dst] = s[i.a] > s[i.b]; break;
+            case LESS_EQUALS: s[i.dst] = s[i.a] <= s[i.b]; break;
+            case MORE_EQUALS: s[i.dst] = s[i.a] >= s[i.b]; break;
+            case EQUALS: s[i.dst] = s[i.a] == s[i.b]; break;
+            case NOT_EQUALS: s[i.dst] = s[i.a] != s[i.b]; break;
+            case SIN: s[i.dst] = std::sin(s[i.a]); break;
+            case COS: s[i.dst] = std::cos(s[i.a]); break;
+            case EXP: s[i.dst] = std::exp(s[i.a]); break;
+            case LOG: s[i.dst] = std::log(s[i.a]); break;
+            case ABS: s[i.dst] = std::abs(s[i.a]); break;
+            case POW: s[i.dst] = std::pow(s[i.a], s[i.b]); break;
+            case LOAD: s[i.dst] = s[i.a + (int32_t) s[i.b]]; break;
+            case STORE: s[i.dst + (int32_t) s[i.a]] = s[i.b]; break;
+            case CHECK_INDEX:
+                if (!(s[i.a] >= 0 && s[i.a] < i.b)) {
+                    throw std::out_of_range("Index " + std::to_string(s[i.a]) + " out of range in '" + name + "'");
+                }
+                break;
+            // The loop increments pc
+            case JUMP: pc = i.dst - 1; break;
+            case JUMP_IF_ZERO: if (s[i.a] == 0) { pc = i.dst - 1; } break;
+        }
+    }
+    std::copy(s + outputSlot, s + outputSlot + outputCount, outputs);
+}
+
+int32_t BytecodeCompiler::Storage::size() const {
+    int32_t result = 1;
+    for (int32_t dim: dims) {
+        result *= dim;
+    }
+    return result;
+}
+
+bool BytecodeCompiler::Storage::isSized() const {
+    return std::find(dims.begin(), dims.end(), -1) == dims.end();
+}
+
+bool BytecodeCompiler::Reference::isScalar() const {
+    return depth == storage.dims.size();
+}
+
+int32_t BytecodeCompiler::Reference::size() const {
+    int32_t result = 1;
+    for (size_t i = depth; i < storage.dims.size(); ++i) {
+        result *= storage.dims[i];
+    }
+    return result;
+}
+
+Bytecode BytecodeCompiler::compile(std::shared_ptr<Function> function) {
+    program.name = function->declaration->name;
+    scopes.emplace_back();
+    // The parameters take the first slots, in order, for run to copy the inputs to
+    for (std::shared_ptr<Variable> &param: function->declaration->params) {
+        Storage storage;
+        storage.dims = dimensionsOf(param->type, nullptr);
+        storage.integer = isIntegerType(param->type);
+        if (!storage.isSized()) {
+            throw DiffException("Vector parameters need a constant size in the bytecode");
+        }
+        storage.slot = allocate(storage.size());
+        scopes.back()[param->symbol] = storage;
+    }
+    program.inputCount = program.initialSlots.size();
+
+    for (std::shared_ptr<Statement> &statement: function->block->statements) {
+        compile(statement);
+    }
+    if (returns.empty()) {
+        throw DiffException("Function '" + program.name + "' does not return a value");
+    }
+    for (size_t jump: returns) {
+        program.code[jump].dst = (int32_t) program.code.size();
+    }
+    return std::move(program);
+}
+
+void BytecodeCompiler::compile(std::shared_ptr<Statement> statement) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            compileExpression(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr);
+            break;
+        case Statement::RETURN:
+            returnValue(std::dynamic_pointer_cast<ReturnStatement>(statement)->expr);
+            break;
+        case Statement::BLOCK:
+            scopes.emplace_back();
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                compile(inner);
+            }
+            scopes.pop_back();
+            break;
+        case Statement::IF: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            size_t skip = emit(Bytecode::JUMP_IF_ZERO, 0, scalar(conditional->condition));
+            compile(conditional->statement);
+            if (conditional->elseStatement != nullptr) {
+                size_t end = emit(Bytecode::JUMP, 0);
+                program.code[skip].dst = (int32_t) program.code.size();
+                compile(conditional->elseStatement);
+                skip = end;
+            }
+            program.code[skip].dst = (int32_t) program.code.size();
+            break;
+        }
+        case Statement::WHILE_LOOP:
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<Expression> condition, expr;
+            std::shared_ptr<Statement> body;
+            scopes.emplace_back();
+            if (statement->getType() == Statement::FOR_LOOP) {
+                std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+                compile(loop->definition);
+                condition = loop->condition;
+                expr = loop->expr;
+                body = loop->statement;
+            } else {
+                std::shared_ptr<ConditionalStatement> loop = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+                condition = loop->condition;
+                body = loop->statement;
+            }
+            int32_t start = (int32_t) program.code.size();
+            breaks.emplace_back();
+            if (condition != nullptr) {
+                breaks.back().push_back(emit(Bytecode::JUMP_IF_ZERO, 0, scalar(condition)));
+            }
+            compile(body);
+            if (expr != nullptr) {
+                compileExpression(expr);
+            }
+            emit(Bytecode::JUMP, start);
+            for (size_t jump: breaks.back()) {
+                program.code[jump].dst = (int32_t) program.code.size();
+            }
+            breaks.pop_back();
+            scopes.pop_back();
+            break;
+        }
+        case Statement::BREAK:
+            if (breaks.empty()) {
+                throw DiffException("Break outside of a loop in '" + program.name + "'");
+            }
+            breaks.back().push_back(emit(Bytecode::JUMP, 0));
+            break;
+        case Statement::COMMENT:
+            break;
+        default: {
+            std::string text = statement->to_string();
+            throw DiffException("Statement '" + text.substr(0, text.find('\n')) + "' is not supported by the bytecode");
+        }
+    }
+}
+
+void BytecodeCompiler::compileExpression(std::shared_ptr<Expression> expression) {
+    if (expression->getType() == Expression::VARIABLE_DECLARATION) {
+        declare(std::dynamic_pointer_cast<Variable>(expression), nullptr);
+        return;
+    } else if (expression->getType() == Expression::BINARY_OPERATOR) {
+        std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+        if (op->op == BinaryOperator::EQUALS && op->left->getType() == Expression::VARIABLE_DECLARATION) {
+            declare(std::dynamic_pointer_cast<Variable>(op->left), op->right);
+            return;
+        } else if (op->op >= BinaryOperator::EQUALS && op->op <= BinaryOperator::DIVIDE_EQUALS) {
+            resolve(op->left, op->right);
+            assign(reference(op->left), op->op, op->right);
+            return;
+        }
+    } else if (expression->getType() == Expression::UNARY_OPERATOR) {
+        std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+        if (op->op == UnaryOperator::PLUS_PLUS || op->op == UnaryOperator::MINUS_MINUS) {
+            increment(op->expr, op->op == UnaryOperator::PLUS_PLUS ? 1 : -1);
+            return;
+        }
+    }
+    scalar(expression);
+}
+
+void BytecodeCompiler::declare(std::shared_ptr<Variable> variable, std::shared_ptr<Expression> value) {
+    Storage storage;
+    storage.integer = isIntegerType(variable->type);
+    if (variable->type.name == "auto" && value != nullptr && isReference(value)) {
+        Reference source = reference(value);
+        storage.dims.assign(source.storage.dims.begin() + (long) source.depth, source.storage.dims.end());
+        storage.integer = source.storage.integer;
+        storage.slot = allocate(storage.size());
+        scopes.back()[variable->symbol] = storage;
+        copy(source, Reference{storage});
+        return;
+    }
+
+    std::shared_ptr<Call> constructorCall = variable->constructorCall;
+    if (variable->type.name == "auto" && value != nullptr) {
+        // The scalar's type is the value's
+        int32_t slot = scalar(value, storage.integer);
+        storage.slot = allocate(1);
+        scopes.back()[variable->symbol] = storage;
+        emit(Bytecode::MOVE, storage.slot, slot);
+        return;
+    }
+    storage.dims = dimensionsOf(variable->type, constructorCall);
+    if (storage.dims.empty() && value == nullptr && constructorCall != nullptr && constructorCall->args.size() == 1) {
+        value = constructorCall->args[0];
+    }
+    if (value != nullptr && !storage.dims.empty()) {
+        Reference source = reference(value);
+        fit(storage, 0, source);
+        storage.slot = allocate(storage.size());
+        scopes.back()[variable->symbol] = storage;
+        copy(source, Reference{storage});
+    } else if (!storage.isSized()) {
+        // Allocated by resolve
+        storage.slot = -1;
+        scopes.back()[variable->symbol] = storage;
+    } else if (value != nullptr) {
+        bool integer;
+        int32_t slot = scalar(value, integer);
+        storage.slot = allocate(1);
+        scopes.back()[variable->symbol] = storage;
+        store(Reference{storage}, slot, integer);
+    } else {
+        // The vectors are filled with their second argument, everything else with zeros
+        int32_t fill = constant(0);
+        if (variable->type.name == "std::vector" && constructorCall != nullptr && constructorCall->args.size() == 2) {
+            fill = scalar(constructorCall->args[1]);
+        }
+        storage.slot = allocate(storage.size());
+        scopes.back()[variable->symbol] = storage;
+        emit(Bytecode::FILL, storage.slot, fill, storage.size());
+    }
+}
+
+void BytecodeCompiler::assign(Reference target, BinaryOperator::Operation op, std::shared_ptr<Expression> value) {
+    if (!target.isScalar()) {
+        if (op != BinaryOperator::EQUALS) {
+            throw DiffException("Compound assignments to arrays are not supported by the bytecode");
+        }
+        copy(reference(value), target);
+        return;
+    }
+    bool integer;
+    int32_t slot = scalar(value, integer);
+    if (op != BinaryOperator::EQUALS) {
+        Bytecode::Op arithmetic = op == BinaryOperator::PLUS_EQUALS ? Bytecode::ADD :
+                                  op == BinaryOperator::MINUS_EQUALS ? Bytecode::SUBTRACT :
+                                  op == BinaryOperator::MULTIPLY_EQUALS ? Bytecode::MULTIPLY : Bytecode::DIVIDE;
+        integer = integer && target.storage.integer;
+        if (arithmetic == Bytecode::DIVIDE && integer) {
+            arithmetic = Bytecode::INTEGER_DIVIDE;
+        }
+        int32_t result = allocate(1);
+        emit(arithmetic, result, load(target), slot);
+        slot = result;
+    }
+    store(target, slot, integer);
+}
+
+void BytecodeCompiler::increment(std::shared_ptr<Expression> target, double step) {
+    Reference destination = reference(target);
+    if (!destination.isScalar()) {
+        throw DiffException("Arrays cannot be incremented");
+    }
+    int32_t result = allocate(1);
+    emit(Bytecode::ADD, result, load(destination), constant(step));
+    store(destination, result, true);
+}
+
+void BytecodeCompiler::returnValue(std::shared_ptr<Expression> value) {
+    // The value and the derivative of a std::make_pair follow each other in the result
+    std::vector<std::shared_ptr<Expression>> parts{value};
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(value);
+    if (call != nullptr && call->signature.name == "std::make_pair") {
+        parts = call->args;
+    }
+    std::vector<Reference> sources;
+    int32_t size = 0;
+    for (std::shared_ptr<Expression> &part: parts) {
+        Reference source;
+        if (isReference(part)) {
+            source = reference(part);
+        } else {
+            source.storage.slot = scalar(part);
+        }
+        sources.push_back(source);
+        size += source.size();
+    }
+    if (returns.empty()) {
+        program.outputSlot = allocate(size);
+        program.outputCount = size;
+    } else if (size != (int32_t) program.outputCount) {
+        throw DiffException("The returns of '" + program.name + "' have different sizes");
+    }
+
+    Reference output;
+    output.storage.slot = program.outputSlot;
+    for (Reference &source: sources) {
+        output.storage.dims.assign(source.storage.dims.begin() + (long) source.depth, source.storage.dims.end());
+        copy(source, output);
+        output.storage.slot += source.size();
+    }
+    returns.push_back(emit(Bytecode::JUMP, 0));
+}
+
+void BytecodeCompiler::resolve(std::shared_ptr<Expression> target, std::shared_ptr<Expression> value) {
+    size_t depth = 0;
+    std::shared_ptr<BinaryOperator> indexing;
+    while ((indexing = std::dynamic_pointer_cast<BinaryOperator>(target)) != nullptr &&
+            indexing->op == BinaryOperator::INDEXING) {
+        target = indexing->left;
+        ++depth;
+    }
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(target);
+    if (variable == nullptr || find(variable->symbol).slot >= 0 || !isReference(value)) {
+        return;
+    }
+    Reference source = reference(value);
+    Storage &storage = find(variable->symbol);
+    fit(storage, depth, source);
+    if (!storage.isSized()) {
+        throw DiffException("The size of '" + variable->name + "' is not known in the bytecode");
+    }
+    storage.slot = allocate(storage.size());
+}
+
+void BytecodeCompiler::fit(Storage &storage, size_t depth, const Reference &source) {
+    if (storage.dims.size() - depth != source.storage.dims.size() - source.depth) {
+        throw DiffException("Copy between arrays of different sizes in '" + program.name + "'");
+    }
+    for (size_t i = depth; i < storage.dims.size(); ++i) {
+        int32_t dim = source.storage.dims[source.depth + i - depth];
+        if (storage.dims[i] == -1) {
+            storage.dims[i] = dim;
+        } else if (storage.dims[i] != dim) {
+            throw DiffException("Copy between arrays of different sizes in '" + program.name + "'");
+        }
+    }
+}
+
+int32_t BytecodeCompiler::scalar(std::shared_ptr<Expression> expression) {
+    bool integer;
+    return scalar(std::move(expression), integer);
+}
+
+int32_t BytecodeCompiler::scalar(std::shared_ptr<Expression> expression, bool &integer) {
+    integer = false;
+    if (isReference(expression)) {
+        Reference source = reference(expression);
+        if (!source.isScalar()) {
+            throw DiffException("Array '" + expression->to_string() + "' used as a value");
+        }
+        integer = source.storage.integer;
+        return load(source);
+    }
+
+    switch (expression->getType()) {
+        case Expression::ELEMENTARY_VALUE: {
+            std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(expression);
+            if (number == nullptr) {
+                break;
+            }
+            integer = !number->floating;
+            return constant(number->value);
+        }
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            if (op->op == UnaryOperator::PLUS_PLUS || op->op == UnaryOperator::MINUS_MINUS) {
+                // The value after the increment
+                increment(op->expr, op->op == UnaryOperator::PLUS_PLUS ? 1 : -1);
+                return scalar(op->expr, integer);
+            }
+            int32_t slot = scalar(op->expr, integer);
+            if (op->op == UnaryOperator::PLUS || op->op == UnaryOperator::BRACES) {
+                return slot;
+            }
+            int32_t result = allocate(1);
+            if (op->op == UnaryOperator::NOT) {
+                integer = true;
+                emit(Bytecode::NOT, result, slot);
+            } else {
+                emit(Bytecode::NEGATE, result, slot);
+            }
+            return result;
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            if (op->op >= BinaryOperator::EQUALS && op->op <= BinaryOperator::DIVIDE_EQUALS) {
+                compileExpression(expression);
+                return scalar(op->left, integer);
+            } else if (op->op == BinaryOperator::POINT) {
+                std::shared_ptr<Call> method = std::dynamic_pointer_cast<Call>(op->right);
+                if (method != nullptr && method->signature.name == "std::vector::size" && isReference(op->left)) {
+                    integer = true;
+                    return constant(reference(op->left).size());
+                }
+                break;
+            } else if (op->op == BinaryOperator::AND || op->op == BinaryOperator::OR) {
+                // Short-circuits, the right side is skipped when the left one is false for && and true for ||
+                integer = true;
+                int32_t result = allocate(1);
+                emit(Bytecode::NOT, result, scalar(op->left));
+                if (op->op == BinaryOperator::AND) {
+                    emit(Bytecode::NOT, result, result);
+                }
+                size_t skip = emit(Bytecode::JUMP_IF_ZERO, 0, result);
+                emit(Bytecode::NOT, result, scalar(op->right));
+                emit(Bytecode::NOT, result, result);
+                if (op->op == BinaryOperator::OR) {
+                    size_t end = emit(Bytecode::JUMP, 0);
+                    program.code[skip].dst = (int32_t) program.code.size();
+                    emit(Bytecode::MOVE, result, constant(1));
+                    skip = end;
+                }
+                program.code[skip].dst = (int32_t) program.code.size();
+                return result;
+            }
+            bool leftInteger, rightInteger;
+            int32_t left = scalar(op->left, leftInteger);
+            int32_t right = scalar(op->right, rightInteger);
+            integer = leftInteger && rightInteger;
+            Bytecode::Op code;
+            switch (op->op) {
+                case BinaryOperator::PLUS: code = Bytecode::ADD; break;
+                case BinaryOperator::MINUS: code = Bytecode::SUBTRACT; break;
+                case BinaryOperator::MULTIPLY: code = Bytecode::MULTIPLY; break;
+                case BinaryOperator::DIVIDE: code = integer ? Bytecode::INTEGER_DIVIDE : Bytecode::DIVIDE; break;
+                case BinaryOperator::IS_EQUAL: code = Bytecode::EQUALS; integer = true; break;
+                case BinaryOperator::NOT_EQUALS: code = Bytecode::NOT_EQUALS; integer = true; break;
+                case BinaryOperator::LESS: code = Bytecode::LESS; integer = true; break;
+                case BinaryOperator::MORE: code = Bytecode::MORE; integer = true; break;
+                case BinaryOperator::LESS_EQUALS: code = Bytecode::LESS_EQUALS; integer = true; break;
+                case BinaryOperator::MORE_EQUALS: code = Bytecode::MORE_EQUALS; integer = true; break;
+                default:
+                    throw DiffException("Operator '" + op->to_string() + "' is not supported by the bytecode");
+            }
+            int32_t result = allocate(1);
+            emit(code, result, left, right);
+            return result;
+        }
+        case Expression::CALL: {
+            std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+            const std::string &name = call->signature.name;
+            auto function = UNARY_FUNCTIONS.find(name);
+            int32_t result;
+            if (function != UNARY_FUNCTIONS.end() && call->args.size() == 1) {
+                int32_t arg = scalar(call->args[0]);
+                result = allocate(1);
+                emit(function->second, result, arg);
+            } else if (name == "std::pow" && call->args.size() == 2) {
+                int32_t base = scalar(call->args[0]);
+                int32_t exponent = scalar(call->args[1]);
+                result = allocate(1);
+                emit(Bytecode::POW, result, base, exponent);
+            } else {
+                throw DiffException("Calls to '" + name + "' are not supported by the bytecode");
+            }
+            return result;
+        }
+        default:
+            break;
+    }
+    throw DiffException("Expression '" + expression->to_string() + "' is not supported by the bytecode");
+}
+
+int32_t BytecodeCompiler::load(const Reference &reference) {
+    int32_t slot = reference.storage.slot + reference.offset;
+    if (reference.dynamicOffset < 0) {
+        return slot;
+    }
+    int32_t result = allocate(1);
+    emit(Bytecode::LOAD, result, slot, reference.dynamicOffset);
+    return result;
+}
+
+void BytecodeCompiler::store(const Reference &reference, int32_t value, bool integer) {
+    if (reference.storage.integer && !integer) {
+        int32_t truncated = allocate(1);
+        emit(Bytecode::TRUNCATE, truncated, value);
+        value = truncated;
+    }
+    int32_t slot = reference.storage.slot + reference.offset;
+    if (reference.dynamicOffset < 0) {
+        emit(Bytecode::MOVE, slot, value);
+    } else {
+        emit(Bytecode::STORE, slot, reference.dynamicOffset, value);
+    }
+}
+
+bool BytecodeCompiler::isReference(std::shared_ptr<Expression> expression) {
+    switch (expression->getType()) {
+        case Expression::VARIABLE:
+            return true;
+        case Expression::BINARY_OPERATOR:
+            return std::dynamic_pointer_cast<BinaryOperator>(expression)->op == BinaryOperator::INDEXING;
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            return op->op == UnaryOperator::BRACES && isReference(op->expr);
+        }
+        default:
+            return false;
+    }
+}
+
+BytecodeCompiler::Reference BytecodeCompiler::reference(std::shared_ptr<Expression> expression) {
+    if (expression->getType() == Expression::VARIABLE) {
+        std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+        Storage &storage = find(variable->symbol);
+        if (storage.slot < 0) {
+            throw DiffException("The size of '" + variable->name + "' is not known in the bytecode");
+        }
+        return Reference{storage};
+    } else if (expression->getType() == Expression::UNARY_OPERATOR) {
+        return reference(std::dynamic_pointer_cast<UnaryOperator>(expression)->expr);
+    } else if (!isReference(expression)) {
+        throw DiffException("Expression '" + expression->to_string() + "' is not an array");
+    }
+
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    Reference result = reference(op->left);
+    if (result.isScalar()) {
+        throw DiffException("Expression '" + op->left->to_string() + "' is not an array");
+    }
+    int32_t dim = result.storage.dims[result.depth];
+    ++result.depth;
+    int32_t stride = result.size();
+    if (op->right->getType() == Expression::ELEMENTARY_VALUE) {
+        // Constant indexes are resolved to the slots
+        double index = std::dynamic_pointer_cast<Number>(op->right)->value;
+        if (index < 0 || index >= dim) {
+            throw DiffException("Index out of range in '" + expression->to_string() + "'");
+        }
+        result.offset += (int32_t) index * stride;
+        return result;
+    }
+    int32_t index = scalar(op->right);
+    emit(Bytecode::CHECK_INDEX, 0, index, dim);
+    if (stride != 1) {
+        int32_t scaled = allocate(1);
+        emit(Bytecode::MULTIPLY, scaled, index, constant(stride));
+        index = scaled;
+    }
+    if (result.dynamicOffset >= 0) {
+        int32_t sum = allocate(1);
+        emit(Bytecode::ADD, sum, result.dynamicOffset, index);
+        index = sum;
+    }
+    result.dynamicOffset = index;
+    return result;
+}
+
+void BytecodeCompiler::copy(const Reference &source, const Reference &target) {
+    if (source.size() != target.size() || source.isScalar() != target.isScalar()) {
+        throw DiffException("Copy between arrays of different sizes in '" + program.name + "'");
+    }
+    for (int32_t i = 0; i < source.size(); ++i) {
+        Reference from = source, to = target;
+        from.offset += i;
+        to.offset += i;
+        from.depth = from.storage.dims.size();
+        to.depth = to.storage.dims.size();
+        store(to, load(from), source.storage.integer);
+    }
+}
+
+int32_t BytecodeCompiler::allocate(int32_t size) {
+    int32_t result = (int32_t) program.initialSlots.size();
+    program.initialSlots.resize(program.initialSlots.size() + size, 0);
+    return result;
+}
+
+int32_t BytecodeCompiler::constant(double value) {
+    auto it = constants.find(value);
+    if (it != constants.end()) {
+        return it->second;
+    }
+    int32_t slot = allocate(1);
+    program.initialSlots[slot] = value;
+    constants[value] = slot;
+    return slot;
+}
+
+size_t BytecodeCompiler::emit(Bytecode::Op op, int32_t dst, int32_t a, int32_t b) {
+    program.code.push_back(Bytecode::Instruction{op, dst, a, b});
+    return program.code.size() - 1;
+}
+
+BytecodeCompiler::Storage &BytecodeCompiler::find(Symbol symbol) {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto it = scope->find(symbol);
+        if (it != scope->end()) {
+            return it->second;
+        }
+    }
+    throw DiffException("Variable '" + SymbolTable::global().name(symbol) + "' is not declared");
+}
+
+std::vector<int32_t> BytecodeCompiler::dimensionsOf(const Type &type, std::shared_ptr<Call> constructorCall) {
+    std::vector<int32_t> result;
+    if (type.name == "std::array" && type.generics.size() == 2) {
+        result.push_back(std::stoi(type.generics[1].name));
+    } else if (type.name == "std::vector" && constructorCall != nullptr && !constructorCall->args.empty() &&
+            constructorCall->args[0]->getType() == Expression::ELEMENTARY_VALUE) {
+        result.push_back((int32_t) std::dynamic_pointer_cast<Number>(constructorCall->args[0])->value);
+    } else if (type.name == "std::vector") {
+        result.push_back(-1);
+    } else {
+        return result;
+    }
+    std::vector<int32_t> inner = dimensionsOf(type.generics[0], nullptr);
+    result.insert(result.end(), inner.begin(), inner.end());
+    return result;
+}
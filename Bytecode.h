@@ -0,0 +1,124 @@
+#ifndef FINAL_PROJECT_BYTECODE_H
+#define FINAL_PROJECT_BYTECODE_H
+
+#include "SyntaxTreeNode.h"
+#include <cstdint>
+#include <unordered_map>
+
+// A generated function lowered to a linear program over numbered slots of doubles, run by an interpreter, so that
+// the derivatives of a model parsed at runtime are evaluated without compiling C++.
+// Every scalar of the function has a slot and arrays have consecutive slots, the parameters first in their order,
+// then the result. The constants are slots set once when the slots are allocated. Integers are stored exactly as
+// doubles and divided with truncation.
+class Bytecode {
+public:
+    enum Op: uint8_t {
+        MOVE,
+        // Sets the b slots from dst to a's value
+        FILL,
+        ADD, SUBTRACT, MULTIPLY, DIVIDE, INTEGER_DIVIDE,
+        NEGATE, NOT, TRUNCATE,
+        LESS, MORE, LESS_EQUALS, MORE_EQUALS, EQUALS, NOT_EQUALS,
+        SIN, COS, EXP, LOG, ABS, POW,
+        // dst = slots[a + slots[b]] and slots[dst + slots[a]] = slots[b], with indexes checked by CHECK_INDEX
+        LOAD, STORE,
+        // Throws std::out_of_range unless 0 <= slots[a] < b
+        CHECK_INDEX,
+        JUMP,
+        // Jumps to dst when slots[a] is zero
+        JUMP_IF_ZERO
+    };
+
+    struct Instruction {
+        Op op;
+        int32_t dst;
+        int32_t a;
+        int32_t b;
+    };
+
+    std::string name;
+    std::vector<Instruction> code;
+    // The slots as allocated, with the constants set
+    std::vector<double> initialSlots;
+    size_t inputCount = 0;
+    int32_t outputSlot = 0;
+    size_t outputCount = 0;
+
+    // Lowers the function, throwing a DiffException for the statements and the calls it cannot run
+    static Bytecode compile(std::shared_ptr<Function> function);
+    // The functions of the file that can be lowered, by name
+    static std::unordered_map<std::string, Bytecode> compile(std::shared_ptr<FileNode> file);
+
+    // Runs the program with inputs, the flattened parameters, writing the flattened result to outputs. slots must
+    // be a copy of initialSlots, which is kept between runs so that no memory is allocated.
+    void run(const double *inputs, double *outputs, std::vector<double> &slots) const;
+};
+
+class BytecodeCompiler {
+protected:
+    // Slots of a variable, an array of dimensions dims flattened in row major order. The vectors declared without a
+    // constant size, such as the elements of std::array<std::vector<double>, 2>, have the dimension -1 and no slots
+    // (slot -1) until their size is known from the first array assigned to them.
+    struct Storage {
+        int32_t slot = 0;
+        std::vector<int32_t> dims;
+        bool integer = false;
+
+        int32_t size() const;
+        bool isSized() const;
+    };
+
+    // A scalar value or a part of an array, possibly at an offset only known when running
+    struct Reference {
+        Storage storage;
+        int32_t offset = 0;
+        // Slot holding the offset added to offset, -1 without one
+        int32_t dynamicOffset = -1;
+        size_t depth = 0;
+
+        bool isScalar() const;
+        int32_t size() const;
+    };
+
+    Bytecode program;
+    std::vector<std::unordered_map<Symbol, Storage>> scopes;
+    std::unordered_map<double, int32_t> constants;
+    // Jumps to the end of the innermost loop
+    std::vector<std::vector<size_t>> breaks;
+    std::vector<size_t> returns;
+
+public:
+    Bytecode compile(std::shared_ptr<Function> function);
+
+protected:
+    void compile(std::shared_ptr<Statement> statement);
+    void compileExpression(std::shared_ptr<Expression> expression);
+    void declare(std::shared_ptr<Variable> variable, std::shared_ptr<Expression> value);
+    void assign(Reference target, BinaryOperator::Operation op, std::shared_ptr<Expression> value);
+    void increment(std::shared_ptr<Expression> target, double step);
+    void returnValue(std::shared_ptr<Expression> value);
+    // Allocates the variable that target assigns value to when it was declared without a size
+    void resolve(std::shared_ptr<Expression> target, std::shared_ptr<Expression> value);
+    // Sets the unknown dimensions of storage from depth on to the ones of source
+    void fit(Storage &storage, size_t depth, const Reference &source);
+
+    // Slot holding the scalar value of the expression, whether it is an integer in integer
+    int32_t scalar(std::shared_ptr<Expression> expression, bool &integer);
+    int32_t scalar(std::shared_ptr<Expression> expression);
+    int32_t load(const Reference &reference);
+    void store(const Reference &reference, int32_t value, bool integer);
+    // Whether the expression names a variable or an element, which may be an array
+    static bool isReference(std::shared_ptr<Expression> expression);
+    Reference reference(std::shared_ptr<Expression> expression);
+    // Copies the scalar or the array source to target
+    void copy(const Reference &source, const Reference &target);
+
+    int32_t allocate(int32_t size);
+    int32_t constant(double value);
+    size_t emit(Bytecode::Op op, int32_t dst, int32_t a=0, int32_t b=0);
+    Storage &find(Symbol symbol);
+    // The dimensions of an array type, empty for the scalars and -1 for the vectors without a constant size
+    static std::vector<int32_t> dimensionsOf(const Type &type, std::shared_ptr<Call> constructorCall);
+};
+
+#endif //FINAL_PROJECT_BYTECODE_H
@@ -0,0 +1,482 @@
+#include "ConstantPropagation.h"
+#include "Diff.h"
+#include <cmath>
+
+size_t ConstantPropagation::run(std::shared_ptr<Function> function) {
+    ConstantPropagation propagation;
+    std::unordered_map<Symbol, int> declarations;
+    for (std::shared_ptr<Variable> &param: function->declaration->params) {
+        declarations[param->symbol]++;
+    }
+    propagation.findTracked(function->block, declarations, false);
+    for (auto &declaration: declarations) {
+        if (declaration.second > 1) {
+            propagation.tracked.erase(declaration.first);
+        }
+    }
+    for (Symbol symbol: propagation.escaped) {
+        propagation.tracked.erase(symbol);
+    }
+
+    Values values;
+    propagation.propagate(function->block->statements, values);
+    return propagation.folded;
+}
+
+bool ConstantPropagation::evaluate(const std::string &function, const std::vector<double> &args, double &result) {
+    if (args.size() == 1 && function == "std::cos") {
+        result = std::cos(args[0]);
+    } else if (args.size() == 1 && function == "std::sin") {
+        result = std::sin(args[0]);
+    } else if (args.size() == 1 && function == "std::exp") {
+        result = std::exp(args[0]);
+    } else if (args.size() == 1 && function == "std::log") {
+        result = std::log(args[0]);
+    } else if (args.size() == 1 && function == "std::abs") {
+        result = std::abs(args[0]);
+    } else if (args.size() == 2 && function == "std::pow") {
+        result = std::pow(args[0], args[1]);
+    } else {
+        return false;
+    }
+    return std::isfinite(result);
+}
+
+void ConstantPropagation::propagate(std::vector<std::shared_ptr<Statement>> &statements, Values &values) {
+    for (std::shared_ptr<Statement> &statement: statements) {
+        propagate(statement, values);
+    }
+}
+
+void ConstantPropagation::propagate(std::shared_ptr<Statement> &statement, Values &values) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            propagateExpression(statement, values);
+            break;
+        case Statement::RETURN: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            if (expr != nullptr) {
+                std::shared_ptr<Expression> value = rewrite(expr, values);
+                if (value != expr) {
+                    statement = std::make_shared<ReturnStatement>(value);
+                }
+            }
+            break;
+        }
+        case Statement::BLOCK:
+            propagate(std::dynamic_pointer_cast<BlockStatement>(statement)->statements, values);
+            break;
+        case Statement::IF: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            conditional->condition = rewrite(conditional->condition, values);
+            Values thenValues = values;
+            propagate(conditional->statement, thenValues);
+            if (conditional->elseStatement != nullptr) {
+                propagate(conditional->elseStatement, values);
+            }
+            values = intersect(thenValues, values);
+            break;
+        }
+        case Statement::WHILE_LOOP: {
+            // Any variable assigned in the loop may differ in the next iteration
+            forgetAssigned(statement, values);
+            std::shared_ptr<ConditionalStatement> loop = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            loop->condition = rewrite(loop->condition, values);
+            Values bodyValues = values;
+            propagate(loop->statement, bodyValues);
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                propagate(loop->definition, values);
+            }
+            forgetAssigned(statement, values);
+            if (loop->condition != nullptr) {
+                loop->condition = rewrite(loop->condition, values);
+            }
+            if (loop->expr != nullptr) {
+                loop->expr = rewrite(loop->expr, values);
+            }
+            Values bodyValues = values;
+            propagate(loop->statement, bodyValues);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void ConstantPropagation::propagateExpression(std::shared_ptr<Statement> &statement, Values &values) {
+    std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expr);
+    std::shared_ptr<Variable> target = op == nullptr ? nullptr : std::dynamic_pointer_cast<Variable>(op->left);
+    bool assignment = op != nullptr && op->op >= BinaryOperator::EQUALS && op->op <= BinaryOperator::DIVIDE_EQUALS;
+
+    std::shared_ptr<Expression> result = rewrite(expr, values);
+    if (result != expr) {
+        statement = std::make_shared<ExpressionStatement>(result);
+    }
+    forgetAssigned(expr, values);
+    if (!assignment || target == nullptr || tracked.count(target->symbol) == 0) {
+        return;
+    }
+
+    std::shared_ptr<Number> value = std::dynamic_pointer_cast<Number>(std::dynamic_pointer_cast<BinaryOperator>(result)->right);
+    if (value != nullptr && op->op != BinaryOperator::EQUALS) {
+        // The compound assignments follow the order of the arithmetic operators
+        auto current = values.find(target->symbol);
+        auto arithmetic = (BinaryOperator::Operation) (op->op - BinaryOperator::PLUS_EQUALS + BinaryOperator::PLUS);
+        value = current == values.end() ? nullptr : fold(arithmetic, current->second, value);
+    }
+    if (value != nullptr) {
+        value = convert(value, tracked[target->symbol]);
+    }
+    if (value != nullptr) {
+        values[target->symbol] = value;
+    }
+}
+
+std::shared_ptr<Expression> ConstantPropagation::rewrite(std::shared_ptr<Expression> expression, Values &values) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+
+    if (variable != nullptr && !variable->declaration) {
+        auto value = values.find(variable->symbol);
+        if (value == values.end()) {
+            return expression;
+        }
+        ++folded;
+        return std::shared_ptr<Number>(value->second->copy());
+    } else if (variable != nullptr && variable->constructorCall != nullptr) {
+        std::shared_ptr<Expression> constructorCall = rewrite(variable->constructorCall, values);
+        if (constructorCall == variable->constructorCall) {
+            return expression;
+        }
+        return std::make_shared<Variable>(variable->type, variable->symbol, true,
+                                          std::dynamic_pointer_cast<Call>(constructorCall));
+    } else if (unary != nullptr) {
+        if (unary->op == UnaryOperator::PLUS_PLUS || unary->op == UnaryOperator::MINUS_MINUS) {
+            return expression;
+        }
+        std::shared_ptr<Expression> expr = rewrite(unary->expr, values);
+        std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(expr);
+        if (number != nullptr && unary->op != UnaryOperator::NOT) {
+            ++folded;
+            return unary->op == UnaryOperator::MINUS ? std::make_shared<Number>(-number->value, number->floating) : number;
+        }
+        return expr == unary->expr ? expression : std::make_shared<UnaryOperator>(unary->op, expr);
+    } else if (binary != nullptr) {
+        if (binary->op == BinaryOperator::POINT) {
+            return expression;
+        }
+        // Neither the assigned variables nor the indexed ones are replaced, only the indexes
+        bool assignment = binary->op >= BinaryOperator::EQUALS && binary->op <= BinaryOperator::DIVIDE_EQUALS;
+        std::shared_ptr<Expression> left = binary->left;
+        if (assignment || binary->op == BinaryOperator::INDEXING) {
+            std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(left);
+            if (indexing != nullptr && indexing->op == BinaryOperator::INDEXING) {
+                left = rewrite(left, values);
+            }
+        } else {
+            left = rewrite(left, values);
+        }
+        std::shared_ptr<Expression> right = rewrite(binary->right, values);
+
+        std::shared_ptr<Number> leftNumber = std::dynamic_pointer_cast<Number>(left);
+        std::shared_ptr<Number> rightNumber = std::dynamic_pointer_cast<Number>(right);
+        if (leftNumber != nullptr && rightNumber != nullptr) {
+            std::shared_ptr<Number> value = fold(binary->op, leftNumber, rightNumber);
+            if (value != nullptr) {
+                ++folded;
+                return value;
+            }
+        }
+        std::shared_ptr<Expression> simplified = simplify(binary->op, left, right);
+        if (simplified != nullptr) {
+            ++folded;
+            return simplified;
+        }
+        if (left == binary->left && right == binary->right) {
+            return expression;
+        }
+        return std::make_shared<BinaryOperator>(binary->op, left, right);
+    } else if (call != nullptr) {
+        // The other functions may take the variables by reference
+        bool library = call->signature.name.compare(0, 5, "std::") == 0;
+        bool changed = false;
+        std::vector<std::shared_ptr<Expression>> args;
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            args.push_back(library || std::dynamic_pointer_cast<Variable>(arg) == nullptr ? rewrite(arg, values) : arg);
+            changed = changed || args.back() != arg;
+        }
+        std::shared_ptr<Call> result = changed ? std::make_shared<Call>(call->signature, args) : call;
+        std::shared_ptr<Number> value = fold(result);
+        if (value != nullptr) {
+            ++folded;
+            return value;
+        }
+        return result;
+    }
+    return expression;
+}
+
+std::shared_ptr<Number> ConstantPropagation::fold(BinaryOperator::Operation op, std::shared_ptr<Number> left,
+                                                  std::shared_ptr<Number> right) {
+    bool floating = left->floating || right->floating;
+    double value;
+    switch (op) {
+        case BinaryOperator::PLUS:
+            value = left->value + right->value;
+            break;
+        case BinaryOperator::MINUS:
+            value = left->value - right->value;
+            break;
+        case BinaryOperator::MULTIPLY:
+            value = left->value * right->value;
+            break;
+        case BinaryOperator::DIVIDE:
+            if (right->value == 0) {
+                return nullptr;
+            }
+            value = floating ? left->value / right->value : std::trunc(left->value / right->value);
+            break;
+        default:
+            return nullptr;
+    }
+    if (!std::isfinite(value)) {
+        return nullptr;
+    }
+    return std::make_shared<Number>(value, floating);
+}
+
+std::shared_ptr<Expression> ConstantPropagation::simplify(BinaryOperator::Operation op, std::shared_ptr<Expression> left,
+                                                          std::shared_ptr<Expression> right) {
+    std::shared_ptr<Number> leftNumber = std::dynamic_pointer_cast<Number>(left);
+    std::shared_ptr<Number> rightNumber = std::dynamic_pointer_cast<Number>(right);
+    bool leftZero = leftNumber != nullptr && leftNumber->isZero();
+    bool rightZero = rightNumber != nullptr && rightNumber->isZero();
+    bool leftOne = leftNumber != nullptr && leftNumber->isOne();
+    bool rightOne = rightNumber != nullptr && rightNumber->isOne();
+    switch (op) {
+        case BinaryOperator::PLUS:
+            return leftZero ? right : rightZero ? left : nullptr;
+        case BinaryOperator::MINUS:
+            if (leftZero) {
+                return std::make_shared<UnaryOperator>(UnaryOperator::MINUS, right);
+            }
+            return rightZero ? left : nullptr;
+        case BinaryOperator::MULTIPLY:
+            if (leftZero && Diff::isPure(right)) {
+                return left;
+            } else if (rightZero && Diff::isPure(left)) {
+                return right;
+            }
+            return leftOne ? right : rightOne ? left : nullptr;
+        case BinaryOperator::DIVIDE:
+            return rightOne ? left : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+std::shared_ptr<Number> ConstantPropagation::fold(std::shared_ptr<Call> call) {
+    std::vector<double> args;
+    for (std::shared_ptr<Expression> &arg: call->args) {
+        std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(arg);
+        if (number == nullptr) {
+            return nullptr;
+        }
+        args.push_back(number->value);
+    }
+    double value;
+    if (!evaluate(call->signature.name, args, value)) {
+        return nullptr;
+    }
+    // Only std::abs keeps an integer integer
+    bool floating = call->signature.name != "std::abs" || std::dynamic_pointer_cast<Number>(call->args[0])->floating;
+    return std::make_shared<Number>(value, floating);
+}
+
+std::shared_ptr<Number> ConstantPropagation::convert(std::shared_ptr<Number> number, bool floating) {
+    if (floating) {
+        return number->floating ? number : std::make_shared<Number>(number->value, true);
+    }
+    double value = std::trunc(number->value);
+    if (std::abs(value) > 2147483647.0) {
+        return nullptr;
+    }
+    return std::make_shared<Number>(value, false);
+}
+
+void ConstantPropagation::forgetAssigned(std::shared_ptr<Statement> statement, Values &values) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            forgetAssigned(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr, values);
+            break;
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                forgetAssigned(inner, values);
+            }
+            break;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            forgetAssigned(conditional->condition, values);
+            forgetAssigned(conditional->statement, values);
+            if (conditional->elseStatement != nullptr) {
+                forgetAssigned(conditional->elseStatement, values);
+            }
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                forgetAssigned(loop->definition, values);
+            }
+            if (loop->condition != nullptr) {
+                forgetAssigned(loop->condition, values);
+            }
+            if (loop->expr != nullptr) {
+                forgetAssigned(loop->expr, values);
+            }
+            forgetAssigned(loop->statement, values);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void ConstantPropagation::forgetAssigned(std::shared_ptr<Expression> expression, Values &values) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+    if (variable != nullptr && variable->declaration) {
+        values.erase(variable->symbol);
+    } else if (unary != nullptr) {
+        std::shared_ptr<Variable> operand = std::dynamic_pointer_cast<Variable>(unary->expr);
+        if (operand != nullptr && (unary->op == UnaryOperator::PLUS_PLUS || unary->op == UnaryOperator::MINUS_MINUS)) {
+            values.erase(operand->symbol);
+        }
+        forgetAssigned(unary->expr, values);
+    } else if (binary != nullptr) {
+        std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(binary->left);
+        if (target != nullptr && binary->op >= BinaryOperator::EQUALS && binary->op <= BinaryOperator::DIVIDE_EQUALS) {
+            values.erase(target->symbol);
+        }
+        forgetAssigned(binary->left, values);
+        forgetAssigned(binary->right, values);
+    } else if (call != nullptr) {
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            forgetAssigned(arg, values);
+        }
+    }
+}
+
+ConstantPropagation::Values ConstantPropagation::intersect(const Values &first, const Values &second) {
+    Values result;
+    for (auto &value: first) {
+        auto other = second.find(value.first);
+        if (other != second.end() && other->second->value == value.second->value &&
+                other->second->floating == value.second->floating) {
+            result.insert(value);
+        }
+    }
+    return result;
+}
+
+void ConstantPropagation::findTracked(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &declarations,
+                                      bool inLambda) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            findTracked(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr, declarations, inLambda);
+            break;
+        case Statement::RETURN: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            if (expr != nullptr) {
+                findTracked(expr, declarations, inLambda);
+            }
+            break;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                findTracked(inner, declarations, inLambda);
+            }
+            break;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            findTracked(conditional->condition, declarations, inLambda);
+            findTracked(conditional->statement, declarations, inLambda);
+            if (conditional->elseStatement != nullptr) {
+                findTracked(conditional->elseStatement, declarations, inLambda);
+            }
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                findTracked(loop->definition, declarations, inLambda);
+            }
+            if (loop->condition != nullptr) {
+                findTracked(loop->condition, declarations, inLambda);
+            }
+            if (loop->expr != nullptr) {
+                findTracked(loop->expr, declarations, inLambda);
+            }
+            findTracked(loop->statement, declarations, inLambda);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void ConstantPropagation::findTracked(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &declarations,
+                                      bool inLambda) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+    std::shared_ptr<Lambda> lambda = std::dynamic_pointer_cast<Lambda>(expression);
+    if (variable != nullptr && variable->declaration) {
+        declarations[variable->symbol]++;
+        if (!inLambda && (variable->type.name == "double" || variable->type.name == "int")) {
+            tracked[variable->symbol] = variable->type.name == "double";
+        }
+        if (variable->constructorCall != nullptr) {
+            findTracked(variable->constructorCall, declarations, inLambda);
+        }
+    } else if (unary != nullptr) {
+        std::shared_ptr<Variable> operand = std::dynamic_pointer_cast<Variable>(unary->expr);
+        if (inLambda && operand != nullptr) {
+            escaped.insert(operand->symbol);
+        }
+        findTracked(unary->expr, declarations, inLambda);
+    } else if (binary != nullptr) {
+        std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(binary->left);
+        if (inLambda && target != nullptr && binary->op >= BinaryOperator::EQUALS &&
+                binary->op <= BinaryOperator::DIVIDE_EQUALS) {
+            escaped.insert(target->symbol);
+        }
+        findTracked(binary->left, declarations, inLambda);
+        findTracked(binary->right, declarations, inLambda);
+    } else if (call != nullptr) {
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            std::shared_ptr<Variable> argVariable = std::dynamic_pointer_cast<Variable>(arg);
+            if (argVariable != nullptr && call->signature.name.compare(0, 5, "std::") != 0) {
+                escaped.insert(argVariable->symbol);
+            }
+            findTracked(arg, declarations, inLambda);
+        }
+    } else if (lambda != nullptr) {
+        for (std::shared_ptr<Variable> &param: lambda->params) {
+            declarations[param->symbol]++;
+        }
+        findTracked(lambda->block, declarations, true);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef FINAL_PROJECT_CONSTANT_PROPAGATION_H
+#define FINAL_PROJECT_CONSTANT_PROPAGATION_H
+
+#include "SyntaxTreeNode.h"
+#include <unordered_map>
+#include <unordered_set>
+
+// Replaces the reads of the locals whose value is a number by that number and folds the operators and the pure
+// functions of the default context (std::exp, std::pow, ...) applied to numbers, so `std::exp(2)` is generated as
+// its value. Folding follows the C++ types of the literals: `1 / 2` stays an integer division.
+// Values are tracked per statement along the control flow: an if keeps the values its branches agree on and a loop
+// forgets every variable it assigns. Only the double and int locals declared once are tracked, and not the ones
+// assigned in a lambda or passed to a function that may take them by reference.
+class ConstantPropagation {
+protected:
+    typedef std::unordered_map<Symbol, std::shared_ptr<Number>> Values;
+
+    // Tracked variables, whether each has a floating point type
+    std::unordered_map<Symbol, bool> tracked;
+    std::unordered_set<Symbol> escaped;
+    size_t folded = 0;
+
+public:
+    // Returns the number of expressions replaced by a number
+    static size_t run(std::shared_ptr<Function> function);
+
+    // Value of a pure function of the default context, false when it is not known or the value is not finite
+    static bool evaluate(const std::string &function, const std::vector<double> &args, double &result);
+
+protected:
+    void propagate(std::vector<std::shared_ptr<Statement>> &statements, Values &values);
+    void propagate(std::shared_ptr<Statement> &statement, Values &values);
+    void propagateExpression(std::shared_ptr<Statement> &statement, Values &values);
+
+    // Substitutes the known values into the expression and folds it, the assigned variables are left as they are.
+    // Returns the expression itself when nothing changed, as the primal statements are shared with the function.
+    std::shared_ptr<Expression> rewrite(std::shared_ptr<Expression> expression, Values &values);
+    std::shared_ptr<Number> fold(BinaryOperator::Operation op, std::shared_ptr<Number> left,
+                                 std::shared_ptr<Number> right);
+    std::shared_ptr<Number> fold(std::shared_ptr<Call> call);
+    // The identities of Diff::simplify with a number operand, nullptr when none applies
+    static std::shared_ptr<Expression> simplify(BinaryOperator::Operation op, std::shared_ptr<Expression> left,
+                                                std::shared_ptr<Expression> right);
+    // Number stored in a variable of the type
+    static std::shared_ptr<Number> convert(std::shared_ptr<Number> number, bool floating);
+
+    void forgetAssigned(std::shared_ptr<Statement> statement, Values &values);
+    void forgetAssigned(std::shared_ptr<Expression> expression, Values &values);
+    static Values intersect(const Values &first, const Values &second);
+
+    void findTracked(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &declarations, bool inLambda);
+    void findTracked(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &declarations, bool inLambda);
+};
+
+#endif //FINAL_PROJECT_CONSTANT_PROPAGATION_H
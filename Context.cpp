@@ -6,7 +6,7 @@ namespace std {
         for(const Type &generic: type.generics) {
             result ^= std::hash<Type>()(generic) + 0x9e3779b9 + (result << 6) + (result >> 2);
         }
-        return (std::hash<std::string>()(type.name) ^ (result << 6)) << 6 ^ (type.isGeneric ? 53 : 83);
+        return (std::hash<Symbol>()(type.symbol) ^ (result << 6)) << 6 ^ (type.isGeneric ? 53 : 83);
     }
 
     std::size_t hash<FunctionSignature>::operator()(const FunctionSignature &sign) const {
@@ -14,6 +14,29 @@ namespace std {
         for(const Type &type: sign.paramTypes) {
             result ^= std::hash<Type>()(type) + 0x9e3779b9 + (result << 6) + (result >> 2);
         }
-        return std::hash<std::string>()(sign.name) ^ (result << 6);
+        return std::hash<Symbol>()(sign.symbol) ^ (result << 6);
     }
 }
+
+DefaultContext::DefaultContext() {
+    Type integer("int");
+    Type floating("float");
+    Type doubleFloating("double");
+    Type vector("std::vector");
+    Type array("std::array");
+    addType(integer.name, integer);
+    addType(floating.name, floating);
+    addType(doubleFloating.name, doubleFloating);
+    addType(vector.name, vector);
+    addType(array.name, array);
+
+    addFunction(FunctionSignature("std::cos", Type()));
+    addFunction(FunctionSignature("std::sin", Type()));
+    addFunction(FunctionSignature("std::pow", Type(), Type()));
+    addFunction(FunctionSignature("std::exp", Type()));
+    addFunction(FunctionSignature("std::log", Type()));
+    addFunction(FunctionSignature("std::vector", Type(), Type()));
+    addFunction(FunctionSignature("std::vector::size"));
+    addFunction(FunctionSignature("std::array", Type()));
+    addFunction(FunctionSignature("std::abs", Type()));
+}
@@ -8,6 +8,7 @@
 #include <unordered_set>
 #include <memory>
 #include <sstream>
+#include "SymbolTable.h"
 
 
 struct Variable;
@@ -15,12 +16,13 @@ struct FunctionDeclaration;
 
 struct Type {
     std::string name;
+    Symbol symbol = SymbolTable::EMPTY;
     bool isGeneric = false;
     std::vector<Type> generics;
 
-    explicit Type(std::string name): name(std::move(name)) {}
+    explicit Type(std::string name): name(std::move(name)), symbol(SymbolTable::global().intern(this->name)) {}
     Type(std::string name, std::vector<Type> generics):
-            name(std::move(name)), generics(std::move(generics)) {}
+            name(std::move(name)), symbol(SymbolTable::global().intern(this->name)), generics(std::move(generics)) {}
     Type(): isGeneric(true) {}
 
     std::string to_string() {
@@ -41,29 +43,31 @@ struct Type {
     };
 
     bool operator==(const Type &o) const {
-        return name == o.name && isGeneric == o.isGeneric && generics == o.generics;
+        return symbol == o.symbol && isGeneric == o.isGeneric && generics == o.generics;
     }
 };
 
 
 struct FunctionSignature {
     std::string name;
+    Symbol symbol = SymbolTable::EMPTY;
     std::vector<Type> paramTypes;
 
     FunctionSignature() = default;
     FunctionSignature(const FunctionSignature &o) = default;
-    explicit FunctionSignature(std::string name): name(std::move(name)) {};
-    FunctionSignature(std::string name, Type param): name(std::move(name)) {
+    explicit FunctionSignature(std::string name): name(std::move(name)), symbol(SymbolTable::global().intern(this->name)) {};
+    FunctionSignature(std::string name, Type param): FunctionSignature(std::move(name)) {
         paramTypes.push_back(std::move(param));
     }
     FunctionSignature(std::string name, Type param1, Type param2):
             FunctionSignature(std::move(name), std::move(param1)) {
         paramTypes.push_back(std::move(param2));
     }
-    FunctionSignature(std::string name, std::vector<Type> paramTypes): name(name), paramTypes(paramTypes) {}
+    FunctionSignature(std::string name, std::vector<Type> paramTypes):
+            name(std::move(name)), symbol(SymbolTable::global().intern(this->name)), paramTypes(std::move(paramTypes)) {}
 
     bool operator==(const FunctionSignature &o) const {
-        return name == o.name && paramTypes == o.paramTypes;
+        return symbol == o.symbol && paramTypes == o.paramTypes;
     }
 
     std::string to_string() {
@@ -87,59 +91,131 @@ namespace std {
     };
 }
 
-struct Context {
-public:
-    std::unordered_map<std::string, Type> types;
-    std::unordered_map<std::string, std::shared_ptr<Variable>> variables;
+// One layer of context definitions. Once a layer is shared between contexts (see Context::copy) it is frozen
+// and never modified again, so any number of copies may refer to it.
+struct ContextScope {
+    std::unordered_map<Symbol, Type> types;
+    std::unordered_map<Symbol, std::shared_ptr<Variable>> variables;
     std::unordered_set<FunctionSignature> functions;
     std::unordered_map<Type, std::vector<Type>> typeConversions;
+    std::shared_ptr<const ContextScope> base = nullptr;
+
+    bool empty() const {
+        return types.empty() && variables.empty() && functions.empty() && typeConversions.empty();
+    }
+};
+
+struct Context {
+protected:
+    // Definitions added to this context since it was created or last copied. Lookups fall through to the
+    // frozen layers in scope->base, and then to the parent context.
+    std::shared_ptr<ContextScope> scope = std::make_shared<ContextScope>();
+
+    template <typename Map>
+    static const typename Map::mapped_type *findInScope(const ContextScope *layer, Map ContextScope::*map,
+                                                        const typename Map::key_type &key) {
+        for (; layer != nullptr; layer = layer->base.get()) {
+            auto it = (layer->*map).find(key);
+            if (it != (layer->*map).end()) {
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    bool isFunctionInScope(const FunctionSignature &sign) const {
+        for (const ContextScope *layer = scope.get(); layer != nullptr; layer = layer->base.get()) {
+            if (layer->functions.count(sign)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
     std::shared_ptr<Context> parent = nullptr;
 
     Context() = default;
     explicit Context(std::shared_ptr<Context> parent): parent(std::move(parent)) {}
+    Context(const Context &o) = delete;
+    Context &operator=(const Context &o) = delete;
+    virtual ~Context() = default;
 
     void addType(const std::string &name, Type type) {
-        types[name] = std::move(type);
+        scope->types[SymbolTable::global().intern(name)] = std::move(type);
     }
 
     void addVariable(const std::string &name, std::shared_ptr<Variable> var) {
-        variables[name] = std::move(var);
+        addVariable(SymbolTable::global().intern(name), std::move(var));
+    }
+
+    void addVariable(Symbol name, std::shared_ptr<Variable> var) {
+        scope->variables[name] = std::move(var);
     }
 
     void addFunction(const FunctionSignature &sign) {
-        functions.insert(std::move(sign));
+        scope->functions.insert(sign);
     }
 
     void addTypeConversion(const Type &typeFrom, const Type &typeTo) {
-        if (!typeConversions.count(typeFrom)) {
-            typeConversions[typeFrom] = std::vector<Type>();
+        if (!scope->typeConversions.count(typeFrom)) {
+            const std::vector<Type> *inherited = findInScope(scope->base.get(), &ContextScope::typeConversions, typeFrom);
+            scope->typeConversions[typeFrom] = inherited == nullptr ? std::vector<Type>() : *inherited;
         }
-        typeConversions[typeFrom].push_back(typeTo);
+        scope->typeConversions[typeFrom].push_back(typeTo);
     }
 
     bool isVariablePresent(const std::string& name) {
-        return variables.count(name) ||
+        return isVariablePresent(SymbolTable::global().intern(name));
+    }
+
+    bool isVariablePresent(Symbol name) {
+        return isOwnVariablePresent(name) ||
                (parent != nullptr && parent->isVariablePresent(name));
     }
 
-    bool isTypePresent(std::string& name) {
-        return types.count(name) ||
+    // Only looks at this context, ignoring the parent
+    bool isOwnVariablePresent(Symbol name) {
+        return findInScope(scope.get(), &ContextScope::variables, name) != nullptr;
+    }
+
+    bool isTypePresent(const std::string& name) {
+        return isTypePresent(SymbolTable::global().intern(name));
+    }
+
+    bool isTypePresent(Symbol name) {
+        return findInScope(scope.get(), &ContextScope::types, name) != nullptr ||
                (parent != nullptr && parent->isTypePresent(name));
     }
 
-    std::shared_ptr<Variable> getVariable(std::string& name) {
-        return variables.count(name) > 0 ? variables[name] :
+    std::shared_ptr<Variable> getVariable(const std::string& name) {
+        return getVariable(SymbolTable::global().intern(name));
+    }
+
+    std::shared_ptr<Variable> getVariable(Symbol name) {
+        std::shared_ptr<Variable> variable = getOwnVariable(name);
+        return variable != nullptr ? variable :
                (parent == nullptr ? nullptr : parent->getVariable(name));
     }
 
-    Type getType(std::string& name) {
-        return types.count(name) > 0 ? types[name] :
+    std::shared_ptr<Variable> getOwnVariable(Symbol name) {
+        const std::shared_ptr<Variable> *variable = findInScope(scope.get(), &ContextScope::variables, name);
+        return variable != nullptr ? *variable : nullptr;
+    }
+
+    Type getType(const std::string& name) {
+        return getType(SymbolTable::global().intern(name));
+    }
+
+    Type getType(Symbol name) {
+        const Type *type = findInScope(scope.get(), &ContextScope::types, name);
+        return type != nullptr ? *type :
                (parent == nullptr ? Type() : parent->getType(name));
     }
 
 protected:
     std::unique_ptr<FunctionSignature> findExactDefinedFunction(FunctionSignature &desired) {
-        if (functions.count(desired)) {
+        if (isFunctionInScope(desired)) {
             return std::make_unique<FunctionSignature>(desired);
         }
         return parent == nullptr ? nullptr : parent->findExactDefinedFunction(desired);
@@ -158,9 +234,9 @@ protected:
         desired.paramTypes[paramI] = paramType;
 
         // Try the conversions
-        if (typeConversions.count(paramType)) {
-            std::vector<Type> &conversions = typeConversions[desired.paramTypes[paramI]];
-            for (Type &conversion: conversions) {
+        const std::vector<Type> *conversions = findInScope(scope.get(), &ContextScope::typeConversions, paramType);
+        if (conversions != nullptr) {
+            for (const Type &conversion: *conversions) {
                 desired.paramTypes[paramI] = conversion;
                 signature = findExactDefinedFunction(desired);
                 if (signature != nullptr) {
@@ -194,15 +270,23 @@ public:
         return signature;
     }
 
+    // Creates a context with the same definitions and parent. Nothing is copied: the current definitions are
+    // frozen into a layer shared by both contexts, and each of them keeps its further additions to itself.
     Context *copy() {
-        auto *context = new Context();
-        context->parent = parent;
-        context->types = types;
-        context->variables = variables;
-        context->functions = functions;
-        context->typeConversions = typeConversions;
+        if (!scope->empty()) {
+            std::shared_ptr<ContextScope> frozen = std::move(scope);
+            scope = std::make_shared<ContextScope>();
+            scope->base = std::move(frozen);
+        }
+        auto *context = new Context(parent);
+        context->scope->base = scope->base;
         return context;
     }
 };
 
+// The types and the functions of the standard library the parsed files may use
+struct DefaultContext: Context {
+    DefaultContext();
+};
+
 #endif //FINAL_PROJECT_CONTEXT_H
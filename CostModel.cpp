@@ -0,0 +1,322 @@
+#include "CostModel.h"
+#include "diff_checkpointing.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+#include <cstdlib>
+
+const double CostModel::TRANSCENDENTAL_WEIGHT = 20;
+const double CostModel::MEMORY_WEIGHT = 0.5;
+const double CostModel::DEFAULT_ITERATIONS = 10;
+
+// Calls to other functions are counted as one transcendental call as well
+static const std::unordered_set<std::string> ARITHMETIC_FUNCTIONS = {
+        "std::abs", "std::fabs", "std::min", "std::max", "std::fmin", "std::fmax"
+};
+
+CostModel::Cost &CostModel::Cost::operator+=(const Cost &other) {
+    flops += other.flops;
+    transcendentals += other.transcendentals;
+    memory += other.memory;
+    return *this;
+}
+
+CostModel::Cost CostModel::Cost::operator-(const Cost &other) const {
+    Cost result = *this;
+    result += other * -1;
+    return result;
+}
+
+CostModel::Cost CostModel::Cost::operator*(double factor) const {
+    Cost result;
+    result.flops = flops * factor;
+    result.transcendentals = transcendentals * factor;
+    result.memory = memory * factor;
+    return result;
+}
+
+double CostModel::Estimate::cost(Mode mode) const {
+    switch (mode) {
+        case FORWARD:
+            return primal.total() + activeTangents.total();
+        case REVERSE:
+            return primal.total() + outputs * adjoint.total();
+    }
+    return 0;
+}
+
+CostModel::Mode CostModel::Estimate::cheapest() const {
+    return cost(REVERSE) < cost(FORWARD) ? REVERSE : FORWARD;
+}
+
+std::string CostModel::Estimate::to_string(Mode chosen) const {
+    return modeName(chosen) + " mode, " + costs();
+}
+
+std::string CostModel::Estimate::costs() const {
+    std::ostringstream result;
+    result << "estimated cost: forward " << std::lround(cost(FORWARD)) << " (" << inputs
+           << " directions), reverse " << std::lround(cost(REVERSE)) << " (" << outputs << " outputs); "
+           << "one evaluation: " << std::lround(primal.flops) << " flops, "
+           << std::lround(primal.transcendentals) << " transcendental calls, "
+           << std::lround(primal.memory) << " memory accesses";
+    return result.str();
+}
+
+CostModel::CostModel(std::shared_ptr<Function> function, int checkpoints):
+        checkpoints(checkpoints), function(std::move(function)) {}
+
+CostModel::Estimate CostModel::estimateFunction(std::shared_ptr<Function> function, int checkpoints) {
+    CostModel model(function, checkpoints);
+    std::vector<std::shared_ptr<Variable>> inputs = function->declaration->getDifferentiatedParams();
+    model.estimate.inputs = inputs.size();
+    model.activity = std::make_shared<ActivityAnalysis>(function, inputs);
+    model.count(function->block, 1);
+    model.countOutputs();
+    return model.estimate;
+}
+
+CostModel::Estimate CostModel::estimateExpression(std::shared_ptr<Expression> expression) {
+    CostModel model(nullptr, 0);
+    model.count(expression, 1);
+    return model.estimate;
+}
+
+std::string CostModel::modeName(Mode mode) {
+    switch (mode) {
+        case FORWARD:
+            return "forward";
+        case REVERSE:
+            return "reverse";
+    }
+    return "";
+}
+
+void CostModel::count(std::shared_ptr<Statement> statement, double weight) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            countStatement(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr, weight);
+            break;
+        case Statement::RETURN: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            returned.push_back(expr);
+            countStatement(expr, weight);
+            break;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                count(inner, weight);
+            }
+            break;
+        case Statement::IF: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            // The condition is only evaluated, the reverse mode also stores and loads the branch taken
+            Cost tangent = estimate.tangent, adjoint = estimate.adjoint;
+            count(conditional->condition, weight);
+            estimate.tangent = tangent;
+            estimate.adjoint = adjoint;
+            estimate.adjoint.memory += 2 * weight;
+            count(conditional->statement, weight / 2);
+            if (conditional->elseStatement != nullptr) {
+                count(conditional->elseStatement, weight / 2);
+            }
+            break;
+        }
+        case Statement::WHILE_LOOP:
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<Expression> condition, expr;
+            std::shared_ptr<Statement> body;
+            double steps = DEFAULT_ITERATIONS;
+            if (statement->getType() == Statement::FOR_LOOP) {
+                std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+                steps = iterations(loop);
+                if (loop->definition != nullptr) {
+                    count(loop->definition, weight);
+                }
+                condition = loop->condition;
+                expr = loop->expr;
+                body = loop->statement;
+            } else {
+                std::shared_ptr<ConditionalStatement> loop = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+                condition = loop->condition;
+                body = loop->statement;
+            }
+
+            Cost tangent = estimate.tangent, adjoint = estimate.adjoint;
+            if (condition != nullptr) {
+                count(condition, weight * (steps + 1));
+            }
+            if (expr != nullptr) {
+                count(expr, weight * steps);
+            }
+            estimate.tangent = tangent;
+            estimate.adjoint = adjoint;
+            Cost before = estimate.primal;
+            count(body, weight * steps);
+
+            // Reversing the loop reruns each iteration once to save its values, plus the recomputations of the
+            // states between the checkpoints
+            int repetitions = 0;
+            if (checkpoints > 0) {
+                while (checkpointedSteps(checkpoints, repetitions) < steps) {
+                    ++repetitions;
+                }
+            } else {
+                repetitions = (int) std::ceil(steps / 2);
+            }
+            estimate.adjoint += (estimate.primal - before) * (repetitions + 1);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void CostModel::countStatement(std::shared_ptr<Expression> expression, double weight) {
+    Cost tangent = estimate.tangent;
+    count(expression, weight);
+    if (activity != nullptr) {
+        ActivityAnalysis::Inputs inputs = activity->dependenciesOf(expression);
+        estimate.activeTangents += (estimate.tangent - tangent) * (double) std::count(inputs.begin(), inputs.end(), true);
+    }
+}
+
+void CostModel::count(std::shared_ptr<Expression> expression, double weight) {
+    Cost primal, tangent, adjoint;
+    switch (expression->getType()) {
+        case Expression::VARIABLE:
+        case Expression::VARIABLE_DECLARATION: {
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+            if (variable->declaration) {
+                return;
+            }
+            // The adjoint of a variable is loaded and stored back
+            primal.memory = 1;
+            tangent.memory = 1;
+            adjoint.memory = 2;
+            break;
+        }
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            count(op->expr, weight);
+            if (op->op == UnaryOperator::MINUS) {
+                primal.flops = tangent.flops = adjoint.flops = 1;
+            } else if (op->op == UnaryOperator::NOT) {
+                primal.flops = 1;
+            } else if (op->op == UnaryOperator::PLUS_PLUS || op->op == UnaryOperator::MINUS_MINUS) {
+                primal.flops = 1;
+                primal.memory = 1;
+            }
+            break;
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            // Assigned variables are only stored
+            if (op->op != BinaryOperator::EQUALS || op->left->getType() != Expression::VARIABLE) {
+                count(op->left, weight);
+            }
+            if (op->op == BinaryOperator::INDEXING) {
+                // The index is only evaluated
+                Cost savedTangent = estimate.tangent, savedAdjoint = estimate.adjoint;
+                count(op->right, weight);
+                estimate.tangent = savedTangent;
+                estimate.adjoint = savedAdjoint;
+                return;
+            }
+            count(op->right, weight);
+
+            BinaryOperator::Operation operation = op->op;
+            if (operation >= BinaryOperator::EQUALS && operation <= BinaryOperator::DIVIDE_EQUALS) {
+                // The reverse mode saves and restores the overwritten value and resets the adjoint
+                primal.memory = tangent.memory = 1;
+                adjoint.memory = 3;
+                operation = operation == BinaryOperator::PLUS_EQUALS ? BinaryOperator::PLUS :
+                            operation == BinaryOperator::MINUS_EQUALS ? BinaryOperator::MINUS :
+                            operation == BinaryOperator::MULTIPLY_EQUALS ? BinaryOperator::MULTIPLY :
+                            operation == BinaryOperator::DIVIDE_EQUALS ? BinaryOperator::DIVIDE : operation;
+            }
+
+            if (operation == BinaryOperator::PLUS || operation == BinaryOperator::MINUS) {
+                primal.flops += 1;
+                tangent.flops += 1;
+                adjoint.flops += 2;
+            } else if (operation == BinaryOperator::MULTIPLY) {
+                primal.flops += 1;
+                tangent.flops += 3;
+                adjoint.flops += 4;
+            } else if (operation == BinaryOperator::DIVIDE) {
+                primal.flops += 1;
+                tangent.flops += 5;
+                adjoint.flops += 6;
+            } else if (operation == BinaryOperator::POINT) {
+                primal.memory += 1;
+                tangent.memory += 1;
+                adjoint.memory += 2;
+            } else if (operation != BinaryOperator::EQUALS) {
+                primal.flops += 1;
+            }
+            break;
+        }
+        case Expression::CALL: {
+            std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+            for (std::shared_ptr<Expression> &arg: call->args) {
+                count(arg, weight);
+            }
+            // The derivative of a transcendental function is another one, multiplied by the argument tangents
+            if (ARITHMETIC_FUNCTIONS.count(call->signature.name)) {
+                primal.flops = tangent.flops = 1;
+                adjoint.flops = 2;
+            } else {
+                primal.transcendentals = tangent.transcendentals = adjoint.transcendentals = 1;
+                tangent.flops = call->args.size();
+                adjoint.flops = 2 * call->args.size();
+            }
+            break;
+        }
+        default:
+            return;
+    }
+    estimate.primal += primal * weight;
+    estimate.tangent += tangent * weight;
+    estimate.adjoint += adjoint * weight;
+}
+
+double CostModel::iterations(std::shared_ptr<ForLoop> loop) {
+    // Only `for (int i = a; i < b; ...)` and `i <= b` with numbers a and b are recognized
+    auto definition = std::dynamic_pointer_cast<ExpressionStatement>(loop->definition);
+    auto start = definition == nullptr ? nullptr : std::dynamic_pointer_cast<BinaryOperator>(definition->expr);
+    auto condition = std::dynamic_pointer_cast<BinaryOperator>(loop->condition);
+    if (start == nullptr || condition == nullptr || start->op != BinaryOperator::EQUALS ||
+            (condition->op != BinaryOperator::LESS && condition->op != BinaryOperator::LESS_EQUALS)) {
+        return DEFAULT_ITERATIONS;
+    }
+
+    auto counter = std::dynamic_pointer_cast<Variable>(start->left);
+    auto first = std::dynamic_pointer_cast<Number>(start->right);
+    auto compared = std::dynamic_pointer_cast<Variable>(condition->left);
+    auto bound = std::dynamic_pointer_cast<Number>(condition->right);
+    if (counter == nullptr || first == nullptr || compared == nullptr || bound == nullptr ||
+            counter->symbol != compared->symbol) {
+        return DEFAULT_ITERATIONS;
+    }
+    double steps = bound->value - first->value + (condition->op == BinaryOperator::LESS_EQUALS ? 1 : 0);
+    return std::max(std::ceil(steps), 0.0);
+}
+
+void CostModel::countOutputs() {
+    // The elements of the returned arrays are separate outputs
+    size_t outputs = 0;
+    Type &returnType = function->declaration->returnType;
+    for (std::shared_ptr<Expression> &expr: returned) {
+        std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expr);
+        size_t size = 1;
+        if (!returnType.generics.empty() && variable != nullptr) {
+            size = activity->elementCount(variable->symbol);
+            if (returnType.name == "std::array" && returnType.generics.size() == 2) {
+                size = std::max<size_t>(size, std::atoi(returnType.generics[1].name.c_str()));
+            }
+        }
+        outputs = std::max(outputs, size);
+    }
+    estimate.outputs = outputs == 0 ? estimate.inputs : outputs;
+}
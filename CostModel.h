@@ -0,0 +1,82 @@
+#ifndef FINAL_PROJECT_COST_MODEL_H
+#define FINAL_PROJECT_COST_MODEL_H
+
+#include "ActivityAnalysis.h"
+
+// Estimates the cost of differentiating a function in forward and reverse mode by counting the operations of its
+// syntax tree, so that the cheapest mode can be chosen per function.
+// Loops count their body once per iteration, with the number of iterations read from `for (int i = a; i < b; ...)`
+// when a and b are numbers, and DEFAULT_ITERATIONS otherwise. Both branches of an if count half.
+class CostModel {
+public:
+    // Weights of the operations relative to a floating point operation
+    static const double TRANSCENDENTAL_WEIGHT;
+    static const double MEMORY_WEIGHT;
+    static const double DEFAULT_ITERATIONS;
+
+    struct Cost {
+        double flops = 0;
+        double transcendentals = 0;
+        // Loads and stores of variables
+        double memory = 0;
+
+        double total() const {
+            return flops + TRANSCENDENTAL_WEIGHT * transcendentals + MEMORY_WEIGHT * memory;
+        }
+
+        Cost &operator+=(const Cost &other);
+        Cost operator-(const Cost &other) const;
+        Cost operator*(double factor) const;
+    };
+
+    enum Mode {
+        FORWARD,
+        REVERSE
+    };
+
+    struct Estimate {
+        // One evaluation of the function
+        Cost primal;
+        // The tangents of one forward direction
+        Cost tangent;
+        // The tangents of all the forward directions, without those of the statements not depending on the
+        // direction, which the forward mode skips (see ActivityAnalysis)
+        Cost activeTangents;
+        // One reverse sweep, with the saved values and the loop recomputations
+        Cost adjoint;
+        size_t inputs = 0;
+        size_t outputs = 0;
+
+        double cost(Mode mode) const;
+        Mode cheapest() const;
+        std::string to_string(Mode chosen) const;
+        // The estimates of the modes and of one evaluation, without the chosen mode
+        std::string costs() const;
+    };
+
+protected:
+    int checkpoints;
+    std::shared_ptr<Function> function;
+    // Only for the functions
+    std::shared_ptr<ActivityAnalysis> activity;
+    Estimate estimate;
+    std::vector<std::shared_ptr<Expression>> returned;
+
+public:
+    CostModel(std::shared_ptr<Function> function, int checkpoints);
+
+    static Estimate estimateFunction(std::shared_ptr<Function> function, int checkpoints);
+    // The primal, tangent and adjoint costs of a single expression, without inputs nor outputs
+    static Estimate estimateExpression(std::shared_ptr<Expression> expression);
+    static std::string modeName(Mode mode);
+
+protected:
+    void count(std::shared_ptr<Statement> statement, double weight);
+    void count(std::shared_ptr<Expression> expression, double weight);
+    // Counts a statement expression, its tangents once for each direction it depends on
+    void countStatement(std::shared_ptr<Expression> expression, double weight);
+    static double iterations(std::shared_ptr<ForLoop> loop);
+    void countOutputs();
+};
+
+#endif //FINAL_PROJECT_COST_MODEL_H
@@ -1,13 +1,17 @@
 #include "CppParser.h"
 
-FileReader::FileReader(std::string& filePath): filePath(filePath) {
-    ifile.open(filePath);
-
-    if (ifile.fail()) {
+FileReader::FileReader(std::string& filePath): input(std::make_unique<std::ifstream>(filePath)), filePath(filePath) {
+    if (input->fail()) {
         throw ParsingException("Error opening file '" + filePath + "'");
     }
 
-    end = !std::getline(ifile, line);
+    end = !std::getline(*input, line);
+    step();
+}
+
+FileReader::FileReader(std::string filePath, const std::string &source):
+        input(std::make_unique<std::istringstream>(source)), filePath(std::move(filePath)) {
+    end = !std::getline(*input, line);
     step();
 }
 
@@ -17,7 +21,7 @@ void FileReader::step() {
     }
 
     if (charN == line.size() && !end) {
-        end = !std::getline(ifile, line);
+        end = !std::getline(*input, line);
         charN = -1;
         lineN++;
     }
@@ -95,8 +99,9 @@ std::shared_ptr<Number> FileReader::parseNumber() {
             }
         }
     }
+    std::string token = line.substr(start, charN - start);
     skipWhitespace();
-    return std::make_shared<Number>(line.substr(start, charN - start));
+    return std::make_shared<Number>(token);
 }
 
 std::string FileReader::parseIdentifier(bool allowColon, bool skipSpace) {
@@ -210,7 +215,7 @@ std::shared_ptr<Expression> FileReader::parseExpression
     std::string op = parseOperator();
     if (left == nullptr) {
         std::shared_ptr<Expression> right = parseExpression(context);
-        return std::make_shared<UnaryOperator>(op, right);
+        return regroup(std::make_shared<UnaryOperator>(op, right));
     }
 
     if (op[0] == POINT) {
@@ -236,16 +241,7 @@ std::shared_ptr<Expression> FileReader::parseExpression
 
     if (nextChar == OPEN_ROUND || isIdentifierStart(nextChar) || isNumber(nextChar)) {
         std::shared_ptr<Expression> right = parseExpression(context);
-        std::shared_ptr<BinaryOperator> result = std::make_shared<BinaryOperator>(op, left, right);
-        if (right->getType() == Expression::BINARY_OPERATOR) {
-            auto *rightOperator = dynamic_cast<BinaryOperator*>(right.get());
-            if (BinaryOperator::comparePrecedence(result.get(), rightOperator) < 0) {
-                result->right = rightOperator->left;
-                rightOperator->left = result;
-                return right;
-            }
-        }
-        return result;
+        return regroup(std::make_shared<BinaryOperator>(op, left, right));
     } else {
         std::shared_ptr<Expression> result = std::make_shared<UnaryOperator>(op, left, true);
         if (nextChar == CLOSE_ROUND || nextChar == SEMI_COLON || nextChar == COMMA || nextChar == CLOSE_SQUARE) {
@@ -255,6 +251,32 @@ std::shared_ptr<Expression> FileReader::parseExpression
     }
 }
 
+std::shared_ptr<Expression> FileReader::regroup(std::shared_ptr<BinaryOperator> result) {
+    std::shared_ptr<BinaryOperator> rightOperator = std::dynamic_pointer_cast<BinaryOperator>(result->right);
+    if (rightOperator == nullptr) {
+        return result;
+    }
+    int precedence = BinaryOperator::comparePrecedence(result.get(), rightOperator.get());
+    // Assignments are the only right associative binary operators
+    bool assignment = result->getOperatorPrecedence() == 16;
+    if (precedence < 0 || (precedence == 0 && !assignment)) {
+        result->right = rightOperator->left;
+        rightOperator->left = regroup(result);
+        return rightOperator;
+    }
+    return result;
+}
+
+std::shared_ptr<Expression> FileReader::regroup(std::shared_ptr<UnaryOperator> result) {
+    std::shared_ptr<BinaryOperator> operand = std::dynamic_pointer_cast<BinaryOperator>(result->expr);
+    if (operand != nullptr && Operator::comparePrecedence(result.get(), operand.get()) < 0) {
+        result->expr = operand->left;
+        operand->left = regroup(result);
+        return operand;
+    }
+    return result;
+}
+
 std::shared_ptr<Call> FileReader::parseCall(std::shared_ptr<Context> context, std::string name, std::shared_ptr<Variable> var) {
     if (name.empty()) {
         name = parseIdentifier(true);
@@ -403,7 +425,24 @@ std::shared_ptr<Statement> FileReader::parseFunction(std::shared_ptr<Context> gl
     skipWhitespace();
     std::shared_ptr<Context> funcContext = std::make_shared<Context>(globalContext);
 
-    Type returnType = parseType(funcContext);
+    std::vector<std::string> differentiated;
+    std::string typeName = parseIdentifier(true);
+    if (typeName == DIFF_ANNOTATION && nextChar == OPEN_ROUND) {
+        verifyNextCharIs(OPEN_ROUND);
+        while (nextChar != CLOSE_ROUND) {
+            if (!differentiated.empty()) {
+                verifyNextCharIs(COMMA);
+            }
+            differentiated.push_back(parseIdentifier());
+        }
+        verifyNextCharIs(CLOSE_ROUND);
+        typeName = parseIdentifier(true);
+    }
+    if (!funcContext->isTypePresent(typeName)) {
+        throw ParsingException("Type '" + typeName + "' is not supported");
+    }
+
+    Type returnType = parseType(funcContext, typeName);
     skipWhitespace();
     std::string name = parseIdentifier();
     verifyNextCharIs(OPEN_ROUND);
@@ -422,6 +461,16 @@ std::shared_ptr<Statement> FileReader::parseFunction(std::shared_ptr<Context> gl
     verifyNextCharIs(CLOSE_ROUND);
 
     std::shared_ptr<FunctionDeclaration> decl = std::make_shared<FunctionDeclaration>(name, returnType, params);
+    for (std::string &paramName: differentiated) {
+        Symbol symbol = SymbolTable::global().intern(paramName);
+        auto isNamed = [symbol](std::shared_ptr<Variable> &param) { return param->symbol == symbol; };
+        if (std::find_if(params.begin(), params.end(), isNamed) == params.end()) {
+            throw ParsingException("'" + paramName + "' in the diff annotation is not a parameter of '" + name + "'");
+        }
+        decl->differentiated.push_back(symbol);
+    }
+    // The following functions, and this one itself, may call it
+    globalContext->addFunction(decl->getCallSignature());
 
     if (nextChar == OPEN_CURLY) {
         return std::make_shared<Function>(funcContext, decl, parseBlock(funcContext));
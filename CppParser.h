@@ -4,14 +4,16 @@
 #include <list>
 #include <map>
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <unordered_map>
 #include <string>
 #include "SyntaxTreeNode.h"
+#include "Statistics.h"
 
 class FileReader {
 private:
-    std::ifstream ifile;
+    std::unique_ptr<std::istream> input;
     std::string filePath;
     std::string line;
     bool end = false;
@@ -39,9 +41,13 @@ private:
     static const char COLON = ':';
 
     const std::string RETURN = "return";
+    // diff(a, b) before a function, see diff_defines.h
+    const std::string DIFF_ANNOTATION = "diff";
 
 public:
     explicit FileReader(std::string& filePath);
+    // Reads the source held in memory, named filePath in the errors and the file node
+    FileReader(std::string filePath, const std::string &source);
     void step();
     void stepBack(int nSteps);
     void skipWhitespace();
@@ -54,6 +60,10 @@ public:
     std::shared_ptr<BlockStatement> parseBlock(std::shared_ptr<Context> context);
     std::shared_ptr<Expression> parseExpression(std::shared_ptr<Context> context, bool isFirst=false,
                                                 bool missingAllowed=false, std::shared_ptr<Expression> left=nullptr);
+    // Expressions are parsed from the right, so an operator is moved below its right operand when that one
+    // binds less tightly or, for the same precedence, should be applied later
+    static std::shared_ptr<Expression> regroup(std::shared_ptr<BinaryOperator> result);
+    static std::shared_ptr<Expression> regroup(std::shared_ptr<UnaryOperator> result);
     std::shared_ptr<Call> parseCall(std::shared_ptr<Context> context, std::string name="", std::shared_ptr<Variable> var=nullptr);
         std::shared_ptr<Variable> parseVariable(std::shared_ptr<Context> context, bool declarationRequired=true);
     std::shared_ptr<Statement> parseFileStatement(std::shared_ptr<Context> globalContext);
@@ -66,15 +76,16 @@ public:
     CppParser() = default;
 
     static std::shared_ptr<FileNode> parseFile(std::string filePath, std::shared_ptr<Context> context) {
+        Statistics::Timer timer(Statistics::PARSE);
         FileReader reader{filePath};
         return reader.parseFile(std::move(context));
     }
 
-    static void writeFile(std::shared_ptr<FileNode> file) {
-        std::ofstream output;
-        output.open(file->name);
-        output << file->to_string();
-        output.close();
+    static std::shared_ptr<FileNode> parseSource(std::string name, const std::string &source,
+                                                 std::shared_ptr<Context> context) {
+        Statistics::Timer timer(Statistics::PARSE);
+        FileReader reader{std::move(name), source};
+        return reader.parseFile(std::move(context));
     }
 };
 
@@ -0,0 +1,332 @@
+#include "CrossCountryDiff.h"
+#include "FunctionDiffStorage.h"
+#include <cstdint>
+
+const std::string CrossCountryDiff::EDGE_PREFIX = "_e";
+const std::string CrossCountryDiff::RETURN_KEY = "return";
+
+std::shared_ptr<Function> CrossCountryDiff::diff(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage) {
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    context = std::make_shared<DiffContext>(function, storage);
+    for (std::shared_ptr<Variable> &param: context->argumentVariables) {
+        if (!isScalar(param->type)) {
+            throw DiffException("Only scalar parameters are supported in cross-country mode");
+        }
+        current[param->name] = vertices.size();
+        vertices.emplace_back();
+    }
+    inputCount = vertices.size();
+    countAssignments(function->block, assignments);
+
+    Statements body;
+    std::shared_ptr<Expression> returned;
+    bool arrayReturn = false;
+    for (std::shared_ptr<Statement> &statement: function->block->statements) {
+        if (statement->getType() == Statement::COMMENT) {
+            continue;
+        } else if (statement->getType() == Statement::RETURN) {
+            returned = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(returned);
+            if (variable != nullptr && variable->type.name == "std::array" && variable->type.generics.size() == 2 &&
+                    isScalar(variable->type.generics[0])) {
+                arrayReturn = true;
+                int size = std::atoi(variable->type.generics[1].name.c_str());
+                for (int i = 0; i < size; ++i) {
+                    addOutput(variable->name + "[" + std::to_string(i) + "]");
+                }
+            } else if (isScalar(decl->returnType)) {
+                addAssignment(RETURN_KEY, returned, body);
+                addOutput(RETURN_KEY);
+            } else {
+                throw DiffException("Only functions returning a scalar or a std::array of scalars are supported "
+                                    "in cross-country mode");
+            }
+            break;
+        } else if (statement->getType() != Statement::EXPRESSION) {
+            throw DiffException("Only straight-line functions are supported in cross-country mode");
+        }
+
+        std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+        std::shared_ptr<Variable> declared = std::dynamic_pointer_cast<Variable>(expr);
+        std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expr);
+        if (declared != nullptr && declared->declaration) {
+            if (declared->constructorCall != nullptr && !declared->constructorCall->args.empty()) {
+                throw DiffException("Declarations with constructor arguments are not supported in cross-country mode");
+            }
+            // The elements of a value initialized array are zero
+            current.erase(declared->name);
+        } else if (op != nullptr && op->op >= BinaryOperator::EQUALS && op->op <= BinaryOperator::DIVIDE_EQUALS) {
+            std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(op->left);
+            std::shared_ptr<BinaryOperator> element = std::dynamic_pointer_cast<BinaryOperator>(op->left);
+            if (target == nullptr && (element == nullptr || element->op != BinaryOperator::INDEXING ||
+                    std::dynamic_pointer_cast<Number>(element->right) == nullptr)) {
+                throw DiffException("Only variables and elements with a number index can be assigned in cross-country mode");
+            }
+            std::string key = target != nullptr ? target->name : op->left->to_string();
+            std::shared_ptr<Expression> value = op->right;
+            if (op->op != BinaryOperator::EQUALS) {
+                // The compound assignments follow the order of the arithmetic operators
+                auto arithmetic = (BinaryOperator::Operation) (op->op - BinaryOperator::PLUS_EQUALS + BinaryOperator::PLUS);
+                std::shared_ptr<Expression> read = target != nullptr ? std::make_shared<Variable>(target->type, target->symbol) : op->left;
+                value = std::make_shared<BinaryOperator>(arithmetic, read,
+                                                         std::make_shared<UnaryOperator>(UnaryOperator::BRACES, value));
+            }
+            addAssignment(key, value, body);
+        } else {
+            throw DiffException("Only assignments are supported in cross-country mode");
+        }
+        body.push_back(statement);
+    }
+
+    std::vector<Vertex> graph = vertices;
+    counts.markowitz = eliminate(graph, MARKOWITZ, nullptr);
+    graph = vertices;
+    counts.forward = eliminate(graph, FORWARD_ORDER, nullptr);
+    graph = vertices;
+    counts.reverse = eliminate(graph, REVERSE_ORDER, nullptr);
+    for (Order order: {FORWARD_ORDER, REVERSE_ORDER}) {
+        if (counts.count(order) < counts.count(counts.order)) {
+            counts.order = order;
+        }
+    }
+    eliminate(vertices, counts.order, &body);
+
+    // The Jacobian in the layout of the forward mode, the derivatives with respect to each parameter together
+    std::shared_ptr<FunctionDeclaration> dDecl = Diff::diff(decl);
+    if (inputCount == 1 && !arrayReturn) {
+        auto entry = vertices[outputs[0]].predecessors.find(0);
+        body.push_back(makeReturn(returned, entry == vertices[outputs[0]].predecessors.end() ?
+                                            std::make_shared<Number>(0) : entry->second));
+        return std::make_shared<Function>(context->funcContext, dDecl, std::make_shared<BlockStatement>(body));
+    }
+
+    Symbol returnName = SymbolTable::global().intern(DERIVATIVE_VAR_PREFIX + "return");
+    std::shared_ptr<Variable> returnVariable = std::make_shared<Variable>(dDecl->returnType, returnName);
+    FunctionSignature constructor(dDecl->returnType.name);
+    // Value initialized, the entries of the outputs that do not depend on an input are zero
+    body.push_back(std::make_shared<ExpressionStatement>(std::make_shared<Variable>(
+            dDecl->returnType, returnName, true, std::make_shared<Call>(constructor))));
+    for (size_t input = 0; input < inputCount; ++input) {
+        for (size_t output = 0; output < outputs.size(); ++output) {
+            auto entry = vertices[outputs[output]].predecessors.find(input);
+            if (entry == vertices[outputs[output]].predecessors.end()) {
+                continue;
+            }
+            std::shared_ptr<Expression> target = returnVariable;
+            if (inputCount > 1) {
+                target = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, target, std::make_shared<Number>(input));
+            }
+            if (arrayReturn) {
+                target = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, target, std::make_shared<Number>(output));
+            }
+            body.push_back(std::make_shared<ExpressionStatement>(
+                    std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, target, entry->second)));
+        }
+    }
+    body.push_back(makeReturn(returned, returnVariable));
+    return std::make_shared<Function>(context->funcContext, dDecl, std::make_shared<BlockStatement>(body));
+}
+
+size_t CrossCountryDiff::Counts::count(Order of) const {
+    return of == MARKOWITZ ? markowitz : of == FORWARD_ORDER ? forward : reverse;
+}
+
+std::string CrossCountryDiff::report() const {
+    std::ostringstream result;
+    result << "cross-country mode, " << counts.count(counts.order) << " multiplications eliminating in "
+           << orderName(counts.order) << " order (" << counts.markowitz << " in Markowitz order, " << counts.forward
+           << " in forward order, " << counts.reverse << " in reverse order)";
+    return result.str();
+}
+
+std::string CrossCountryDiff::orderName(Order order) {
+    switch (order) {
+        case MARKOWITZ:
+            return "Markowitz";
+        case FORWARD_ORDER:
+            return "forward";
+        case REVERSE_ORDER:
+            return "reverse";
+    }
+    return "";
+}
+
+void CrossCountryDiff::addAssignment(const std::string &key, std::shared_ptr<Expression> value, Statements &statements) {
+    std::vector<std::shared_ptr<Expression>> candidates, operands;
+    findOperands(value, candidates);
+    for (std::shared_ptr<Expression> &candidate: candidates) {
+        std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(candidate);
+        std::shared_ptr<BinaryOperator> element = std::dynamic_pointer_cast<BinaryOperator>(candidate);
+        if (variable != nullptr && !variable->type.generics.empty()) {
+            throw DiffException("Only scalars can be read in cross-country mode");
+        } else if (element != nullptr && std::dynamic_pointer_cast<Number>(element->right) == nullptr) {
+            throw DiffException("Only elements with a number index can be read in cross-country mode");
+        }
+        // The other variables are constants of the function
+        if (current.count(candidate->to_string())) {
+            operands.push_back(candidate);
+        }
+    }
+    if (operands.empty()) {
+        current.erase(key);
+        return;
+    }
+
+    WrtList seeds = seed(operands, context);
+    Tangents partials = Diff::diff(value, context, seeds);
+    context->seeds.clear();
+
+    size_t vertex = vertices.size();
+    vertices.emplace_back();
+    for (size_t i = 0; i < operands.size(); ++i) {
+        std::shared_ptr<Expression> partial = simplify(partials[i]);
+        std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(partial);
+        if (number != nullptr && number->isZero()) {
+            continue;
+        }
+        size_t source = current[operands[i]->to_string()];
+        vertices[vertex].predecessors[source] = label(partial, statements);
+        vertices[source].successors.insert(vertex);
+    }
+    current[key] = vertex;
+}
+
+void CrossCountryDiff::addOutput(const std::string &key) {
+    size_t output = vertices.size();
+    vertices.emplace_back();
+    outputs.push_back(output);
+    auto value = current.find(key);
+    if (value != current.end()) {
+        vertices[output].predecessors[value->second] = std::make_shared<Number>(1);
+        vertices[value->second].successors.insert(output);
+    }
+}
+
+std::shared_ptr<Expression> CrossCountryDiff::label(std::shared_ptr<Expression> partial, Statements &statements) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(partial);
+    // A parameter assigned once may still be read before its assignment
+    int assigned = variable == nullptr ? 0 : assignments[variable->name];
+    if (partial->getType() == Expression::ELEMENTARY_VALUE || (variable != nullptr &&
+            (assigned == 0 || (assigned == 1 && !context->arguments.count(variable->symbol))))) {
+        return partial;
+    }
+    // The labels are used after the statements, when the variables they read may have other values
+    return declareEdge(partial, statements);
+}
+
+std::shared_ptr<Variable> CrossCountryDiff::declareEdge(std::shared_ptr<Expression> value, Statements &statements) {
+    Symbol name;
+    do {
+        name = SymbolTable::global().intern(EDGE_PREFIX + std::to_string(context->temporaryCount++));
+    } while (context->funcContext->isVariablePresent(name));
+    Type type("double");
+    std::shared_ptr<Variable> edge = std::make_shared<Variable>(type, name);
+    context->funcContext->addVariable(name, edge);
+    owned.insert(name);
+    statements.push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+            BinaryOperator::EQUALS, std::make_shared<Variable>(type, name, true), value)));
+    return edge;
+}
+
+size_t CrossCountryDiff::eliminate(std::vector<Vertex> &graph, Order order, Statements *statements) {
+    std::set<size_t> sinks(outputs.begin(), outputs.end());
+    std::vector<size_t> remaining;
+    for (size_t vertex = inputCount; vertex < graph.size(); ++vertex) {
+        if (!sinks.count(vertex)) {
+            remaining.push_back(vertex);
+        }
+    }
+
+    size_t multiplications = 0;
+    while (!remaining.empty()) {
+        size_t position = order == REVERSE_ORDER ? remaining.size() - 1 : 0;
+        if (order == MARKOWITZ) {
+            size_t best = SIZE_MAX;
+            for (size_t i = 0; i < remaining.size(); ++i) {
+                Vertex &candidate = graph[remaining[i]];
+                size_t degree = candidate.predecessors.size() * candidate.successors.size();
+                if (degree < best) {
+                    best = degree;
+                    position = i;
+                }
+            }
+        }
+        size_t eliminated = remaining[position];
+        remaining.erase(remaining.begin() + position);
+
+        Vertex &vertex = graph[eliminated];
+        for (size_t successor: vertex.successors) {
+            std::map<size_t, std::shared_ptr<Expression>> &labels = graph[successor].predecessors;
+            std::shared_ptr<Expression> outer = labels[eliminated];
+            for (auto &predecessor: vertex.predecessors) {
+                std::shared_ptr<Expression> inner = predecessor.second;
+                if (outer->getType() != Expression::ELEMENTARY_VALUE && inner->getType() != Expression::ELEMENTARY_VALUE) {
+                    ++multiplications;
+                }
+                std::shared_ptr<Expression> product = simplify(Expression::multiply(outer, inner));
+                auto existing = labels.find(predecessor.first);
+                std::shared_ptr<Expression> value = existing == labels.end() ? product :
+                                                    simplify(Expression::add(existing->second, product));
+                std::shared_ptr<Variable> existingEdge = existing == labels.end() ? nullptr :
+                                                         std::dynamic_pointer_cast<Variable>(existing->second);
+
+                if (value->getType() == Expression::ELEMENTARY_VALUE) {
+                    labels[predecessor.first] = value;
+                } else if (statements == nullptr) {
+                    // Only counting, the label is some expression
+                    labels[predecessor.first] = std::make_shared<Variable>(Type("double"), EDGE_PREFIX);
+                } else if (existingEdge != nullptr && owned.count(existingEdge->symbol) &&
+                           countLabelled(graph, existingEdge->symbol) == 1) {
+                    statements->push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+                            BinaryOperator::PLUS_EQUALS, existingEdge, product)));
+                } else if (existing == labels.end() && value->getType() == Expression::VARIABLE) {
+                    // A product with 1, the edges share the label until one of them is updated
+                    labels[predecessor.first] = value;
+                } else {
+                    labels[predecessor.first] = declareEdge(value, *statements);
+                }
+                graph[predecessor.first].successors.insert(successor);
+            }
+            labels.erase(eliminated);
+        }
+        for (auto &predecessor: vertex.predecessors) {
+            graph[predecessor.first].successors.erase(eliminated);
+        }
+        vertex.predecessors.clear();
+        vertex.successors.clear();
+    }
+    return multiplications;
+}
+
+size_t CrossCountryDiff::countLabelled(const std::vector<Vertex> &graph, Symbol label) {
+    size_t result = 0;
+    for (const Vertex &vertex: graph) {
+        for (auto &predecessor: vertex.predecessors) {
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(predecessor.second);
+            if (variable != nullptr && variable->symbol == label) {
+                ++result;
+            }
+        }
+    }
+    return result;
+}
+
+void CrossCountryDiff::countAssignments(std::shared_ptr<Statement> statement,
+                                        std::unordered_map<std::string, int> &assignments) {
+    if (statement->getType() == Statement::BLOCK) {
+        for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+            countAssignments(inner, assignments);
+        }
+    } else if (statement->getType() == Statement::EXPRESSION) {
+        std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+        std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expr);
+        if (op != nullptr && op->op >= BinaryOperator::EQUALS && op->op <= BinaryOperator::DIVIDE_EQUALS) {
+            std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(op->left);
+            assignments[target != nullptr ? target->name : op->left->to_string()]++;
+        }
+    }
+}
+
+bool CrossCountryDiff::isScalar(const Type &type) {
+    return type.generics.empty() && (type.name == "double" || type.name == "float");
+}
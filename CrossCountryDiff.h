@@ -0,0 +1,94 @@
+#ifndef FINAL_PROJECT_CROSS_COUNTRY_DIFF_H
+#define FINAL_PROJECT_CROSS_COUNTRY_DIFF_H
+
+#include "Diff.h"
+#include <map>
+#include <set>
+#include <unordered_set>
+
+// Generates the d_ functions of straight-line functions by cross-country Jacobian accumulation. The function is
+// turned into its linearized computational graph: a vertex per input, assignment and output, with an edge from each
+// variable an assignment reads labelled with the local partial derivative. The intermediate vertices are eliminated
+// one by one, each elimination of j adding c_kj * c_ji to the label of the edge from i to k, until only the edges
+// from the inputs to the outputs are left: the Jacobian. The multiplications are counted for three orders, the
+// vertex with the fewest predecessor and successor pairs first (Markowitz order), the forward order and the reverse
+// order, and the cheapest one is emitted.
+// Functions with loops, branches or vectors throw a DiffException.
+class CrossCountryDiff: public Diff {
+public:
+    enum Order {
+        MARKOWITZ,
+        FORWARD_ORDER,
+        REVERSE_ORDER
+    };
+
+    // Multiplications of two labels that are not numbers in the Markowitz order and in the forward and reverse
+    // orders, which are the ones of the forward and reverse modes on the same graph
+    struct Counts {
+        size_t markowitz = 0;
+        size_t forward = 0;
+        size_t reverse = 0;
+        // The order emitted, the first of the cheapest ones
+        Order order = MARKOWITZ;
+
+        size_t count(Order of) const;
+    };
+
+protected:
+    static const std::string EDGE_PREFIX;
+    static const std::string RETURN_KEY;
+
+    typedef std::vector<std::shared_ptr<Statement>> Statements;
+
+    struct Vertex {
+        // Labels of the edges to this vertex, by their source
+        std::map<size_t, std::shared_ptr<Expression>> predecessors;
+        std::set<size_t> successors;
+    };
+
+    std::shared_ptr<DiffContext> context;
+    // The inputs first, in the order of the differentiated parameters
+    std::vector<Vertex> vertices;
+    size_t inputCount = 0;
+    std::vector<size_t> outputs;
+    // Vertex holding the current value of each variable or element, by its string
+    std::unordered_map<std::string, size_t> current;
+    // Times each variable or element is assigned in the function
+    std::unordered_map<std::string, int> assignments;
+    // Labels declared as locals of the generated function, which the elimination updates in place
+    std::unordered_set<Symbol> owned;
+    Counts counts;
+
+public:
+    using Diff::diff;
+
+    CrossCountryDiff() = default;
+    explicit CrossCountryDiff(Options options): Diff(options) {}
+
+    std::shared_ptr<Function> diff(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage) override;
+
+    const Counts &getCounts() const {
+        return counts;
+    }
+    std::string report() const;
+    static std::string orderName(Order order);
+
+protected:
+    // Adds the vertex of an assignment of value to the variable or element key, and the labels of its edges
+    void addAssignment(const std::string &key, std::shared_ptr<Expression> value, Statements &statements);
+    void addOutput(const std::string &key);
+
+    // Label of a new edge, stored in a local unless it is a number or a variable that is not assigned again
+    std::shared_ptr<Expression> label(std::shared_ptr<Expression> partial, Statements &statements);
+    std::shared_ptr<Variable> declareEdge(std::shared_ptr<Expression> value, Statements &statements);
+    // Eliminates the intermediate vertices of the graph in the order, adding the updates of the labels to
+    // statements unless it is nullptr. Returns the number of multiplications.
+    size_t eliminate(std::vector<Vertex> &graph, Order order, Statements *statements);
+
+    // Number of edges of the graph labelled with the local, which is updated in place only when it is one
+    static size_t countLabelled(const std::vector<Vertex> &graph, Symbol label);
+    static void countAssignments(std::shared_ptr<Statement> statement, std::unordered_map<std::string, int> &assignments);
+    static bool isScalar(const Type &type);
+};
+
+#endif //FINAL_PROJECT_CROSS_COUNTRY_DIFF_H
@@ -0,0 +1,410 @@
+#include "DeadStoreElimination.h"
+#include "Diff.h"
+
+size_t DeadStoreElimination::run(std::shared_ptr<Function> function) {
+    DeadStoreElimination elimination;
+    std::unordered_map<Symbol, int> declarations;
+    for (std::shared_ptr<Variable> &param: function->declaration->params) {
+        declarations[param->symbol]++;
+    }
+    elimination.findDeclared(function->block, declarations);
+    for (auto &declaration: declarations) {
+        if (declaration.second > 1) {
+            elimination.shadowed.insert(declaration.first);
+        }
+    }
+    for (std::shared_ptr<Variable> &param: function->declaration->params) {
+        elimination.locals.erase(param->symbol);
+    }
+
+    size_t removed;
+    do {
+        removed = elimination.removed;
+        elimination.sweep(function->block->statements, Live());
+        std::unordered_map<Symbol, int> reads;
+        findReferenced(function->block, reads, false);
+        elimination.removeUnused(function->block->statements, reads);
+    } while (elimination.removed != removed);
+    return elimination.removed;
+}
+
+DeadStoreElimination::Live DeadStoreElimination::sweep(std::vector<std::shared_ptr<Statement>> &statements, Live live) {
+    for (size_t i = statements.size(); i-- > 0;) {
+        live = sweep(statements[i], live);
+    }
+    statements.erase(std::remove(statements.begin(), statements.end(), nullptr), statements.end());
+    return live;
+}
+
+DeadStoreElimination::Live DeadStoreElimination::sweep(std::shared_ptr<Statement> &statement, Live live) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            return sweepExpression(statement, live);
+        case Statement::RETURN: {
+            // Nothing after the return is reached
+            Live result;
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            if (expr != nullptr) {
+                addReferenced(expr, result);
+            }
+            return result;
+        }
+        case Statement::BLOCK: {
+            std::vector<std::shared_ptr<Statement>> &statements = std::dynamic_pointer_cast<BlockStatement>(statement)->statements;
+            live = sweep(statements, live);
+            if (statements.empty()) {
+                statement = nullptr;
+            }
+            return live;
+        }
+        case Statement::IF: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            Live result = sweep(conditional->statement, live);
+            if (conditional->statement == nullptr) {
+                conditional->statement = std::make_shared<BlockStatement>(std::vector<std::shared_ptr<Statement>>());
+            }
+            if (conditional->elseStatement != nullptr) {
+                Live elseLive = sweep(conditional->elseStatement, live);
+                if (conditional->elseStatement == nullptr) {
+                    conditional->elseStatement = std::make_shared<BlockStatement>(std::vector<std::shared_ptr<Statement>>());
+                }
+                result.insert(elseLive.begin(), elseLive.end());
+            } else {
+                result.insert(live.begin(), live.end());
+            }
+            addReferenced(conditional->condition, result);
+            return result;
+        }
+        case Statement::WHILE_LOOP:
+        case Statement::FOR_LOOP: {
+            // Any variable of the loop may be read by a later iteration
+            std::unordered_map<Symbol, int> references;
+            findReferenced(statement, references);
+            for (auto &reference: references) {
+                live.insert(reference.first);
+            }
+
+            std::shared_ptr<Statement> &body = statement->getType() == Statement::FOR_LOOP ?
+                    std::dynamic_pointer_cast<ForLoop>(statement)->statement :
+                    std::dynamic_pointer_cast<ConditionalStatement>(statement)->statement;
+            sweep(body, live);
+            if (body == nullptr) {
+                body = std::make_shared<BlockStatement>(std::vector<std::shared_ptr<Statement>>());
+            }
+            return live;
+        }
+        default: {
+            std::unordered_map<Symbol, int> references;
+            findReferenced(statement, references);
+            for (auto &reference: references) {
+                live.insert(reference.first);
+            }
+            return live;
+        }
+    }
+}
+
+DeadStoreElimination::Live DeadStoreElimination::sweepExpression(std::shared_ptr<Statement> &statement, Live live) {
+    std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+    std::shared_ptr<Variable> declared = std::dynamic_pointer_cast<Variable>(expr);
+    if (declared != nullptr && declared->declaration) {
+        if (!shadowed.count(declared->symbol)) {
+            live.erase(declared->symbol);
+        }
+        if (declared->constructorCall != nullptr) {
+            addReferenced(declared->constructorCall, live);
+        }
+        return live;
+    }
+
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expr);
+    if (op == nullptr || op->op < BinaryOperator::EQUALS || op->op > BinaryOperator::DIVIDE_EQUALS) {
+        addReferenced(expr, live);
+        return live;
+    }
+
+    std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(op->left);
+    std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(op->left);
+    std::shared_ptr<Expression> index;
+    if (target == nullptr && indexing != nullptr && indexing->op == BinaryOperator::INDEXING) {
+        target = std::dynamic_pointer_cast<Variable>(indexing->left);
+        index = indexing->right;
+    }
+    if (target == nullptr) {
+        addReferenced(expr, live);
+        return live;
+    }
+
+    Symbol symbol = target->symbol;
+    std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(op->right);
+    if ((op->op == BinaryOperator::PLUS_EQUALS || op->op == BinaryOperator::MINUS_EQUALS) && number != nullptr &&
+            number->isZero() && (index == nullptr || Diff::isPure(index))) {
+        ++removed;
+        statement = nullptr;
+        return live;
+    }
+    // A declaration of auto type needs its value
+    bool dead = locals.count(symbol) && !live.count(symbol) && Diff::isPure(op->right) &&
+                (index == nullptr || Diff::isPure(index)) && !(target->declaration && target->type.name == "auto");
+    if (dead) {
+        ++removed;
+        if (target->declaration) {
+            // The later stores still need the declaration
+            statement = std::make_shared<ExpressionStatement>(std::make_shared<Variable>(target->type, symbol, true));
+        } else {
+            statement = nullptr;
+        }
+        return live;
+    }
+
+    if (index == nullptr && op->op == BinaryOperator::EQUALS && !shadowed.count(symbol)) {
+        live.erase(symbol);
+    }
+    if (index != nullptr) {
+        addReferenced(index, live);
+    }
+    if (op->op != BinaryOperator::EQUALS) {
+        live.insert(symbol);
+    }
+    addReferenced(op->right, live);
+    return live;
+}
+
+void DeadStoreElimination::removeUnused(std::vector<std::shared_ptr<Statement>> &statements,
+                                        std::unordered_map<Symbol, int> &reads) {
+    for (std::shared_ptr<Statement> &statement: statements) {
+        std::shared_ptr<Statement> body;
+        switch (statement->getType()) {
+            case Statement::EXPRESSION:
+                if (isUnused(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr, reads)) {
+                    statement = nullptr;
+                    ++removed;
+                }
+                break;
+            case Statement::BLOCK: {
+                std::vector<std::shared_ptr<Statement>> &inner = std::dynamic_pointer_cast<BlockStatement>(statement)->statements;
+                removeUnused(inner, reads);
+                if (inner.empty()) {
+                    statement = nullptr;
+                }
+                break;
+            }
+            case Statement::IF: {
+                std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+                body = conditional->statement;
+                if (conditional->elseStatement != nullptr &&
+                        conditional->elseStatement->getType() == Statement::BLOCK) {
+                    removeUnused(std::dynamic_pointer_cast<BlockStatement>(conditional->elseStatement)->statements,
+                                 reads);
+                }
+                break;
+            }
+            case Statement::WHILE_LOOP:
+                body = std::dynamic_pointer_cast<ConditionalStatement>(statement)->statement;
+                break;
+            case Statement::FOR_LOOP:
+                body = std::dynamic_pointer_cast<ForLoop>(statement)->statement;
+                break;
+            default:
+                break;
+        }
+        if (body != nullptr && body->getType() == Statement::BLOCK) {
+            removeUnused(std::dynamic_pointer_cast<BlockStatement>(body)->statements, reads);
+        }
+    }
+    statements.erase(std::remove(statements.begin(), statements.end(), nullptr), statements.end());
+}
+
+bool DeadStoreElimination::isUnused(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &reads) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Expression> value;
+    if (variable != nullptr) {
+        if (!variable->declaration) {
+            return false;
+        }
+        value = variable->constructorCall;
+    } else {
+        variable = assignedVariable(expression);
+        if (variable == nullptr) {
+            return false;
+        }
+        value = op->right;
+        // The indexes of the elements stored are evaluated too
+        for (std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(op->left);
+                indexing != nullptr && indexing->op == BinaryOperator::INDEXING;
+                indexing = std::dynamic_pointer_cast<BinaryOperator>(indexing->left)) {
+            if (!Diff::isPure(indexing->right)) {
+                return false;
+            }
+        }
+    }
+    // The stores through a reference change another variable
+    const std::string &type = variable->type.name;
+    bool reference = !type.empty() && type.back() == '&';
+    return locals.count(variable->symbol) && reads[variable->symbol] == 0 && !reference &&
+           (value == nullptr || Diff::isPure(value));
+}
+
+void DeadStoreElimination::findDeclared(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &declarations) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+            findDeclared(expr, declarations);
+            break;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                findDeclared(inner, declarations);
+            }
+            break;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            findDeclared(conditional->statement, declarations);
+            if (conditional->elseStatement != nullptr) {
+                findDeclared(conditional->elseStatement, declarations);
+            }
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                findDeclared(loop->definition, declarations);
+            }
+            findDeclared(loop->statement, declarations);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DeadStoreElimination::findDeclared(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &declarations) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+    std::shared_ptr<Lambda> lambda = std::dynamic_pointer_cast<Lambda>(expression);
+    if (variable != nullptr && variable->declaration) {
+        declarations[variable->symbol]++;
+        locals.insert(variable->symbol);
+    } else if (unary != nullptr) {
+        findDeclared(unary->expr, declarations);
+    } else if (binary != nullptr) {
+        findDeclared(binary->left, declarations);
+        findDeclared(binary->right, declarations);
+    } else if (call != nullptr) {
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            findDeclared(arg, declarations);
+        }
+    } else if (lambda != nullptr) {
+        for (std::shared_ptr<Variable> &param: lambda->params) {
+            declarations[param->symbol]++;
+        }
+        findDeclared(lambda->block, declarations);
+    }
+}
+
+void DeadStoreElimination::findReferenced(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &references,
+                                          bool targets) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            findReferenced(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr, references, targets);
+            break;
+        case Statement::RETURN: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ReturnStatement>(statement)->expr;
+            if (expr != nullptr) {
+                findReferenced(expr, references, targets);
+            }
+            break;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                findReferenced(inner, references, targets);
+            }
+            break;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            findReferenced(conditional->condition, references, targets);
+            findReferenced(conditional->statement, references, targets);
+            if (conditional->elseStatement != nullptr) {
+                findReferenced(conditional->elseStatement, references, targets);
+            }
+            break;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->definition != nullptr) {
+                findReferenced(loop->definition, references, targets);
+            }
+            if (loop->condition != nullptr) {
+                findReferenced(loop->condition, references, targets);
+            }
+            if (loop->expr != nullptr) {
+                findReferenced(loop->expr, references, targets);
+            }
+            findReferenced(loop->statement, references, targets);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void DeadStoreElimination::findReferenced(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &references,
+                                          bool targets) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+    std::shared_ptr<Lambda> lambda = std::dynamic_pointer_cast<Lambda>(expression);
+    if (variable != nullptr) {
+        if (!variable->declaration) {
+            references[variable->symbol]++;
+        } else if (variable->constructorCall != nullptr) {
+            findReferenced(variable->constructorCall, references, targets);
+        }
+    } else if (unary != nullptr) {
+        findReferenced(unary->expr, references, targets);
+    } else if (binary != nullptr && !targets && assignedVariable(binary) != nullptr) {
+        for (std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(binary->left);
+                indexing != nullptr && indexing->op == BinaryOperator::INDEXING;
+                indexing = std::dynamic_pointer_cast<BinaryOperator>(indexing->left)) {
+            findReferenced(indexing->right, references, targets);
+        }
+        findReferenced(binary->right, references, targets);
+    } else if (binary != nullptr) {
+        findReferenced(binary->left, references, targets);
+        findReferenced(binary->right, references, targets);
+    } else if (call != nullptr) {
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            findReferenced(arg, references, targets);
+        }
+    } else if (lambda != nullptr) {
+        findReferenced(lambda->block, references, targets);
+    }
+}
+
+std::shared_ptr<Variable> DeadStoreElimination::assignedVariable(std::shared_ptr<Expression> expression) {
+    std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    if (op == nullptr || op->op < BinaryOperator::EQUALS || op->op > BinaryOperator::DIVIDE_EQUALS) {
+        return nullptr;
+    }
+    std::shared_ptr<Expression> target = op->left;
+    std::shared_ptr<BinaryOperator> indexing;
+    while ((indexing = std::dynamic_pointer_cast<BinaryOperator>(target)) != nullptr &&
+            indexing->op == BinaryOperator::INDEXING) {
+        target = indexing->left;
+    }
+    return std::dynamic_pointer_cast<Variable>(target);
+}
+
+void DeadStoreElimination::addReferenced(std::shared_ptr<Expression> expression, Live &live) {
+    std::unordered_map<Symbol, int> references;
+    findReferenced(expression, references);
+    for (auto &reference: references) {
+        live.insert(reference.first);
+    }
+}
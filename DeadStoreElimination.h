@@ -0,0 +1,47 @@
+#ifndef FINAL_PROJECT_DEAD_STORE_ELIMINATION_H
+#define FINAL_PROJECT_DEAD_STORE_ELIMINATION_H
+
+#include "SyntaxTreeNode.h"
+#include <unordered_map>
+#include <unordered_set>
+
+// Removes the stores of a generated function whose values never reach its return, such as the primal values a
+// derivative does not use, the updates adding zero, and then the locals that are only stored and never read.
+// Liveness is computed backwards over the statements. Loops keep every variable they reference live, and the
+// variables declared more than once are never considered overwritten, as the analysis does not track scopes.
+class DeadStoreElimination {
+protected:
+    typedef std::unordered_set<Symbol> Live;
+
+    std::unordered_set<Symbol> locals;
+    std::unordered_set<Symbol> shadowed;
+    size_t removed = 0;
+
+public:
+    // Returns the number of statements removed
+    static size_t run(std::shared_ptr<Function> function);
+
+protected:
+    // Removes the dead stores of the statements given the variables live after them, returns the ones live before
+    Live sweep(std::vector<std::shared_ptr<Statement>> &statements, Live live);
+    // Sets statement to nullptr when it is removed
+    Live sweep(std::shared_ptr<Statement> &statement, Live live);
+    Live sweepExpression(std::shared_ptr<Statement> &statement, Live live);
+    // Removes the declarations and the stores of the locals that are never read
+    void removeUnused(std::vector<std::shared_ptr<Statement>> &statements, std::unordered_map<Symbol, int> &reads);
+    bool isUnused(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &reads);
+
+    void findDeclared(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &declarations);
+    void findDeclared(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &declarations);
+    // Every variable occurring in the statement or expression, including the lambdas, except the declarations.
+    // Without targets, the variables assigned are left out, as their stores do not read them.
+    static void findReferenced(std::shared_ptr<Statement> statement, std::unordered_map<Symbol, int> &references,
+                               bool targets=true);
+    static void findReferenced(std::shared_ptr<Expression> expression, std::unordered_map<Symbol, int> &references,
+                               bool targets=true);
+    // The variable whose value or element the expression assigns, nullptr for the other expressions
+    static std::shared_ptr<Variable> assignedVariable(std::shared_ptr<Expression> expression);
+    static void addReferenced(std::shared_ptr<Expression> expression, Live &live);
+};
+
+#endif //FINAL_PROJECT_DEAD_STORE_ELIMINATION_H
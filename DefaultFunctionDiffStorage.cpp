@@ -1,65 +1,89 @@
 #include "DefaultFunctionDiffStorage.h"
 
-std::shared_ptr<Expression> DefaultFunctionDiffStorage::CosDiffCalculator::calculate
-        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) {
+Diff::Tangents DefaultFunctionDiffStorage::multiplyEach(const std::shared_ptr<Expression> &derivative,
+                                                        const Diff::Tangents &argTangents) {
+    Diff::Tangents result;
+    result.reserve(argTangents.size());
+    for (const std::shared_ptr<Expression> &argTangent: argTangents) {
+        result.push_back(Expression::multiply(derivative, argTangent));
+    }
+    return result;
+}
+
+Diff::Tangents DefaultFunctionDiffStorage::CosDiffCalculator::calculate
+        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) {
     std::shared_ptr<Expression> arg = call->args[0];
     FunctionSignature sinSignature = FunctionSignature("std::sin", Type());
-    std::shared_ptr<Expression> result = std::make_shared<Call>(sinSignature, arg);
+    std::shared_ptr<Expression> result = std::make_shared<Call>(sinSignature, diff.bind(arg, context));
     result = std::make_shared<UnaryOperator>(UnaryOperator::MINUS, result);
-    return Expression::multiply(result, diff.diff(arg, context, wrt));
+    return multiplyEach(result, diff.diff(arg, context, wrts));
 }
 
-std::shared_ptr<Expression> DefaultFunctionDiffStorage::SinDiffCalculator::calculate
-        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) {
+Diff::Tangents DefaultFunctionDiffStorage::SinDiffCalculator::calculate
+        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) {
     std::shared_ptr<Expression> arg = call->args[0];
     FunctionSignature cosSignature = FunctionSignature("std::cos", Type());
-    std::shared_ptr<Expression> result = std::make_shared<Call>(cosSignature, arg);
-    return Expression::multiply(result, diff.diff(arg, context, wrt));
+    std::shared_ptr<Expression> result = std::make_shared<Call>(cosSignature, diff.bind(arg, context));
+    return multiplyEach(result, diff.diff(arg, context, wrts));
 }
 
-std::shared_ptr<Expression> DefaultFunctionDiffStorage::PowDiffCalculator::calculate
-        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) {
-    std::shared_ptr<Expression> first = call->args[0];
-    std::shared_ptr<Expression> second = call->args[1];
+Diff::Tangents DefaultFunctionDiffStorage::PowDiffCalculator::calculate
+        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) {
+    Diff::Tangents dFirst = diff.diff(call->args[0], context, wrts);
+    Diff::Tangents dSecond = diff.diff(call->args[1], context, wrts);
+    std::shared_ptr<Expression> first = diff.bind(call->args[0], context);
+    std::shared_ptr<Expression> second = diff.bind(call->args[1], context);
 
     std::shared_ptr<Expression> left = std::make_shared<Call>(call->signature, first,
          Expression::subtract(second, std::make_shared<Number>("1")));
     left = Expression::multiply(second, left);
-    left = Expression::multiply(left, diff.diff(first, context, wrt));
     FunctionSignature logSignature = FunctionSignature("std::log", Type());
     std::shared_ptr<Call> logCall = std::make_shared<Call>(logSignature, first);
-    std::shared_ptr<Expression> right = Expression::multiply(call, logCall);
-    right =  Expression::multiply(right, diff.diff(second, context, wrt));
-    return  Expression::add(left, right);
+    std::shared_ptr<Expression> right = Expression::multiply(diff.bind(call, context), logCall);
+
+    Diff::Tangents result;
+    for (int i = 0; i < wrts.size(); ++i) {
+        result.push_back(Expression::add(Expression::multiply(left, dFirst[i]), Expression::multiply(right, dSecond[i])));
+    }
+    return result;
 }
 
-std::shared_ptr<Expression> DefaultFunctionDiffStorage::LogDiffCalculator::calculate
-        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) {
-    std::shared_ptr<Expression> arg = call->args[0];
-    return Expression::divide(diff.diff(arg, context, wrt), arg);
+Diff::Tangents DefaultFunctionDiffStorage::LogDiffCalculator::calculate
+        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) {
+    Diff::Tangents dArgs = diff.diff(call->args[0], context, wrts);
+    std::shared_ptr<Expression> arg = diff.bind(call->args[0], context);
+    Diff::Tangents result;
+    for (std::shared_ptr<Expression> &dArg: dArgs) {
+        result.push_back(Expression::divide(dArg, arg));
+    }
+    return result;
 }
 
-std::shared_ptr<Expression>
+Diff::Tangents
 DefaultFunctionDiffStorage::VectorConstructorDiffCalculator::calculate(std::shared_ptr<Call> call, Diff &diff,
                                                                        std::shared_ptr<Diff::DiffContext> context,
-                                                                       std::shared_ptr<Variable> wrt) {
-    return std::make_shared<Call>(call->signature, call->args[0], diff.diff(call->args[1], context, wrt));
+                                                                       const Diff::WrtList &wrts) {
+    Diff::Tangents result;
+    for (std::shared_ptr<Expression> &dValue: diff.diff(call->args[1], context, wrts)) {
+        result.push_back(std::make_shared<Call>(call->signature, call->args[0], dValue));
+    }
+    return result;
 }
 
-std::shared_ptr<Expression>
+Diff::Tangents
 DefaultFunctionDiffStorage::ExpDiffCalculator::calculate(std::shared_ptr<Call> call, Diff &diff,
                                                          std::shared_ptr<Diff::DiffContext> context,
-                                                         std::shared_ptr<Variable> wrt) {
-    return Expression::multiply(call, diff.diff(call->args[0], context, wrt));
+                                                         const Diff::WrtList &wrts) {
+    return multiplyEach(diff.bind(call, context), diff.diff(call->args[0], context, wrts));
 }
 
-std::shared_ptr<Expression>
+Diff::Tangents
 DefaultFunctionDiffStorage::AbsDiffCalculator::calculate(std::shared_ptr<Call> call, Diff &diff,
                                                          std::shared_ptr<Diff::DiffContext> context,
-                                                         std::shared_ptr<Variable> wrt) {
-    std::shared_ptr<Expression> first = call->args[0];
+                                                         const Diff::WrtList &wrts) {
+    std::shared_ptr<Expression> first = diff.bind(call->args[0], context);
     std::shared_ptr<Expression> sign = Expression::subtract(
             std::make_shared<BinaryOperator>(BinaryOperator::MORE, first, std::make_shared<Number>(0)),
             std::make_shared<BinaryOperator>(BinaryOperator::LESS, first, std::make_shared<Number>(0)));
-    return Expression::multiply(sign, diff.diff(call->args[0], context, wrt));
+    return multiplyEach(sign, diff.diff(call->args[0], context, wrts));
 }
@@ -4,46 +4,53 @@
 #include "FunctionDiffStorage.h"
 
 class DefaultFunctionDiffStorage: public FunctionDiffStorage {
+    // Applies the chain rule for a function of one argument: multiplies each argument tangent by the derivative
+    static Diff::Tangents multiplyEach(const std::shared_ptr<Expression> &derivative, const Diff::Tangents &argTangents);
+
     struct CosDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct SinDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct PowDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct ExpDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct LogDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
-                                              std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct VectorConstructorDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
-                                              std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
     struct AbsDiffCalculator: virtual DiffCalculator {
-        std::shared_ptr<Expression> calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
-                                              std::shared_ptr<Variable> wrt) override;
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
     };
 
 public:
     explicit DefaultFunctionDiffStorage(std::shared_ptr<Context> context): FunctionDiffStorage(std::move(context)) {
-        addDiffCalculator(FunctionSignature("std::cos", Type()), new CosDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::sin", Type()), new SinDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::pow", Type(), Type()), new PowDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::exp", Type()), new ExpDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::log", Type()), new LogDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::vector", Type(), Type()), new VectorConstructorDiffCalculator());
-        addDiffCalculator(FunctionSignature("std::abs", Type()), new AbsDiffCalculator());
+        addDiffCalculator(FunctionSignature("std::cos", Type()), std::make_shared<CosDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::sin", Type()), std::make_shared<SinDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::pow", Type(), Type()), std::make_shared<PowDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::exp", Type()), std::make_shared<ExpDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::log", Type()), std::make_shared<LogDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::vector", Type(), Type()), std::make_shared<VectorConstructorDiffCalculator>());
+        addDiffCalculator(FunctionSignature("std::abs", Type()), std::make_shared<AbsDiffCalculator>());
     }
 };
 
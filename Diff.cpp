@@ -1,49 +1,113 @@
 #include "Diff.h"
+#include "ReverseDiff.h"
+#include "CrossCountryDiff.h"
+#include "TaylorMode.h"
+#include "DualMode.h"
+#include "CostModel.h"
+#include "ConstantPropagation.h"
+#include "DeadStoreElimination.h"
 #include "FunctionDiffStorage.h"
 
 const std::string Diff::DERIVATIVE_WRT_PREFIX = "d_";
 const std::string Diff::DERIVATIVE_VAR_PREFIX = "_";
 const std::string Diff::DERIVATIVE_FUNCTION_PREFIX = "d_";
 const std::string Diff::DERIVATIVE_FILE_PREFIX = "d_";
+const std::string Diff::TEMPORARY_PREFIX = "_t";
+const std::string Diff::VALUE_AND_JACOBIAN_PREFIX = "value_and_jac_";
+const std::string Diff::SENSITIVITY_FUNCTION_PREFIX = "sens_";
+const std::string Diff::SENSITIVITY_NAME = "S";
+
+std::string Diff::Options::to_string() const {
+    return "mode " + std::to_string(mode) + " temporaryThreshold " + std::to_string(temporaryThreshold) +
+           " reverse " + std::to_string(reverse) + " valueAndJacobian " + std::to_string(valueAndJacobian) +
+           " sensitivities " + std::to_string(sensitivities) + " taylor " + std::to_string(taylor) +
+           " dual " + std::to_string(dual) + " checkpoints " + std::to_string(checkpoints) +
+           " preaccumulate " + std::to_string(preaccumulate) +
+           " propagateConstants " + std::to_string(propagateConstants) +
+           " eliminateDeadStores " + std::to_string(eliminateDeadStores) + "\n";
+}
 
 std::string Diff::createDerivativeName(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context,
                                        std::shared_ptr<Variable> wrt) {
     return DERIVATIVE_WRT_PREFIX + wrt->name + DERIVATIVE_VAR_PREFIX + variable->name;
 }
 
-std::shared_ptr<Expression> Diff::diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
-                                       std::shared_ptr<Variable> wrt, bool leftEquality, bool topStatement) {
+Symbol Diff::getDerivativeSymbol(std::shared_ptr<Variable> &variable, std::shared_ptr<DiffContext> &context,
+                                 std::shared_ptr<Variable> &wrt) {
+    if (derivativeSymbols.size() <= wrt->symbol) {
+        derivativeSymbols.resize(wrt->symbol + 1);
+    }
+    std::vector<Symbol> &wrtSymbols = derivativeSymbols[wrt->symbol];
+    if (wrtSymbols.size() <= variable->symbol) {
+        wrtSymbols.resize(variable->symbol + 1, SymbolTable::EMPTY);
+    }
+
+    Symbol &symbol = wrtSymbols[variable->symbol];
+    if (symbol == SymbolTable::EMPTY) {
+        symbol = SymbolTable::global().intern(createDerivativeName(variable, context, wrt));
+    }
+    return symbol;
+}
+
+Diff::Tangents Diff::diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts, bool leftEquality, bool topStatement) {
     if (leftEquality && expression->getType() != Expression::VARIABLE &&
             expression->getType() != Expression::VARIABLE_DECLARATION &&
             expression->getType() != Expression::BINARY_OPERATOR) {
         throw DiffException("Only variables are allowed as assignable types in equalities");
     }
 
+    std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    if (!context->seeds.empty() && (expression->getType() == Expression::VARIABLE ||
+            (indexing != nullptr && indexing->op == BinaryOperator::INDEXING))) {
+        Symbol seed = findSeed(expression, context);
+        Tangents result;
+        for (const std::shared_ptr<Variable> &wrt: wrts) {
+            result.push_back(std::make_shared<Number>(wrt->symbol == seed ? 1 : 0));
+        }
+        return result;
+    }
+
     switch(expression->getType()) {
         case Expression::VARIABLE:
         case Expression::VARIABLE_DECLARATION:
-            return diff(std::dynamic_pointer_cast<Variable>(expression), context, wrt, leftEquality, topStatement);
+            return diff(std::dynamic_pointer_cast<Variable>(expression), context, wrts, leftEquality, topStatement);
         case Expression::UNARY_OPERATOR:
-            return diff(std::dynamic_pointer_cast<UnaryOperator>(expression), context, wrt);
+            return diff(std::dynamic_pointer_cast<UnaryOperator>(expression), context, wrts);
         case Expression::BINARY_OPERATOR:
-            return diff(std::dynamic_pointer_cast<BinaryOperator>(expression), context, wrt);
+            return diff(std::dynamic_pointer_cast<BinaryOperator>(expression), context, wrts);
         case Expression::ELEMENTARY_VALUE:
-            return diff(std::dynamic_pointer_cast<ElementaryValue>(expression), context, wrt);
+            return diff(std::dynamic_pointer_cast<ElementaryValue>(expression), context, wrts);
         case Expression::CALL:
-            return diff(std::dynamic_pointer_cast<Call>(expression), context, wrt);
+            return diff(std::dynamic_pointer_cast<Call>(expression), context, wrts);
         default:
             throw DiffException("Unsupported Expression Type for differentiation provided");
     }
 }
 
-std::shared_ptr<Expression> Diff::diff(std::shared_ptr<ElementaryValue> value, std::shared_ptr<DiffContext> context,
-                                       std::shared_ptr<Variable> wrt) {
-    return std::make_shared<Number>("0");
+std::shared_ptr<Expression> Diff::diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                                       std::shared_ptr<Variable> wrt, bool leftEquality, bool topStatement) {
+    return diff(std::move(expression), std::move(context), WrtList{std::move(wrt)}, leftEquality, topStatement)[0];
+}
+
+Diff::Tangents Diff::diff(std::shared_ptr<ElementaryValue> value, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts) {
+    return Tangents(wrts.size(), std::make_shared<Number>("0"));
+}
+
+Diff::Tangents Diff::diff(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts, bool leftEquality, bool topStatement) {
+    Tangents result;
+    result.reserve(wrts.size());
+    for (const std::shared_ptr<Variable> &wrt: wrts) {
+        result.push_back(diff(variable, context, wrt, leftEquality, topStatement));
+    }
+    return result;
 }
 
 std::shared_ptr<Expression> Diff::diff(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context,
                                        std::shared_ptr<Variable> wrt, bool leftEquality, bool topStatement) {
-    std::string derName = createDerivativeName(variable, context, wrt);
+    Symbol derName = getDerivativeSymbol(variable, context, wrt);
     if (variable->declaration) {
         if (!leftEquality && !topStatement) {
             throw DiffException("Variable declaration is only allowed on the left of equalities");
@@ -51,57 +115,70 @@ std::shared_ptr<Expression> Diff::diff(std::shared_ptr<Variable> variable, std::
 
         if (context->derivedVariables.count(derName)) {
             return context->derivedVariables[derName];
-        } else if (context->funcContext->variables.count(derName)) {
-            return context->funcContext->variables[derName];
+        } else if (context->funcContext->isOwnVariablePresent(derName)) {
+            return context->funcContext->getOwnVariable(derName);
         } else {
             context->derivedVariables[derName] = std::make_shared<Variable>(variable->type, derName);
             std::shared_ptr<Call> constructorCall;
             if (variable->constructorCall != nullptr) {
                 constructorCall = std::dynamic_pointer_cast<Call>(diff(variable->constructorCall, context, wrt));
+            } else if (context->activity != nullptr && context->activity->isIndexed(variable->symbol)) {
+                // The elements without tangent statements stay zero
+                FunctionSignature signature(variable->type.name);
+                constructorCall = std::make_shared<Call>(signature);
             }
             return std::make_shared<Variable>(variable->type, derName, true, constructorCall);
         }
     }
 
-    if (context->derivedVariables.count(derName)) {
+    if (!leftEquality && !hasTangent(variable, context, wrt)) {
+        return std::make_shared<Number>("0");
+    } else if (context->derivedVariables.count(derName)) {
         return context->derivedVariables[derName];
-    } else if (context->funcContext->variables.count(derName)) {
-        return context->funcContext->variables[derName];
-    } else if (variable->name == wrt->name) {
+    } else if (context->funcContext->isOwnVariablePresent(derName)) {
+        return context->funcContext->getOwnVariable(derName);
+    } else if (variable->symbol == wrt->symbol) {
         if (leftEquality) {
             context->derivedVariables[derName] = std::make_shared<Variable>(variable->type, derName);
             return std::make_shared<Variable>(variable->type, derName, true);
         }
         return std::make_shared<Number>("1");
-    } else if (context->arguments.count(variable->name)) {
+    } else if (context->arguments.count(variable->symbol)) {
         if (leftEquality) {
             context->derivedVariables[derName] = std::make_shared<Variable>(variable->type, derName);
             return std::make_shared<Variable>(variable->type, derName, true);
         }
         return std::make_shared<Number>("0");
     } else {
-        throw DiffException("Cannot differentiate as variable '" + derName + "' was not defined");
+        throw DiffException("Cannot differentiate as variable '" + SymbolTable::global().name(derName) +
+                            "' was not defined");
     }
 }
 
-std::shared_ptr<Expression> Diff::diff(std::shared_ptr<UnaryOperator> oper, std::shared_ptr<DiffContext> context,
-                                       std::shared_ptr<Variable> wrt) {
+Diff::Tangents Diff::diff(std::shared_ptr<UnaryOperator> oper, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts) {
+    Tangents result;
     switch(oper->op) {
         case UnaryOperator::Operation::PLUS:
         case UnaryOperator::Operation::MINUS:
         case UnaryOperator::Operation::BRACES:
-            return std::make_shared<UnaryOperator>(oper->op, diff(oper->expr, context, wrt));
+            for (std::shared_ptr<Expression> &dExpr: diff(oper->expr, context, wrts)) {
+                result.push_back(std::make_shared<UnaryOperator>(oper->op, dExpr));
+            }
+            return result;
         case UnaryOperator::Operation::PLUS_PLUS:
         case UnaryOperator::Operation::MINUS_MINUS:
-            return diff(oper->expr, context, wrt);
+            return diff(oper->expr, context, wrts);
         default:
             throw DiffException("Unsupported Unary Operator received");
     }
 }
 
-std::shared_ptr<Expression> Diff::diff(std::shared_ptr<BinaryOperator> oper, std::shared_ptr<DiffContext> context,
-                                       std::shared_ptr<Variable> wrt, bool leftEquality) {
+Diff::Tangents Diff::diff(std::shared_ptr<BinaryOperator> oper, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts, bool leftEquality) {
     std::shared_ptr<BinaryOperator> left, right, combined;
+    std::shared_ptr<Expression> boundLeft, boundRight;
+    Tangents dLeft, dRight, dAssigned, result;
     if (leftEquality && oper->op != BinaryOperator::INDEXING) {
         throw DiffException("Only Variables allowed on the left side of an assignment");
     }
@@ -109,60 +186,318 @@ std::shared_ptr<Expression> Diff::diff(std::shared_ptr<BinaryOperator> oper, std
     switch(oper->op) {
         case BinaryOperator::PLUS:
         case BinaryOperator::MINUS:
-            return std::make_shared<BinaryOperator>(oper->op,
-                                                    diff(oper->left, context, wrt),
-                                                    diff(oper->right, context, wrt));
+            dLeft = diff(oper->left, context, wrts);
+            dRight = diff(oper->right, context, wrts);
+            for (int i = 0; i < wrts.size(); ++i) {
+                result.push_back(std::make_shared<BinaryOperator>(oper->op, dLeft[i], dRight[i]));
+            }
+            return result;
         case BinaryOperator::MULTIPLY:
         case BinaryOperator::MULTIPLY_EQUALS:
-            left = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, diff(oper->left, context, wrt), oper->right);
-            right = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, oper->left, diff(oper->right, context, wrt));
-            combined = std::make_shared<BinaryOperator>(BinaryOperator::PLUS, left, right);
+            dLeft = diff(oper->left, context, wrts);
+            dRight = diff(oper->right, context, wrts);
             if (oper->op == BinaryOperator::MULTIPLY_EQUALS) {
-                return std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, diff(oper->left, context, wrt, true), combined);
+                dAssigned = diff(oper->left, context, wrts, true);
             }
-            return combined;
+            boundLeft = bind(oper->left, context);
+            boundRight = bind(oper->right, context);
+            for (int i = 0; i < wrts.size(); ++i) {
+                left = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, dLeft[i], boundRight);
+                right = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, boundLeft, dRight[i]);
+                combined = std::make_shared<BinaryOperator>(BinaryOperator::PLUS, left, right);
+                if (oper->op == BinaryOperator::MULTIPLY_EQUALS) {
+                    result.push_back(std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, dAssigned[i], combined));
+                } else {
+                    result.push_back(combined);
+                }
+            }
+            return result;
         case BinaryOperator::DIVIDE:
         case BinaryOperator::DIVIDE_EQUALS:
-            left = std::make_shared<BinaryOperator>(BinaryOperator::MINUS,
-                                                   std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, diff(oper->left, context, wrt), oper->right),
-                                                   std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, oper->left, diff(oper->right, context, wrt)));
-            right = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, oper->right, oper->right);
-            combined = std::make_shared<BinaryOperator>(BinaryOperator::DIVIDE, left, right);
+            dLeft = diff(oper->left, context, wrts);
+            dRight = diff(oper->right, context, wrts);
             if (oper->op == BinaryOperator::DIVIDE_EQUALS) {
-                return std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, diff(oper->left, context, wrt, true), combined);
+                dAssigned = diff(oper->left, context, wrts, true);
+            }
+            boundLeft = bind(oper->left, context);
+            boundRight = bind(oper->right, context);
+            // The denominator is the same for every wrt
+            right = std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, boundRight, boundRight);
+            for (int i = 0; i < wrts.size(); ++i) {
+                left = std::make_shared<BinaryOperator>(BinaryOperator::MINUS,
+                                                       std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, dLeft[i], boundRight),
+                                                       std::make_shared<BinaryOperator>(BinaryOperator::MULTIPLY, boundLeft, dRight[i]));
+                combined = std::make_shared<BinaryOperator>(BinaryOperator::DIVIDE, left, right);
+                if (oper->op == BinaryOperator::DIVIDE_EQUALS) {
+                    result.push_back(std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, dAssigned[i], combined));
+                } else {
+                    result.push_back(combined);
+                }
             }
-            return combined;
+            return result;
         case BinaryOperator::EQUALS:
         case BinaryOperator::PLUS_EQUALS:
         case BinaryOperator::MINUS_EQUALS:
-            return std::make_shared<BinaryOperator>(oper->op,
-                                                    diff(oper->left, context, wrt, true),
-                                                    diff(oper->right, context, wrt));
-        case BinaryOperator::INDEXING:
-            return std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, diff(oper->left, context, wrt), oper->right);
+            dAssigned = diff(oper->left, context, wrts, true);
+            dRight = diff(oper->right, context, wrts);
+            for (int i = 0; i < wrts.size(); ++i) {
+                result.push_back(std::make_shared<BinaryOperator>(oper->op, dAssigned[i], dRight[i]));
+            }
+            return result;
+        case BinaryOperator::INDEXING: {
+            WrtList active = activeWrts(oper, context, wrts);
+            Tangents dIndexed = diff(oper->left, context, active);
+            for (int i = 0, next = 0; i < wrts.size(); ++i) {
+                if (next < active.size() && active[next] == wrts[i]) {
+                    result.push_back(std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, dIndexed[next++], oper->right));
+                } else {
+                    result.push_back(std::make_shared<Number>("0"));
+                }
+            }
+            return result;
+        }
         default:
             throw DiffException("Unsupported Binary Operator received");
     }
 }
 
-std::shared_ptr<Expression> Diff::diff(std::shared_ptr<Call> call, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt) {
-    std::shared_ptr<Expression> result = context->functionDiffStorage->convert(call, *this, context, wrt);
-    if (result == nullptr) {
+Diff::Tangents Diff::diff(std::shared_ptr<Call> call, std::shared_ptr<DiffContext> context, const WrtList &wrts) {
+    Tangents result = context->functionDiffStorage->convert(call, *this, context, wrts);
+    if (result.size() != wrts.size()) {
         throw DiffException("Cannot differentiate function '" + call->to_string() +
                             "' as cannot find function differentiation calculator");
     }
     return result;
 }
 
+Diff::Tangents Diff::preaccumulate(std::shared_ptr<BinaryOperator> assignment, std::shared_ptr<DiffContext> context,
+                                   const WrtList &wrts) {
+    if (!options.preaccumulate || wrts.size() < 2 || !isPure(assignment->right) ||
+            (assignment->op != BinaryOperator::EQUALS && assignment->op != BinaryOperator::PLUS_EQUALS &&
+             assignment->op != BinaryOperator::MINUS_EQUALS)) {
+        return {};
+    }
+    // Only the tangents of scalars are linear combinations of the operand tangents
+    std::shared_ptr<Variable> target = std::dynamic_pointer_cast<Variable>(assignment->left);
+    std::shared_ptr<BinaryOperator> element = std::dynamic_pointer_cast<BinaryOperator>(assignment->left);
+    bool scalar = target != nullptr ? target->type.generics.empty() && target->type.name != "auto" :
+                  element != nullptr && element->op == BinaryOperator::INDEXING;
+    std::vector<std::shared_ptr<Expression>> candidates;
+    findOperands(assignment->right, candidates);
+    candidates.push_back(assignment->left);
+    for (std::shared_ptr<Expression> &candidate: candidates) {
+        std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(candidate);
+        if (variable != nullptr && context->activity != nullptr && context->activity->isIndexed(variable->symbol)) {
+            scalar = false;
+        }
+    }
+    candidates.pop_back();
+    if (!scalar) {
+        return {};
+    }
+
+    // The operands without tangents are constants of the statement
+    std::vector<std::shared_ptr<Expression>> operands;
+    std::vector<Tangents> dOperands;
+    // Per wrt, the operands with a nonzero tangent, and whether one of them is not a number
+    std::vector<size_t> terms(wrts.size(), 0);
+    std::vector<bool> symbolic(wrts.size(), false);
+    for (std::shared_ptr<Expression> &candidate: candidates) {
+        Tangents dOperand;
+        bool active = false;
+        for (size_t i = 0; i < wrts.size(); ++i) {
+            dOperand.push_back(simplify(diff(candidate, context, wrts[i])));
+            std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(dOperand.back());
+            if (number == nullptr || !number->isZero()) {
+                active = true;
+                ++terms[i];
+                symbolic[i] = symbolic[i] || number == nullptr;
+            }
+        }
+        if (active) {
+            operands.push_back(candidate);
+            dOperands.push_back(dOperand);
+        }
+    }
+    // With the tangents of the operands all numbers, as for the parameters, the tangents are the partial derivatives
+    if (std::count(symbolic.begin(), symbolic.end(), true) < 2) {
+        return {};
+    }
+
+    // The partial derivatives cost about one reverse sweep of the expression, then each wrt a product and a sum
+    // per operand, instead of the tangent of the whole expression
+    CostModel::Estimate local = CostModel::estimateExpression(assignment->right);
+    double direct = 0, combined = local.adjoint.total();
+    for (size_t count: terms) {
+        if (count != 0) {
+            direct += local.tangent.total();
+            combined += 2.0 * count - 1 + CostModel::MEMORY_WEIGHT * count;
+        }
+    }
+    if (combined >= direct) {
+        return {};
+    }
+
+    WrtList seeds = seed(operands, context);
+    Tangents partials;
+    try {
+        partials = diff(assignment->right, context, seeds);
+    } catch (DiffException &) {
+        context->seeds.clear();
+        return {};
+    }
+    context->seeds.clear();
+
+    Tangents dAssigned = diff(assignment->left, context, wrts, true);
+    std::vector<std::shared_ptr<Expression>> coefficients;
+    for (std::shared_ptr<Expression> &partial: partials) {
+        coefficients.push_back(bind(simplify(partial), context, true));
+    }
+    Tangents result;
+    for (size_t i = 0; i < wrts.size(); ++i) {
+        std::shared_ptr<Expression> sum;
+        for (size_t operand = 0; operand < operands.size(); ++operand) {
+            std::shared_ptr<Expression> term = Expression::multiply(coefficients[operand], dOperands[operand][i]);
+            sum = sum == nullptr ? term : Expression::add(sum, term);
+        }
+        result.push_back(std::make_shared<BinaryOperator>(assignment->op, dAssigned[i], sum));
+    }
+    return result;
+}
+
+void Diff::findOperands(std::shared_ptr<Expression> expression, std::vector<std::shared_ptr<Expression>> &operands) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<UnaryOperator> unary = std::dynamic_pointer_cast<UnaryOperator>(expression);
+    std::shared_ptr<BinaryOperator> binary = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+    if ((variable != nullptr && !variable->declaration) || (binary != nullptr && binary->op == BinaryOperator::INDEXING)) {
+        for (std::shared_ptr<Expression> &operand: operands) {
+            if (isSame(operand, expression)) {
+                return;
+            }
+        }
+        operands.push_back(expression);
+    } else if (unary != nullptr) {
+        findOperands(unary->expr, operands);
+    } else if (binary != nullptr) {
+        findOperands(binary->left, operands);
+        findOperands(binary->right, operands);
+    } else if (call != nullptr) {
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            findOperands(arg, operands);
+        }
+    }
+}
+
+Diff::WrtList Diff::seed(const std::vector<std::shared_ptr<Expression>> &operands, std::shared_ptr<DiffContext> context) {
+    while (seedVariables.size() < operands.size()) {
+        seedVariables.push_back(std::make_shared<Variable>(Type("double"),
+                                                           TEMPORARY_PREFIX + "seed" + std::to_string(seedVariables.size())));
+    }
+    WrtList seeds(seedVariables.begin(), seedVariables.begin() + (long) operands.size());
+    for (size_t i = 0; i < operands.size(); ++i) {
+        std::shared_ptr<Expression> element = operands[i]->getType() == Expression::VARIABLE ? nullptr : operands[i];
+        context->seeds[operandVariable(operands[i])->symbol].push_back({element, seeds[i]->symbol});
+    }
+    return seeds;
+}
+
+Symbol Diff::findSeed(std::shared_ptr<Expression> operand, std::shared_ptr<DiffContext> context) {
+    std::shared_ptr<Variable> variable = operandVariable(operand);
+    auto seeds = variable == nullptr ? context->seeds.end() : context->seeds.find(variable->symbol);
+    if (seeds == context->seeds.end()) {
+        return SymbolTable::EMPTY;
+    }
+    bool element = operand->getType() != Expression::VARIABLE;
+    for (DiffContext::Seed &seed: seeds->second) {
+        if (seed.element == nullptr ? !element : element && isSame(seed.element, operand)) {
+            return seed.wrt;
+        }
+    }
+    return SymbolTable::EMPTY;
+}
+
+std::shared_ptr<Variable> Diff::operandVariable(std::shared_ptr<Expression> operand) {
+    std::shared_ptr<BinaryOperator> indexing;
+    while ((indexing = std::dynamic_pointer_cast<BinaryOperator>(operand)) != nullptr &&
+            indexing->op == BinaryOperator::INDEXING) {
+        operand = indexing->left;
+    }
+    return std::dynamic_pointer_cast<Variable>(operand);
+}
+
+bool Diff::isSame(std::shared_ptr<Expression> a, std::shared_ptr<Expression> b) {
+    if (a == b) {
+        return true;
+    } else if (a->getType() != b->getType()) {
+        return false;
+    }
+    switch (a->getType()) {
+        case Expression::VARIABLE:
+            return std::dynamic_pointer_cast<Variable>(a)->symbol == std::dynamic_pointer_cast<Variable>(b)->symbol;
+        case Expression::ELEMENTARY_VALUE: {
+            std::shared_ptr<Number> left = std::dynamic_pointer_cast<Number>(a);
+            std::shared_ptr<Number> right = std::dynamic_pointer_cast<Number>(b);
+            return left != nullptr && right != nullptr && left->value == right->value && left->floating == right->floating;
+        }
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> left = std::dynamic_pointer_cast<UnaryOperator>(a);
+            std::shared_ptr<UnaryOperator> right = std::dynamic_pointer_cast<UnaryOperator>(b);
+            return left->op == right->op && left->suffix == right->suffix && isSame(left->expr, right->expr);
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> left = std::dynamic_pointer_cast<BinaryOperator>(a);
+            std::shared_ptr<BinaryOperator> right = std::dynamic_pointer_cast<BinaryOperator>(b);
+            return left->op == right->op && isSame(left->left, right->left) && isSame(left->right, right->right);
+        }
+        case Expression::CALL: {
+            std::shared_ptr<Call> left = std::dynamic_pointer_cast<Call>(a);
+            std::shared_ptr<Call> right = std::dynamic_pointer_cast<Call>(b);
+            if (!(left->signature == right->signature) || left->args.size() != right->args.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < left->args.size(); ++i) {
+                if (!isSame(left->args[i], right->args[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
 std::vector<std::shared_ptr<Statement> > Diff::diff(
         std::shared_ptr<Statement> statement, std::shared_ptr<DiffContext> context, bool oneStatementRequired) {
     std::vector<std::shared_ptr<Statement>> dStatements;
     if (statement->getType() == Statement::EXPRESSION) {
-        for (std::string &argName: context->argumentNames) {
-            std::shared_ptr<Variable> arg = context->arguments[argName];
-            std::shared_ptr<ExpressionStatement> expressionStatement =
-                    std::dynamic_pointer_cast<ExpressionStatement>(statement);
-            std::shared_ptr<Expression> dExpr = diff(expressionStatement->expr, context, arg, false, true);
+        std::shared_ptr<ExpressionStatement> expressionStatement =
+                std::dynamic_pointer_cast<ExpressionStatement>(statement);
+        // Only the tangents of the assigned variable that can be nonzero are computed
+        std::shared_ptr<Expression> assigned = expressionStatement->expr;
+        std::shared_ptr<BinaryOperator> assignment = std::dynamic_pointer_cast<BinaryOperator>(assigned);
+        std::shared_ptr<UnaryOperator> increment = std::dynamic_pointer_cast<UnaryOperator>(assigned);
+        if (assignment != nullptr && assignment->op >= BinaryOperator::EQUALS &&
+                assignment->op <= BinaryOperator::DIVIDE_EQUALS) {
+            assigned = assignment->left;
+        } else if (increment != nullptr) {
+            assigned = increment->expr;
+        }
+        WrtList wrts = activeWrts(assigned, context, context->argumentVariables);
+        Tangents dExprs;
+        if (assignment != nullptr && assigned == assignment->left) {
+            dExprs = preaccumulate(assignment, context, wrts);
+        }
+        if (dExprs.empty()) {
+            dExprs = diff(expressionStatement->expr, context, wrts, false, true);
+        }
+        if (!context->temporaries.empty()) {
+            // The statement itself also uses the temporaries instead of computing the values again
+            statement = std::make_shared<ExpressionStatement>(replaceBound(expressionStatement->expr, context));
+        }
+        takeTemporaries(context, dStatements);
+        for (std::shared_ptr<Expression> &dExpr: dExprs) {
             dExpr = simplify(dExpr);
             if (dExpr != nullptr) {
                 dStatements.push_back(std::make_shared<ExpressionStatement>(dExpr));
@@ -175,8 +510,9 @@ std::vector<std::shared_ptr<Statement> > Diff::diff(
         std::shared_ptr<ReturnStatement> returnStatement = std::dynamic_pointer_cast<ReturnStatement>(statement);
         if (context->argumentNames.size() == 1) {
             std::shared_ptr<Expression> expr = diff(returnStatement->expr, context, context->arguments[context->argumentNames[0]]);
+            takeTemporaries(context, dStatements);
             expr = simplify(expr);
-            dStatements.push_back(std::make_shared<ReturnStatement>(expr));
+            dStatements.push_back(makeReturn(returnStatement->expr, expr));
         } else {
             std::shared_ptr<Variable> var = std::dynamic_pointer_cast<Variable>(returnStatement->expr);
             if (var == nullptr) {
@@ -184,22 +520,23 @@ std::vector<std::shared_ptr<Statement> > Diff::diff(
             }
 
             size_t nArgs = context->argumentNames.size();
-            std::string returnName = DERIVATIVE_VAR_PREFIX + "return";
+            Symbol returnName = SymbolTable::global().intern(DERIVATIVE_VAR_PREFIX + "return");
             Type returnType = Type("std::array", std::vector<Type>{var->type, Type(std::to_string(nArgs))});
             std::shared_ptr<Variable> returnVariable = std::make_shared<Variable>(returnType, returnName);
             context->funcContext->addVariable(returnName, returnVariable);
             context->derivedVariables[returnName] = returnVariable;
             dStatements.push_back(std::make_shared<ExpressionStatement>(std::make_shared<Variable>(returnType, returnName, true)));
 
+            Tangents dReturn = diff(returnStatement->expr, context, context->argumentVariables);
+            takeTemporaries(context, dStatements);
             for (int i = 0; i < nArgs; ++i) {
                 std::shared_ptr<Expression> left = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING,
                      returnVariable, std::make_shared<Number>(i));
-                std::shared_ptr<Expression> right = diff(returnStatement->expr, context, context->arguments[context->argumentNames[i]]);
-                right = simplify(right);
+                std::shared_ptr<Expression> right = simplify(dReturn[i]);
                 dStatements.push_back(std::make_shared<ExpressionStatement>(
                         std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, left, right)));
             }
-            dStatements.push_back(std::make_shared<ReturnStatement>(returnVariable));
+            dStatements.push_back(makeReturn(returnStatement->expr, returnVariable));
         }
     } else if (statement->getType() == Statement::IF || statement->getType() == Statement::WHILE_LOOP) {
         std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
@@ -249,8 +586,9 @@ std::shared_ptr<BlockStatement> Diff::diff(std::shared_ptr<BlockStatement> block
 std::shared_ptr<FunctionDeclaration> Diff::diff(std::shared_ptr<FunctionDeclaration> decl) {
     std::string name = DERIVATIVE_FUNCTION_PREFIX + decl->name;
     Type returnType = decl->returnType;
-    if (decl->params.size() > 1) {
-        returnType = Type("std::array", std::vector<Type>{decl->returnType, Type(std::to_string(decl->params.size()))});
+    size_t nArgs = decl->getDifferentiatedParams().size();
+    if (nArgs > 1) {
+        returnType = Type("std::array", std::vector<Type>{decl->returnType, Type(std::to_string(nArgs))});
     }
     return std::make_shared<FunctionDeclaration>(name, returnType, decl->params);
 }
@@ -270,14 +608,19 @@ Diff::DiffContext::DiffContext(std::shared_ptr<Function> function, std::shared_p
     funcContext = std::shared_ptr<Context>(function->context->copy());
 
     for (std::shared_ptr<Variable> param: function->declaration->params) {
-        argumentNames.push_back(param->name);
         if (param->type.name == "std::vector" || param->type.name == "std::array") {
-            argumentIndexed[param->name] = 1;
+            argumentIndexed[param->symbol] = 1;
         } else {
-            argumentIndexed[param->name] = 0;
+            argumentIndexed[param->symbol] = 0;
         }
-        arguments[param->name] = param;
+        arguments[param->symbol] = param;
+    }
+    // The other parameters are constants
+    for (std::shared_ptr<Variable> param: function->declaration->getDifferentiatedParams()) {
+        argumentNames.push_back(param->symbol);
+        argumentVariables.push_back(param);
     }
+    activity = std::make_shared<ActivityAnalysis>(function, argumentVariables);
 }
 
 std::shared_ptr<FileNode> Diff::diff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage) {
@@ -295,13 +638,46 @@ std::shared_ptr<FileNode> Diff::diff(std::shared_ptr<FileNode> file, std::shared
 
     std::vector<std::shared_ptr<Statement>> dStatements;
     dStatements.push_back(std::make_shared<Include>("array", true));
+    if (options.reverse) {
+        dStatements.push_back(std::make_shared<Include>("diff_checkpointing.h"));
+    }
+    if (options.valueAndJacobian) {
+        dStatements.push_back(std::make_shared<Include>("utility", true));
+    }
+    if (options.taylor) {
+        dStatements.push_back(std::make_shared<Include>("diff_taylor.h"));
+    }
+    if (options.dual) {
+        dStatements.push_back(std::make_shared<Include>("diff_dual.h"));
+    }
 
+    // The generated statements of a function also depend on the options and the declarations before it
+    std::string fileKey = options.to_string();
     for (std::shared_ptr<Statement> statement: file->statements) {
         switch (statement->getType()) {
-            case Statement::FUNCTION:
-                dStatements.push_back(diff(std::dynamic_pointer_cast<Function>(statement), storage));
+            case Statement::FUNCTION: {
+                std::shared_ptr<Function> function = std::dynamic_pointer_cast<Function>(statement);
+                if (!storage->cacheDerivatives) {
+                    generateFunctions(function, storage, dStatements);
+                    break;
+                }
+                std::string text = function->to_string();
+                const std::string &name = function->declaration->name;
+                std::string key = fileKey + text + storage->dependencyKey(name, text);
+                const FunctionDiffStorage::CachedDerivatives *cached = storage->findDerivatives(name, key);
+                if (cached != nullptr) {
+                    storage->addGeneratedFunction(function, cached->dFunction);
+                    dStatements.insert(dStatements.end(), cached->statements.begin(), cached->statements.end());
+                } else {
+                    size_t first = dStatements.size();
+                    std::shared_ptr<Function> dFunction = generateFunctions(function, storage, dStatements);
+                    storage->addDerivatives(name, key, {dFunction,
+                            std::vector<std::shared_ptr<Statement>>(dStatements.begin() + (long) first, dStatements.end())});
+                }
                 break;
+            }
             case Statement::FUNCTION_DECLARATION:
+                fileKey += statement->to_string();
                 dStatements.push_back(diff(std::dynamic_pointer_cast<FunctionDeclaration>(statement)));
                 break;
             case Statement::INCLUDE:
@@ -317,12 +693,248 @@ std::shared_ptr<FileNode> Diff::diff(std::shared_ptr<FileNode> file, std::shared
     return std::make_shared<FileNode>(dContext, dName, dStatements);
 }
 
+std::shared_ptr<Function> Diff::generateFunctions(std::shared_ptr<Function> function,
+                                                std::shared_ptr<FunctionDiffStorage> storage,
+                                                std::vector<std::shared_ptr<Statement>> &dStatements) {
+    std::shared_ptr<Function> dFunction = diffInMode(function, storage, dStatements);
+    if (options.propagateConstants) {
+        ConstantPropagation::run(dFunction);
+    }
+    if (options.eliminateDeadStores) {
+        DeadStoreElimination::run(dFunction);
+    }
+    storage->addGeneratedFunction(function, dFunction);
+    if (Statistics::global().enabled) {
+        Statistics::global().addFunction(function->declaration->name,
+                                         function->countNodes(), dFunction->countNodes());
+    }
+    dStatements.push_back(dFunction);
+    if (options.valueAndJacobian) {
+        std::shared_ptr<Function> fused = diffWithValue(function, storage);
+        if (options.propagateConstants) {
+            ConstantPropagation::run(fused);
+        }
+        if (options.eliminateDeadStores) {
+            DeadStoreElimination::run(fused);
+        }
+        dStatements.push_back(fused);
+    }
+    if (options.sensitivities) {
+        try {
+            std::shared_ptr<Function> sensitivities = diffSensitivities(function, storage);
+            if (options.propagateConstants) {
+                ConstantPropagation::run(sensitivities);
+            }
+            if (options.eliminateDeadStores) {
+                DeadStoreElimination::run(sensitivities);
+            }
+            dStatements.push_back(sensitivities);
+        } catch (DiffException &exception) {
+            dStatements.push_back(std::make_shared<Comment>(
+                    "No sensitivities for '" + function->declaration->name + "': " + exception.message));
+        }
+    }
+    if (options.taylor) {
+        try {
+            std::shared_ptr<Function> taylor = TaylorMode::generate(function);
+            if (options.eliminateDeadStores) {
+                DeadStoreElimination::run(taylor);
+            }
+            dStatements.push_back(taylor);
+        } catch (DiffException &exception) {
+            dStatements.push_back(std::make_shared<Comment>(
+                    "No Taylor mode for '" + function->declaration->name + "': " + exception.message));
+        }
+    }
+    if (options.dual) {
+        try {
+            std::shared_ptr<Function> dual = DualMode::generate(function);
+            if (options.eliminateDeadStores) {
+                DeadStoreElimination::run(dual);
+            }
+            dStatements.push_back(dual);
+        } catch (DiffException &exception) {
+            dStatements.push_back(std::make_shared<Comment>(
+                    "No dual mode for '" + function->declaration->name + "': " + exception.message));
+        }
+    }
+    if (options.reverse) {
+        ReverseDiff reverseDiff(options);
+        try {
+            std::shared_ptr<Function> gradient = reverseDiff.diff(function, storage);
+            if (options.propagateConstants) {
+                ConstantPropagation::run(gradient);
+            }
+            if (options.eliminateDeadStores) {
+                DeadStoreElimination::run(gradient);
+            }
+            dStatements.push_back(gradient);
+        } catch (DiffException &exception) {
+            dStatements.push_back(std::make_shared<Comment>(
+                    "No reverse mode for '" + function->declaration->name + "': " + exception.message));
+        }
+    }
+    return dFunction;
+}
+
+std::shared_ptr<Function> Diff::diffInMode(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage,
+                                           std::vector<std::shared_ptr<Statement>> &dStatements) {
+    if (options.mode == Options::FORWARD) {
+        return diff(function, storage);
+    }
+
+    std::string name = DERIVATIVE_FUNCTION_PREFIX + function->declaration->name;
+    CostModel::Estimate estimate = CostModel::estimateFunction(function, options.checkpoints);
+    CostModel::Mode mode = options.mode == Options::REVERSE ? CostModel::REVERSE : estimate.cheapest();
+    std::string note;
+    if (options.mode == Options::CROSS_COUNTRY) {
+        CrossCountryDiff crossCountryDiff(options);
+        crossCountryDiff.withValue = withValue;
+        try {
+            std::shared_ptr<Function> dFunction = crossCountryDiff.diff(function, storage);
+            dStatements.push_back(std::make_shared<Comment>(name + ": " + crossCountryDiff.report() + "; " +
+                                                            estimate.costs()));
+            return dFunction;
+        } catch (DiffException &exception) {
+            note = ", as the cross-country mode is not supported: " + exception.message;
+            mode = CostModel::FORWARD;
+        }
+    } else if (mode == CostModel::REVERSE) {
+        // The gradient of a scalar function has the signature of its forward mode derivative
+        ReverseDiff reverseDiff(options);
+        reverseDiff.withValue = withValue;
+        try {
+            std::shared_ptr<Function> dFunction = reverseDiff.diff(function, storage);
+            dFunction->declaration->name = name;
+            if (options.mode == Options::AUTO) {
+                dStatements.push_back(std::make_shared<Comment>(name + ": " + estimate.to_string(mode)));
+            }
+            return dFunction;
+        } catch (DiffException &exception) {
+            note = ", as the reverse mode is not supported: " + exception.message;
+            mode = CostModel::FORWARD;
+        }
+    }
+
+    dStatements.push_back(std::make_shared<Comment>(name + ": " + estimate.to_string(mode) + note));
+    return diff(function, storage);
+}
+
+std::shared_ptr<Function> Diff::diffWithValue(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage) {
+    // The mode is chosen as for the d_ function, whose comments already describe it
+    std::vector<std::shared_ptr<Statement>> comments;
+    withValue = true;
+    std::shared_ptr<Function> fused;
+    try {
+        fused = diffInMode(function, storage, comments);
+    } catch (DiffException &) {
+        withValue = false;
+        throw;
+    }
+    withValue = false;
+
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    Type returnType("std::pair", std::vector<Type>{decl->returnType, fused->declaration->returnType});
+    fused->declaration = std::make_shared<FunctionDeclaration>(VALUE_AND_JACOBIAN_PREFIX + decl->name, returnType,
+                                                               decl->params);
+    return fused;
+}
+
+std::shared_ptr<Function> Diff::diffSensitivities(std::shared_ptr<Function> function,
+                                                 std::shared_ptr<FunctionDiffStorage> storage) {
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    size_t stateCount = CostModel::estimateFunction(function, options.checkpoints).outputs;
+    if (decl->params.size() < stateCount) {
+        throw DiffException("The function has fewer parameters than its " + std::to_string(stateCount) + " outputs");
+    }
+    WrtList states(decl->params.begin(), decl->params.begin() + stateCount);
+    WrtList parameters;
+    for (std::shared_ptr<Variable> &param: decl->getDifferentiatedParams()) {
+        if (std::find(states.begin(), states.end(), param) == states.end()) {
+            parameters.push_back(param);
+        }
+    }
+    if (parameters.empty()) {
+        // An autonomous system: the sensitivities to the initial states, S = dx/dx0, solve the variational equation
+        parameters = states;
+    }
+    for (std::shared_ptr<Variable> &state: states) {
+        if (!state->type.generics.empty() || (state->type.name != "double" && state->type.name != "float")) {
+            throw DiffException("The state '" + state->name + "' is not a scalar");
+        }
+    }
+
+    std::shared_ptr<DiffContext> context = std::make_shared<DiffContext>(function, storage);
+    context->argumentNames.clear();
+    context->argumentVariables = parameters;
+    for (std::shared_ptr<Variable> &parameter: parameters) {
+        context->argumentNames.push_back(parameter->symbol);
+    }
+    // The states depend on every parameter through S, which the activity analysis does not know
+    context->activity = nullptr;
+
+    // S has the type of the result, the derivatives of the outputs with respect to each parameter
+    Type sensitivityType = decl->returnType;
+    if (parameters.size() > 1) {
+        sensitivityType = Type("std::array", std::vector<Type>{decl->returnType, Type(std::to_string(parameters.size()))});
+    }
+    Symbol sensitivityName = SymbolTable::global().intern(SENSITIVITY_NAME);
+    if (context->funcContext->isVariablePresent(sensitivityName)) {
+        throw DiffException("Variable '" + SENSITIVITY_NAME + "' conflicts with the sensitivities");
+    }
+    std::shared_ptr<Variable> sensitivity = std::make_shared<Variable>(sensitivityType, sensitivityName);
+    context->funcContext->addVariable(sensitivityName, sensitivity);
+
+    // The tangents of the states are seeded with their sensitivities to the parameter of each direction
+    std::vector<std::shared_ptr<Statement>> seeds;
+    for (size_t j = 0; j < parameters.size(); ++j) {
+        for (size_t i = 0; i < states.size(); ++i) {
+            std::shared_ptr<Expression> seed = sensitivity;
+            if (parameters.size() > 1) {
+                seed = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, seed, std::make_shared<Number>(j));
+            }
+            if (!decl->returnType.generics.empty()) {
+                seed = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, seed, std::make_shared<Number>(i));
+            }
+            Symbol derName = getDerivativeSymbol(states[i], context, parameters[j]);
+            std::shared_ptr<Variable> tangent = std::make_shared<Variable>(states[i]->type, derName);
+            context->derivedVariables[derName] = tangent;
+            context->funcContext->addVariable(derName, tangent);
+            seeds.push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+                    BinaryOperator::EQUALS, std::make_shared<Variable>(states[i]->type, derName, true), seed)));
+        }
+    }
+
+    std::shared_ptr<BlockStatement> block = diff(function->block, context);
+    block->statements.insert(block->statements.begin(), seeds.begin(), seeds.end());
+    std::vector<std::shared_ptr<Variable>> params = decl->params;
+    params.push_back(std::make_shared<Variable>(sensitivityType, sensitivityName, true));
+    std::shared_ptr<FunctionDeclaration> sensitivityDecl = std::make_shared<FunctionDeclaration>(
+            SENSITIVITY_FUNCTION_PREFIX + decl->name, sensitivityType, params);
+    return std::make_shared<Function>(context->funcContext, sensitivityDecl, block);
+}
+
+std::shared_ptr<Statement> Diff::makeReturn(std::shared_ptr<Expression> value, std::shared_ptr<Expression> derivative) {
+    if (!withValue) {
+        return std::make_shared<ReturnStatement>(derivative);
+    }
+    FunctionSignature makePair("std::make_pair");
+    return std::make_shared<ReturnStatement>(std::make_shared<Call>(makePair, value, derivative));
+}
+
 std::shared_ptr<FileNode> Diff::takeDiff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage) {
-    std::shared_ptr<Diff> diff = std::make_shared<Diff>();
+    return takeDiff(std::move(file), std::move(storage), Options());
+}
+
+std::shared_ptr<FileNode> Diff::takeDiff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage,
+                                         Options options) {
+    Statistics::Timer timer(Statistics::DIFFERENTIATE);
+    std::shared_ptr<Diff> diff = std::make_shared<Diff>(options);
     return diff->diff(std::move(file), std::move(storage));
 }
 
 std::shared_ptr<Expression> Diff::simplify(std::shared_ptr<Expression> expression) {
+    Statistics::Timer timer(Statistics::SIMPLIFY);
     if (expression->getType() == Expression::UNARY_OPERATOR) {
         std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
         std::shared_ptr<Expression> expr = simplify(op->expr);
@@ -344,14 +956,16 @@ std::shared_ptr<Expression> Diff::simplify(std::shared_ptr<Expression> expressio
         bool rightOne = rightNumber != nullptr && rightNumber->isOne();
 
         if (op->op == BinaryOperator::PLUS || op->op == BinaryOperator::MINUS) {
-            if (leftZero) {
+            if (leftNumber != nullptr && rightNumber != nullptr) {
+                double value = op->op == BinaryOperator::PLUS ? leftNumber->value + rightNumber->value
+                        : leftNumber->value - rightNumber->value;
+                return std::make_shared<Number>(value, leftNumber->floating || rightNumber->floating);
+            } else if (leftZero && op->op == BinaryOperator::MINUS) {
+                return std::make_shared<UnaryOperator>(UnaryOperator::MINUS, right);
+            } else if (leftZero) {
                 return right;
             } else if (rightZero) {
                 return left;
-            } else if (leftNumber != nullptr && rightNumber != nullptr) {
-                double value = op->op == BinaryOperator::PLUS ? leftNumber->value + rightNumber->value
-                        : leftNumber->value - rightNumber->value;
-                return std::make_shared<Number>(value);
             }
         } else if (op->op == BinaryOperator::MULTIPLY) {
             if (leftZero || rightZero) {
@@ -361,7 +975,8 @@ std::shared_ptr<Expression> Diff::simplify(std::shared_ptr<Expression> expressio
             } else if (rightOne) {
                 return left;
             } else if (leftNumber != nullptr && rightNumber != nullptr) {
-                return std::make_shared<Number>(leftNumber->value * rightNumber->value);
+                return std::make_shared<Number>(leftNumber->value * rightNumber->value,
+                                                leftNumber->floating || rightNumber->floating);
             }
         } else if(op->op == BinaryOperator::DIVIDE) {
             if (rightOne) {
@@ -394,6 +1009,215 @@ std::shared_ptr<Expression> Diff::simplify(std::shared_ptr<Expression> expressio
     return expression;
 }
 
+std::shared_ptr<Expression> Diff::bind(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                                       bool always) {
+    if ((options.temporaryThreshold == 0 && !always) || expression->getType() == Expression::VARIABLE ||
+            expression->getType() == Expression::ELEMENTARY_VALUE) {
+        return expression;
+    }
+    auto found = context->boundExpressions.find(expression.get());
+    if (found != context->boundExpressions.end()) {
+        return found->second;
+    }
+    DiffContext::Rebound inner = rebind(expression, context);
+    if ((!always && inner.nodes <= options.temporaryThreshold) || !inner.pure) {
+        return inner.value;
+    }
+    return makeTemporary(expression, inner.value, context);
+}
+
+Diff::DiffContext::Rebound Diff::rebind(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context) {
+    auto found = context->rebound.find(expression.get());
+    if (found != context->rebound.end()) {
+        return found->second;
+    }
+    DiffContext::Rebound result{expression, expression, 1, true};
+    switch (expression->getType()) {
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            result.pure = op->op != UnaryOperator::PLUS_PLUS && op->op != UnaryOperator::MINUS_MINUS;
+            std::shared_ptr<Expression> operand = rebindOperand(op->expr, context, result.nodes, result.pure);
+            if (operand != op->expr) {
+                result.value = std::make_shared<UnaryOperator>(op->op, operand, op->suffix);
+            }
+            break;
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            result.pure = op->op != BinaryOperator::EQUALS && op->op != BinaryOperator::PLUS_EQUALS &&
+                    op->op != BinaryOperator::MINUS_EQUALS && op->op != BinaryOperator::MULTIPLY_EQUALS &&
+                    op->op != BinaryOperator::DIVIDE_EQUALS;
+            std::shared_ptr<Expression> left = rebindOperand(op->left, context, result.nodes, result.pure);
+            std::shared_ptr<Expression> right = rebindOperand(op->right, context, result.nodes, result.pure);
+            if (left != op->left || right != op->right) {
+                result.value = std::make_shared<BinaryOperator>(op->op, left, right);
+            }
+            break;
+        }
+        case Expression::CALL: {
+            std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+            std::vector<std::shared_ptr<Expression>> args;
+            bool changed = false;
+            for (std::shared_ptr<Expression> &arg: call->args) {
+                args.push_back(rebindOperand(arg, context, result.nodes, result.pure));
+                changed = changed || args.back() != arg;
+            }
+            if (changed) {
+                result.value = std::make_shared<Call>(call->signature, args);
+            }
+            break;
+        }
+        case Expression::VARIABLE:
+        case Expression::ELEMENTARY_VALUE:
+            break;
+        default:
+            result.nodes = expression->countNodes();
+            result.pure = false;
+            break;
+    }
+    context->rebound[expression.get()] = result;
+    return result;
+}
+
+std::shared_ptr<Expression> Diff::rebindOperand(std::shared_ptr<Expression> operand, std::shared_ptr<DiffContext> context,
+                                                size_t &nodes, bool &pure) {
+    auto found = context->boundExpressions.find(operand.get());
+    if (found != context->boundExpressions.end()) {
+        nodes += 1;
+        return found->second;
+    }
+    DiffContext::Rebound inner = rebind(operand, context);
+    pure = pure && inner.pure;
+    if (options.temporaryThreshold != 0 && inner.pure && inner.nodes > options.temporaryThreshold) {
+        nodes += 1;
+        return makeTemporary(operand, inner.value, context);
+    }
+    nodes += inner.nodes;
+    return inner.value;
+}
+
+std::shared_ptr<Variable> Diff::makeTemporary(std::shared_ptr<Expression> expression, std::shared_ptr<Expression> value,
+                                              std::shared_ptr<DiffContext> context) {
+    // Strip the braces, the temporary is a single value
+    auto braces = std::dynamic_pointer_cast<UnaryOperator>(value);
+    while (braces != nullptr && braces->op == UnaryOperator::BRACES) {
+        value = braces->expr;
+        braces = std::dynamic_pointer_cast<UnaryOperator>(value);
+    }
+
+    std::string valueString = value->to_string();
+    auto same = context->boundValues.find(valueString);
+    if (same != context->boundValues.end()) {
+        context->boundExpressions[expression.get()] = same->second;
+        return same->second;
+    }
+
+    Symbol name;
+    do {
+        name = SymbolTable::global().intern(TEMPORARY_PREFIX + std::to_string(context->temporaryCount++));
+    } while (context->funcContext->isVariablePresent(name));
+
+    Type type("auto");
+    std::shared_ptr<Variable> temporary = std::make_shared<Variable>(type, name);
+    context->funcContext->addVariable(name, temporary);
+    context->temporaries.push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+            BinaryOperator::EQUALS, std::make_shared<Variable>(type, name, true), value)));
+    context->boundExpressions[expression.get()] = temporary;
+    context->boundValues[valueString] = temporary;
+    return temporary;
+}
+
+bool Diff::hasTangent(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                      const std::shared_ptr<Variable> &wrt) {
+    std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+    std::shared_ptr<BinaryOperator> indexing = std::dynamic_pointer_cast<BinaryOperator>(expression);
+    if (indexing != nullptr && indexing->op == BinaryOperator::INDEXING) {
+        variable = std::dynamic_pointer_cast<Variable>(indexing->left);
+    } else {
+        indexing = nullptr;
+    }
+    if (context->activity == nullptr || variable == nullptr || context->arguments.count(variable->symbol)) {
+        return true;
+    }
+
+    if (indexing == nullptr) {
+        return context->activity->isIndexed(variable->symbol) || context->activity->isActive(variable->symbol, wrt->symbol);
+    }
+    std::shared_ptr<Number> index = std::dynamic_pointer_cast<Number>(indexing->right);
+    if (index == nullptr) {
+        return context->activity->isActive(variable->symbol, wrt->symbol);
+    }
+    return context->activity->isActive(variable->symbol, (int) index->value, wrt->symbol);
+}
+
+Diff::WrtList Diff::activeWrts(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                               const WrtList &wrts) {
+    WrtList result;
+    for (const std::shared_ptr<Variable> &wrt: wrts) {
+        if (hasTangent(expression, context, wrt)) {
+            result.push_back(wrt);
+        }
+    }
+    return result;
+}
+
+bool Diff::isPure(std::shared_ptr<Expression> expression) {
+    switch (expression->getType()) {
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            return op->op != UnaryOperator::PLUS_PLUS && op->op != UnaryOperator::MINUS_MINUS && isPure(op->expr);
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            bool assignment = op->op == BinaryOperator::EQUALS || op->op == BinaryOperator::PLUS_EQUALS ||
+                    op->op == BinaryOperator::MINUS_EQUALS || op->op == BinaryOperator::MULTIPLY_EQUALS ||
+                    op->op == BinaryOperator::DIVIDE_EQUALS;
+            return !assignment && isPure(op->left) && isPure(op->right);
+        }
+        case Expression::CALL:
+            for (std::shared_ptr<Expression> &arg: std::dynamic_pointer_cast<Call>(expression)->args) {
+                if (!isPure(arg)) return false;
+            }
+            return true;
+        case Expression::VARIABLE:
+        case Expression::ELEMENTARY_VALUE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::shared_ptr<Expression> Diff::replaceBound(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context) {
+    auto found = context->boundExpressions.find(expression.get());
+    if (found != context->boundExpressions.end()) {
+        return found->second;
+    }
+
+    if (expression->getType() == Expression::UNARY_OPERATOR) {
+        std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+        return std::make_shared<UnaryOperator>(op->op, replaceBound(op->expr, context), op->suffix);
+    } else if (expression->getType() == Expression::BINARY_OPERATOR) {
+        std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+        return std::make_shared<BinaryOperator>(op->op, replaceBound(op->left, context), replaceBound(op->right, context));
+    } else if (expression->getType() == Expression::CALL) {
+        std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+        std::vector<std::shared_ptr<Expression>> args;
+        for (std::shared_ptr<Expression> &arg: call->args) {
+            args.push_back(replaceBound(arg, context));
+        }
+        return std::make_shared<Call>(call->signature, args);
+    }
+    return expression;
+}
+
+void Diff::takeTemporaries(std::shared_ptr<DiffContext> context, std::vector<std::shared_ptr<Statement>> &dStatements) {
+    dStatements.insert(dStatements.end(), context->temporaries.begin(), context->temporaries.end());
+    context->temporaries.clear();
+    context->boundExpressions.clear();
+    context->boundValues.clear();
+    context->rebound.clear();
+}
+
 std::vector<std::shared_ptr<Expression>> Diff::getIndexesOfIndexedArg
         (std::shared_ptr<Expression> expression, std::string wrt) {
     std::vector<std::shared_ptr<Expression>> result;
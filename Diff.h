@@ -2,6 +2,7 @@
 #define FINAL_PROJECT_DIFF_H
 
 #include "CppParser.h"
+#include "ActivityAnalysis.h"
 #include <unordered_map>
 
 class FunctionDiffStorage;
@@ -12,29 +13,136 @@ protected:
     static const std::string DERIVATIVE_VAR_PREFIX;
     static const std::string DERIVATIVE_FILE_PREFIX;
     static const std::string DERIVATIVE_FUNCTION_PREFIX;
+    static const std::string TEMPORARY_PREFIX;
+    static const std::string VALUE_AND_JACOBIAN_PREFIX;
+    static const std::string SENSITIVITY_FUNCTION_PREFIX;
+    static const std::string SENSITIVITY_NAME;
 
 public:
+    // Derivatives of an expression with respect to each variable of a WrtList, in the same order
+    typedef std::vector<std::shared_ptr<Expression>> Tangents;
+    typedef std::vector<std::shared_ptr<Variable>> WrtList;
+
+    struct Options {
+        enum Mode {
+            // Chooses per function the cheapest mode estimated by CostModel, and writes the estimate in a comment
+            AUTO,
+            FORWARD,
+            // Computes the d_ functions of the scalar functions in reverse mode, falling back to forward mode
+            REVERSE,
+            // Accumulates the Jacobians of the straight-line functions by eliminating the vertices of their
+            // computational graph (see CrossCountryDiff.h), falling back to forward mode
+            CROSS_COUNTRY
+        };
+
+        Mode mode = AUTO;
+        // Subexpressions with more nodes than this that would be repeated in the derivatives are computed once
+        // into a temporary instead. 0 disables the temporaries.
+        size_t temporaryThreshold = 16;
+        // Also generate grad_ functions computing the gradients of the scalar functions in reverse mode
+        bool reverse = false;
+        // Also generate value_and_jac_ functions returning the pair of the value of the function and its d_
+        // derivative, computed in the mode of the d_ function from one evaluation
+        bool valueAndJacobian = false;
+        // Also generate sens_ functions computing the right-hand sides of the forward sensitivity equations of
+        // ODE systems (see diffSensitivities)
+        bool sensitivities = false;
+        // Also generate taylor_ functions computing the Taylor coefficients of the functions along a direction up
+        // to a degree K (see TaylorMode.h)
+        bool taylor = false;
+        // Also generate dual_ functions evaluating the functions on the vector dual numbers of diff_dual.h, whose
+        // tangents hold the Jacobian (see DualMode.h)
+        bool dual = false;
+        // Loop states the reverse mode keeps in memory at once, the others are recomputed (see diff_checkpointing.h)
+        int checkpoints = 16;
+        // Compute the partial derivatives of an assignment with respect to the variables it reads once, and each
+        // tangent as their combination with the tangents of those variables, when estimated cheaper (see preaccumulate)
+        bool preaccumulate = true;
+        // Replace the locals holding a known number and fold the pure calls on numbers in the generated functions
+        // (see ConstantPropagation.h)
+        bool propagateConstants = true;
+        // Remove the stores of the generated functions that do not reach their return (see DeadStoreElimination.h)
+        bool eliminateDeadStores = true;
+
+        // All the options, which the generated code depends on
+        std::string to_string() const;
+    };
+
     struct DiffContext {
-        std::unordered_map<std::string, std::shared_ptr<Variable>> derivedVariables;
-        std::unordered_map<std::string, std::shared_ptr<Variable>> arguments;
-        std::vector<std::string> argumentNames;
-        std::unordered_map<std::string, int> argumentIndexed;
+        std::unordered_map<Symbol, std::shared_ptr<Variable>> derivedVariables;
+        std::unordered_map<Symbol, std::shared_ptr<Variable>> arguments;
+        std::vector<Symbol> argumentNames;
+        WrtList argumentVariables;
+        std::unordered_map<Symbol, int> argumentIndexed;
         std::shared_ptr<Context> funcContext;
         std::shared_ptr<FunctionDiffStorage> functionDiffStorage;
+        // The tangents of the variables that do not depend on a wrt are zero, and are neither stored nor computed
+        std::shared_ptr<ActivityAnalysis> activity;
+
+        // Declarations of the temporaries bound while differentiating the current statement
+        std::vector<std::shared_ptr<Statement>> temporaries;
+        std::unordered_map<Expression *, std::shared_ptr<Variable>> boundExpressions;
+        std::unordered_map<std::string, std::shared_ptr<Variable>> boundValues;
+        // An expression visited by bind, rebuilt with the temporaries of its subexpressions, with the number of
+        // nodes left and whether it is pure. Holds the expression, so that its address is not reused.
+        struct Rebound {
+            std::shared_ptr<Expression> expression;
+            std::shared_ptr<Expression> value;
+            size_t nodes;
+            bool pure;
+        };
+        std::unordered_map<Expression *, Rebound> rebound;
+        int temporaryCount = 0;
+
+        // While preaccumulating, the wrt for which each operand of the statement has tangent 1, by the symbol of
+        // its variable, with the element for the elements. All the other variables have zero tangents.
+        struct Seed {
+            std::shared_ptr<Expression> element;
+            Symbol wrt;
+        };
+        std::unordered_map<Symbol, std::vector<Seed>> seeds;
 
         DiffContext(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage);
     };
 
+protected:
+    Options options;
+    // While generating a value_and_jac_ function, the generated functions return the value with the derivative
+    bool withValue = false;
+    // The directions of the operands while preaccumulating, named once
+    std::vector<std::shared_ptr<Variable>> seedVariables;
+
+    // derivativeSymbols[wrt][variable] is the symbol of the derivative of variable with respect to wrt,
+    // or SymbolTable::EMPTY if it was not named yet
+    std::vector<std::vector<Symbol>> derivativeSymbols;
+
+public:
+    Diff() = default;
+    explicit Diff(Options options): options(options) {}
+
     virtual std::string createDerivativeName(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt);
+    Symbol getDerivativeSymbol(std::shared_ptr<Variable> &variable, std::shared_ptr<DiffContext> &context, std::shared_ptr<Variable> &wrt);
 
-    virtual std::shared_ptr<Expression> diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
-                                             std::shared_ptr<Variable> wrt, bool leftEquality=false, bool topStatement=false);
+    // Each expression is traversed once, producing the derivatives with respect to all of wrts together
+    virtual Tangents diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts, bool leftEquality=false, bool topStatement=false);
+    virtual Tangents diff(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context,
+                          const WrtList &wrts, bool leftEquality=false, bool topStatement=false);
+    virtual Tangents diff(std::shared_ptr<ElementaryValue> value, std::shared_ptr<DiffContext> context, const WrtList &wrts);
+    virtual Tangents diff(std::shared_ptr<UnaryOperator> oper, std::shared_ptr<DiffContext> context, const WrtList &wrts);
+    virtual Tangents diff(std::shared_ptr<BinaryOperator> oper, std::shared_ptr<DiffContext> context, const WrtList &wrts, bool leftEquality=false);
+    virtual Tangents diff(std::shared_ptr<Call> call, std::shared_ptr<DiffContext> context, const WrtList &wrts);
+
+    std::shared_ptr<Expression> diff(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                                     std::shared_ptr<Variable> wrt, bool leftEquality=false, bool topStatement=false);
     virtual std::shared_ptr<Expression> diff(std::shared_ptr<Variable> variable, std::shared_ptr<DiffContext> context,
                                              std::shared_ptr<Variable> wrt, bool leftEquality=false, bool topStatement=false);
-    virtual std::shared_ptr<Expression> diff(std::shared_ptr<ElementaryValue> value, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt);
-    virtual std::shared_ptr<Expression> diff(std::shared_ptr<UnaryOperator> oper, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt);
-    virtual std::shared_ptr<Expression> diff(std::shared_ptr<BinaryOperator> oper, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt, bool leftEquality=false);
-    virtual std::shared_ptr<Expression> diff(std::shared_ptr<Call> call, std::shared_ptr<DiffContext> context, std::shared_ptr<Variable> wrt);
+
+    // Tangents of an assignment `v = e` as `d_v = p_1 * d_u_1 + ... + p_k * d_u_k`, with the partial derivatives p_i
+    // of e with respect to the variables and elements u_i it reads computed once into temporaries. Returns an empty
+    // list when the assignment is not supported or the cost model estimates differentiating e for each wrt cheaper.
+    virtual Tangents preaccumulate(std::shared_ptr<BinaryOperator> assignment, std::shared_ptr<DiffContext> context,
+                                   const WrtList &wrts);
 
     virtual std::vector<std::shared_ptr<Statement>> diff(std::shared_ptr<Statement> statement, std::shared_ptr<DiffContext> context, bool oneStatementRequired=false);
     virtual std::shared_ptr<BlockStatement> diff(std::shared_ptr<BlockStatement> block, std::shared_ptr<DiffContext> context);
@@ -42,15 +150,80 @@ public:
     virtual std::shared_ptr<FunctionDeclaration> diff(std::shared_ptr<FunctionDeclaration> decl);
     virtual std::shared_ptr<Function> diff(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage);
     virtual std::shared_ptr<FileNode> diff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage);
+    // Differentiates the function in the mode of the options, adding the comments about the choice to dStatements
+    virtual std::shared_ptr<Function> diffInMode(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage,
+                                                 std::vector<std::shared_ptr<Statement>> &dStatements);
+    // Adds the d_ function and the other functions of the options generated for the function to dStatements,
+    // returning the d_ function
+    virtual std::shared_ptr<Function> generateFunctions(std::shared_ptr<Function> function,
+                                                        std::shared_ptr<FunctionDiffStorage> storage,
+                                                        std::vector<std::shared_ptr<Statement>> &dStatements);
+    // The value_and_jac_ function, returning the value of the function together with the result of its d_ function
+    virtual std::shared_ptr<Function> diffWithValue(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage);
+    // The sens_ function of a right-hand side f(x, p) whose leading parameters are the states x, one per output, and
+    // the following differentiated parameters the parameters p. Given the sensitivities S = dx/dp as an extra
+    // parameter, in the layout of the d_ functions, it returns f_x * S + f_p with one forward sweep per parameter.
+    // Without parameters after the states, p is the initial states and it returns f_x * S, the variational system.
+    virtual std::shared_ptr<Function> diffSensitivities(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage);
 
     virtual std::shared_ptr<Expression> simplify(std::shared_ptr<Expression> expression);
 
+    // Returns a temporary holding the value of the expression if it is larger than the temporary threshold,
+    // otherwise the expression itself. Used for the parts of the original expression that the derivatives repeat.
+    // With always the expression is bound regardless of its size, for the values that are expensive to compute.
+    virtual std::shared_ptr<Expression> bind(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                                             bool always=false);
+
+protected:
+    // The expression with its subexpressions larger than the temporary threshold bound, innermost first, so that
+    // each temporary refers to the ones inside it and the generated code grows linearly with the nesting
+    DiffContext::Rebound rebind(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context);
+    // The subexpression of a rebound expression, adding its nodes left to nodes
+    std::shared_ptr<Expression> rebindOperand(std::shared_ptr<Expression> operand, std::shared_ptr<DiffContext> context,
+                                              size_t &nodes, bool &pure);
+    // The temporary holding value, the rebound expression
+    std::shared_ptr<Variable> makeTemporary(std::shared_ptr<Expression> expression, std::shared_ptr<Expression> value,
+                                            std::shared_ptr<DiffContext> context);
+
 protected:
     virtual std::vector<std::shared_ptr<Expression>> getIndexesOfIndexedArg(std::shared_ptr<Expression> expression, std::string wrt);
     void getIndexesOfIndexedArg(std::shared_ptr<Expression> expression, std::string wrt, std::vector<std::shared_ptr<Expression>> &found);
 
+    // Whether the tangent of the variable or element read or assigned by the expression with respect to wrt
+    // can be nonzero. Indexed variables always have tangents, with only their inactive elements left zero.
+    static bool hasTangent(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                           const std::shared_ptr<Variable> &wrt);
+    // The wrts the tangents of the expression are computed for
+    static WrtList activeWrts(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context,
+                              const WrtList &wrts);
+
+    // The variables and elements read by the expression, each once, the indexes excluded
+    static void findOperands(std::shared_ptr<Expression> expression, std::vector<std::shared_ptr<Expression>> &operands);
+    // The directions of the operands, each operand seeded with its own
+    WrtList seed(const std::vector<std::shared_ptr<Expression>> &operands, std::shared_ptr<DiffContext> context);
+    // The seed of the operand while preaccumulating, SymbolTable::EMPTY for the other variables and elements
+    static Symbol findSeed(std::shared_ptr<Expression> operand, std::shared_ptr<DiffContext> context);
+    // The variable of a variable or an element, nullptr for the other expressions
+    static std::shared_ptr<Variable> operandVariable(std::shared_ptr<Expression> operand);
+    // Whether the expressions of variables, numbers, operators and calls are the same
+    static bool isSame(std::shared_ptr<Expression> a, std::shared_ptr<Expression> b);
+
+    // Return statement of a generated function, of the derivative, or of the pair of value and derivative with withValue
+    std::shared_ptr<Statement> makeReturn(std::shared_ptr<Expression> value, std::shared_ptr<Expression> derivative);
+
+    // Rebuilds the expression using the temporaries bound for its subexpressions
+    static std::shared_ptr<Expression> replaceBound(std::shared_ptr<Expression> expression, std::shared_ptr<DiffContext> context);
+    // Moves the temporaries of the differentiated statement to dStatements
+    static void takeTemporaries(std::shared_ptr<DiffContext> context, std::vector<std::shared_ptr<Statement>> &dStatements);
+
 public:
+    // Whether evaluating the expression has no side effects, so that it can be computed in advance or dropped.
+    // Calls are assumed to be to pure functions.
+    static bool isPure(std::shared_ptr<Expression> expression);
+
     static std::shared_ptr<FileNode> takeDiff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage);
+    static std::shared_ptr<FileNode> takeDiff(std::shared_ptr<FileNode> file, std::shared_ptr<FunctionDiffStorage> storage,
+                                              Options options);
 };
 
 class DiffException : public std::exception
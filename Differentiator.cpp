@@ -0,0 +1,93 @@
+#include "Differentiator.h"
+#include "DefaultFunctionDiffStorage.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+// The decimal value of a numeric option, between min and max
+static unsigned long long parseCount(const std::string &option, const std::string &value, unsigned long long min,
+                                     unsigned long long max) {
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long count = value.empty() || value[0] == '-' ? 0 : std::strtoull(value.c_str(), &end, 10);
+    if (end == nullptr || *end != '\0' || errno == ERANGE || count < min || count > max) {
+        throw DiffException("Invalid value '" + value + "' for " + option + ", expected an integer from " +
+                            std::to_string(min) + " to " + std::to_string(max));
+    }
+    return count;
+}
+
+Differentiator::Differentiator(bool cacheDerivatives): defaultContext(std::make_shared<DefaultContext>()),
+                                                       context(defaultContext),
+                                                       diffStorage(std::make_shared<DefaultFunctionDiffStorage>(defaultContext)) {
+    diffStorage->cacheDerivatives = cacheDerivatives;
+}
+
+std::shared_ptr<FileNode> Differentiator::parse(std::string_view source, std::string name) {
+    std::shared_ptr<FileNode> file;
+    try {
+        file = CppParser::parseSource(name, std::string(source), context);
+    } catch (std::out_of_range &) {
+        // The parser reads past the end of truncated sources
+        throw ParsingException("Unexpected end of file '" + name + "'");
+    }
+    context = file->context;
+    return file;
+}
+
+std::shared_ptr<FileNode> Differentiator::differentiate(std::shared_ptr<FileNode> file, const Diff::Options &options) {
+    return Diff::takeDiff(std::move(file), diffStorage, options);
+}
+
+void Differentiator::emit(std::shared_ptr<FileNode> file, std::ostream &sink) {
+    Statistics::Timer timer(Statistics::EMIT);
+    sink << file->to_string();
+}
+
+std::string Differentiator::generate(std::string_view source, const Diff::Options &options, std::string name) {
+    std::ostringstream result;
+    emit(differentiate(parse(source, std::move(name)), options), result);
+    return result.str();
+}
+
+void Differentiator::forget() {
+    context = defaultContext;
+}
+
+bool Differentiator::parseOption(const std::vector<std::string> &args, size_t &i, Diff::Options &options) {
+    const std::string &option = args[i];
+    bool hasValue = i + 1 < args.size();
+    if (option == "--temporary-threshold" && hasValue) {
+        options.temporaryThreshold = parseCount(option, args[++i], 0, SIZE_MAX);
+    } else if (option == "--mode" && hasValue) {
+        const std::string &mode = args[++i];
+        if (mode == "auto") {
+            options.mode = Diff::Options::AUTO;
+        } else if (mode == "forward") {
+            options.mode = Diff::Options::FORWARD;
+        } else if (mode == "reverse") {
+            options.mode = Diff::Options::REVERSE;
+        } else if (mode == "cross-country") {
+            options.mode = Diff::Options::CROSS_COUNTRY;
+        } else {
+            throw DiffException("Unknown mode '" + mode + "', expected auto, forward, reverse or cross-country");
+        }
+    } else if (option == "--reverse") {
+        options.reverse = true;
+    } else if (option == "--value-and-jac") {
+        options.valueAndJacobian = true;
+    } else if (option == "--sensitivities") {
+        options.sensitivities = true;
+    } else if (option == "--taylor") {
+        options.taylor = true;
+    } else if (option == "--dual") {
+        options.dual = true;
+    } else if (option == "--checkpoints" && hasValue) {
+        options.checkpoints = (int) parseCount(option, args[++i], 1, INT_MAX);
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef FINAL_PROJECT_DIFFERENTIATOR_H
+#define FINAL_PROJECT_DIFFERENTIATOR_H
+
+#include "CppParser.h"
+#include "Diff.h"
+#include <ostream>
+#include <string_view>
+
+// The generator as a library, working on sources and generated code held in memory without touching files.
+// The sources parsed by one Differentiator may call the functions of those parsed before, and their derivatives,
+// like the files given together to the differentiator executable.
+class Differentiator {
+protected:
+    std::shared_ptr<Context> defaultContext;
+    // The context of the last parsed source
+    std::shared_ptr<Context> context;
+    std::shared_ptr<FunctionDiffStorage> diffStorage;
+
+public:
+    // With cacheDerivatives the functions differentiated again with the same options reuse their generated
+    // statements (see FunctionDiffStorage::cacheDerivatives)
+    explicit Differentiator(bool cacheDerivatives=false);
+
+    // Throws a ParsingException with the name and the position of the error
+    std::shared_ptr<FileNode> parse(std::string_view source, std::string name="source.h");
+    // The d_ file of a file from parse, named after it. Throws a DiffException.
+    std::shared_ptr<FileNode> differentiate(std::shared_ptr<FileNode> file, const Diff::Options &options);
+    static void emit(std::shared_ptr<FileNode> file, std::ostream &sink);
+
+    // The generated code for the source
+    std::string generate(std::string_view source, const Diff::Options &options, std::string name="source.h");
+
+    // The next sources only see the functions of the default context, the derivatives already generated stay cached
+    void forget();
+
+    // Reads the option args[i], as --mode forward, into options and moves i to its last word. Returns false for the
+    // words that are not options of the generator, and throws a DiffException for invalid values.
+    static bool parseOption(const std::vector<std::string> &args, size_t &i, Diff::Options &options);
+};
+
+#endif //FINAL_PROJECT_DIFFERENTIATOR_H
@@ -0,0 +1,39 @@
+#include "DualMode.h"
+
+const std::string DualMode::FUNCTION_PREFIX = "dual_";
+const std::string DualMode::DUAL_TYPE = "dual::Dual";
+
+std::shared_ptr<Function> DualMode::generate(std::shared_ptr<Function> function) {
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    std::vector<std::shared_ptr<Variable>> differentiated = decl->getDifferentiatedParams();
+    if (differentiated.empty()) {
+        throw DiffException("The function has no differentiated parameters");
+    }
+    Type dualType(DUAL_TYPE, {Type("double"), Type(std::to_string(differentiated.size()))});
+    DualMode mode(dualType);
+    std::shared_ptr<Context> context = std::shared_ptr<Context>(function->context->copy());
+
+    // The i-th differentiated parameter is read through the dual number with the unit tangent i
+    std::vector<std::shared_ptr<Statement>> statements;
+    FunctionSignature variable(dualType.to_string() + "::variable");
+    for (size_t i = 0; i < differentiated.size(); ++i) {
+        if (differentiated[i]->type.name != "double" && differentiated[i]->type.name != "float") {
+            throw DiffException("Only scalar parameters are supported in dual mode");
+        }
+        std::shared_ptr<Variable> dual = mode.declareParameter(context, SERIES_PREFIX + differentiated[i]->name,
+                                                               dualType);
+        mode.seeded[differentiated[i]->symbol] = dual;
+        std::shared_ptr<Call> seed = std::make_shared<Call>(variable, std::vector<std::shared_ptr<Expression>>{
+                std::make_shared<Variable>(differentiated[i]->type, differentiated[i]->symbol),
+                std::make_shared<Number>((double) i)});
+        statements.push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+                BinaryOperator::EQUALS, std::make_shared<Variable>(dualType, dual->symbol, true), seed)));
+    }
+    for (std::shared_ptr<Statement> &statement: function->block->statements) {
+        statements.push_back(mode.rewrite(statement));
+    }
+
+    std::shared_ptr<FunctionDeclaration> dualDecl = std::make_shared<FunctionDeclaration>(
+            FUNCTION_PREFIX + decl->name, mode.retype(decl->returnType), decl->params);
+    return std::make_shared<Function>(context, dualDecl, std::make_shared<BlockStatement>(statements));
+}
@@ -0,0 +1,22 @@
+#ifndef FINAL_PROJECT_DUAL_MODE_H
+#define FINAL_PROJECT_DUAL_MODE_H
+
+#include "TaylorMode.h"
+
+// Generates dual_<name>(params...) functions evaluating a function on the dual::Dual<double, N> numbers of
+// diff_dual.h, the N differentiated parameters seeded with the unit directions. The result holds the value of the
+// function and, in its tangents, the derivatives by each differentiated parameter, from one evaluation whose code
+// only grows by a constant factor with the function, where the symbolic derivatives may blow up.
+// The function is copied like in TaylorMode, with the dual numbers instead of the series.
+class DualMode: public TaylorMode {
+protected:
+    static const std::string FUNCTION_PREFIX;
+    static const std::string DUAL_TYPE;
+
+    explicit DualMode(Type valueType): TaylorMode(std::move(valueType), "dual::", "dual mode") {}
+
+public:
+    static std::shared_ptr<Function> generate(std::shared_ptr<Function> function);
+};
+
+#endif //FINAL_PROJECT_DUAL_MODE_H
@@ -0,0 +1,103 @@
+#include "FunctionDiffStorage.h"
+
+Diff::Tangents FunctionDiffStorage::GeneratedFunctionDiffCalculator::calculate
+        (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) {
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    bool scalar = decl->returnType.name == "double" || decl->returnType.name == "float";
+    for (std::shared_ptr<Variable> &param: decl->params) {
+        scalar = scalar && param->type.generics.empty() && param->type.name != "std::vector";
+    }
+    if (!scalar) {
+        throw DiffException("Cannot differentiate the call to '" + decl->name +
+                            "' as only calls to functions of scalars returning a scalar are supported");
+    }
+
+    // Differentiating in place costs about the size of the expression for every wrt, calling the derivative
+    // costs its whole body and a product for every argument and wrt
+    std::shared_ptr<Expression> inlined = inlineCall(call);
+    size_t callCost = dFunction->countNodes() + call->args.size() * wrts.size();
+    if (inlined != nullptr && inlined->countNodes() * wrts.size() <= callCost) {
+        return diff.diff(inlined, context, wrts);
+    }
+
+    // Position of each argument in the partial derivatives, -1 for the parameters excluded by the diff annotation
+    std::vector<int> positions;
+    std::vector<std::shared_ptr<Variable>> differentiated = decl->getDifferentiatedParams();
+    for (std::shared_ptr<Variable> &param: decl->params) {
+        auto position = std::find(differentiated.begin(), differentiated.end(), param);
+        positions.push_back(position == differentiated.end() ? -1 : (int) (position - differentiated.begin()));
+    }
+
+    std::vector<Diff::Tangents> dArgs;
+    for (std::shared_ptr<Expression> &arg: call->args) {
+        dArgs.push_back(diff.diff(arg, context, wrts));
+    }
+    // The derivative returns the partial derivatives with respect to all the parameters at once
+    FunctionSignature signature(dFunction->declaration->name, call->signature.paramTypes);
+    std::shared_ptr<Expression> partials = diff.bind(std::make_shared<Call>(signature, call->args), context, true);
+
+    Diff::Tangents result;
+    for (int i = 0; i < wrts.size(); ++i) {
+        std::shared_ptr<Expression> sum;
+        for (int arg = 0; arg < call->args.size(); ++arg) {
+            if (positions[arg] < 0) {
+                std::shared_ptr<Number> dArg = std::dynamic_pointer_cast<Number>(diff.simplify(dArgs[arg][i]));
+                if (dArg == nullptr || !dArg->isZero()) {
+                    throw DiffException("Cannot differentiate the call to '" + decl->name + "' with respect to '" +
+                                        decl->params[arg]->name + "', which is not in its diff annotation");
+                }
+                continue;
+            }
+            std::shared_ptr<Expression> partial = partials;
+            if (differentiated.size() > 1) {
+                partial = std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, partials,
+                                                           std::make_shared<Number>(positions[arg]));
+            }
+            std::shared_ptr<Expression> term = Expression::multiply(partial, dArgs[arg][i]);
+            sum = sum == nullptr ? term : Expression::add(sum, term);
+        }
+        result.push_back(sum == nullptr ? std::make_shared<Number>(0) : sum);
+    }
+    return result;
+}
+
+std::shared_ptr<Expression> FunctionDiffStorage::GeneratedFunctionDiffCalculator::inlineCall(std::shared_ptr<Call> call) {
+    std::vector<std::shared_ptr<Statement>> &statements = function->block->statements;
+    if (statements.size() != 1 || statements[0]->getType() != Statement::RETURN) {
+        return nullptr;
+    }
+
+    std::unordered_map<Symbol, std::shared_ptr<Expression>> values;
+    for (int i = 0; i < call->args.size(); ++i) {
+        values[function->declaration->params[i]->symbol] = call->args[i];
+    }
+    return substitute(std::dynamic_pointer_cast<ReturnStatement>(statements[0])->expr, values);
+}
+
+std::shared_ptr<Expression> FunctionDiffStorage::GeneratedFunctionDiffCalculator::substitute
+        (std::shared_ptr<Expression> expression, std::unordered_map<Symbol, std::shared_ptr<Expression>> &values) {
+    switch (expression->getType()) {
+        case Expression::VARIABLE: {
+            auto value = values.find(std::dynamic_pointer_cast<Variable>(expression)->symbol);
+            return value == values.end() ? expression : value->second;
+        }
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            return std::make_shared<UnaryOperator>(op->op, substitute(op->expr, values), op->suffix);
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            return std::make_shared<BinaryOperator>(op->op, substitute(op->left, values), substitute(op->right, values));
+        }
+        case Expression::CALL: {
+            std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+            std::vector<std::shared_ptr<Expression>> args;
+            for (std::shared_ptr<Expression> &arg: call->args) {
+                args.push_back(substitute(arg, values));
+            }
+            return std::make_shared<Call>(call->signature, args);
+        }
+        default:
+            return expression;
+    }
+}
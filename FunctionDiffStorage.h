@@ -11,26 +11,120 @@
 class FunctionDiffStorage {
 public:
     struct DiffCalculator {
-        virtual std::shared_ptr<Expression> calculate
-            (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) = 0;
+        virtual ~DiffCalculator() = default;
+
+        // Derivatives of the call with respect to each of wrts, calculated in one pass over the arguments
+        virtual Diff::Tangents calculate
+            (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, const Diff::WrtList &wrts) = 0;
+
+        std::shared_ptr<Expression> calculate
+            (std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context, std::shared_ptr<Variable> wrt) {
+            return calculate(std::move(call), diff, std::move(context), Diff::WrtList{std::move(wrt)})[0];
+        }
     };
 
+    // Differentiates the calls to a function of the differentiated files. Depending on the estimated cost the
+    // returned expression of the function is differentiated in place, or its generated derivative is called.
+    struct GeneratedFunctionDiffCalculator: DiffCalculator {
+        std::shared_ptr<Function> function;
+        std::shared_ptr<Function> dFunction;
+
+        GeneratedFunctionDiffCalculator(std::shared_ptr<Function> function, std::shared_ptr<Function> dFunction):
+                function(std::move(function)), dFunction(std::move(dFunction)) {}
+
+        Diff::Tangents calculate(std::shared_ptr<Call> call, Diff &diff, std::shared_ptr<Diff::DiffContext> context,
+                                 const Diff::WrtList &wrts) override;
+
+        // The returned expression with the arguments in place of the parameters, or nullptr if the function
+        // does more than return an expression
+        std::shared_ptr<Expression> inlineCall(std::shared_ptr<Call> call);
+        static std::shared_ptr<Expression> substitute(std::shared_ptr<Expression> expression,
+                                                      std::unordered_map<Symbol, std::shared_ptr<Expression>> &values);
+    };
+
+    // The statements generated for a function, see cacheDerivatives
+    struct CachedDerivatives {
+        std::shared_ptr<Function> dFunction;
+        std::vector<std::shared_ptr<Statement>> statements;
+    };
+
+    static const size_t MAX_CACHED_DERIVATIVES = 4096;
+
 protected:
     std::shared_ptr<Context> context;
     std::unordered_map<FunctionSignature, std::shared_ptr<DiffCalculator>> functionDiffCalculators;
+    // The signatures of the context the call signatures resolve to, which do not change
+    std::unordered_map<FunctionSignature, FunctionSignature> resolvedSignatures;
+    std::unordered_map<std::string, CachedDerivatives> cachedDerivatives;
+    // The hash of the cache key of the last generated or reused function of each name, cleared with the cache
+    std::unordered_map<std::string, size_t> derivativeKeys;
 
 public:
+    // Whether Diff reuses the statements generated for a function with the same text, options and generated
+    // functions it calls, for the processes differentiating many versions of the same sources
+    bool cacheDerivatives = false;
+
     FunctionDiffStorage(std::shared_ptr<Context> context): context(context) {}
 
-    void addDiffCalculator(FunctionSignature signature, DiffCalculator *diffCalculator) {
-        functionDiffCalculators[signature] = std::shared_ptr<DiffCalculator>(diffCalculator);
+    // The names and keys of the other generated functions the text of the function name may call, for its cache key
+    std::string dependencyKey(const std::string &name, const std::string &text) const {
+        std::string result;
+        for (auto &derivative: derivativeKeys) {
+            if (derivative.first != name && text.find(derivative.first + "(") != std::string::npos) {
+                result += "\n" + derivative.first + " " + std::to_string(derivative.second);
+            }
+        }
+        return result;
+    }
+
+    // The statements cached for the function name, whose callers then depend on key
+    const CachedDerivatives *findDerivatives(const std::string &name, const std::string &key) {
+        auto cached = cachedDerivatives.find(key);
+        if (cached == cachedDerivatives.end()) {
+            return nullptr;
+        }
+        derivativeKeys[name] = std::hash<std::string>()(key);
+        return &cached->second;
+    }
+
+    void addDerivatives(const std::string &name, const std::string &key, CachedDerivatives derivatives) {
+        if (cachedDerivatives.size() >= MAX_CACHED_DERIVATIVES) {
+            // The dependency keys go with the entries they were part of
+            cachedDerivatives.clear();
+            derivativeKeys.clear();
+        }
+        cachedDerivatives[key] = std::move(derivatives);
+        derivativeKeys[name] = std::hash<std::string>()(key);
+    }
+
+    void addDiffCalculator(FunctionSignature signature, std::shared_ptr<DiffCalculator> diffCalculator) {
+        functionDiffCalculators[signature] = std::move(diffCalculator);
+    }
+
+    // Registers the derivative generated for a function, so that the functions calling it can be differentiated
+    void addGeneratedFunction(std::shared_ptr<Function> function, std::shared_ptr<Function> dFunction) {
+        addDiffCalculator(function->declaration->getCallSignature(),
+                          std::make_shared<GeneratedFunctionDiffCalculator>(function, std::move(dFunction)));
+    }
+
+    // Returns an empty list if there is no calculator for the called function
+    virtual Diff::Tangents convert(std::shared_ptr<Call> call, Diff &diff,
+                                   std::shared_ptr<Diff::DiffContext> diffContext, const Diff::WrtList &wrts) {
+        auto resolved = resolvedSignatures.find(call->signature);
+        if (resolved == resolvedSignatures.end()) {
+            std::shared_ptr<FunctionSignature> signature = context->findFunction(call->signature);
+            resolved = resolvedSignatures.emplace(call->signature,
+                                                  signature == nullptr ? call->signature : *signature).first;
+        }
+        auto calculator = functionDiffCalculators.find(resolved->second);
+        if (calculator == functionDiffCalculators.end()) return {};
+        return calculator->second->calculate(call, diff, diffContext, wrts);
     }
 
-    virtual std::shared_ptr<Expression> convert(std::shared_ptr<Call> call, Diff &diff,
+    std::shared_ptr<Expression> convert(std::shared_ptr<Call> call, Diff &diff,
                                         std::shared_ptr<Diff::DiffContext> diffContext, std::shared_ptr<Variable> wrt) {
-        std::shared_ptr<FunctionSignature> signature = context->findFunction(call->signature);
-        if (signature == nullptr) return nullptr;
-        return functionDiffCalculators[*signature]->calculate(call, diff, diffContext, wrt);
+        Diff::Tangents result = convert(std::move(call), diff, std::move(diffContext), Diff::WrtList{std::move(wrt)});
+        return result.empty() ? nullptr : result[0];
     }
 };
 
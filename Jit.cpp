@@ -0,0 +1,147 @@
+#include "Jit.h"
+#include "Differentiator.h"
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <filesystem>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef DIFFERENTIATOR_INCLUDE_DIR
+#define DIFFERENTIATOR_INCLUDE_DIR "."
+#endif
+#ifndef GENERATOR_VERSION
+#define GENERATOR_VERSION "unknown"
+#endif
+
+const std::string Jit::SYMBOL_PREFIX = "_jit_";
+
+Jit::Module::~Module() {
+    dlclose(handle);
+}
+
+void *Jit::Module::symbol(const std::string &name) const {
+    void *result = dlsym(handle, (SYMBOL_PREFIX + name).c_str());
+    if (result == nullptr) {
+        throw DiffException("No function '" + name + "' in '" + path + "'");
+    }
+    return result;
+}
+
+Jit::Jit(std::string cacheDirectory): cacheDirectory(std::move(cacheDirectory)),
+                                      includeDirectory(DIFFERENTIATOR_INCLUDE_DIR) {}
+
+std::string Jit::defaultCacheDirectory() {
+    const char *cache = std::getenv("XDG_CACHE_HOME");
+    const char *home = std::getenv("HOME");
+    if (cache != nullptr && cache[0] == '/') {
+        return (std::filesystem::path(cache) / "differentiator-jit").string();
+    } else if (home != nullptr && home[0] == '/') {
+        return (std::filesystem::path(home) / ".cache" / "differentiator-jit").string();
+    }
+    return (std::filesystem::temp_directory_path() / ("differentiator-jit-" + std::to_string(geteuid()))).string();
+}
+
+std::string Jit::generate(const std::string &name, const std::string &source) const {
+    Differentiator differentiator;
+    std::shared_ptr<FileNode> dFile = differentiator.differentiate(differentiator.parse(source, name), options);
+
+    // The derivatives may call the functions of the source, compiled with them like a file including both
+    std::string result = source + "\n" + dFile->to_string() + "\n";
+    // The functions are exported as pointers with C names, which dlsym finds without their C++ mangling
+    result += "extern \"C\" {\n";
+    for (std::shared_ptr<Statement> &statement: dFile->statements) {
+        if (statement->getType() == Statement::FUNCTION) {
+            const std::string &function = std::dynamic_pointer_cast<Function>(statement)->declaration->name;
+            result += "decltype(&" + function + ") " + SYMBOL_PREFIX + function + " = &" + function + ";\n";
+        }
+    }
+    return result + "}\n";
+}
+
+std::shared_ptr<Jit::Module> Jit::load(const std::string &name, const std::string &source) {
+    std::string code = generate(name, source);
+    std::string command = compiler + " " + flags + " -I\"" + includeDirectory + "\"";
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", (unsigned long long) hash(
+            std::string(GENERATOR_VERSION) + "\n" + command + "\n" + runtimeHeaders() + code));
+    std::filesystem::path directory(cacheDirectory);
+    std::filesystem::path library = directory / (std::string(key) + ".so");
+
+    // Anyone able to write to the directory could have the library loaded in this process
+    std::filesystem::create_directories(directory.parent_path());
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw DiffException("Cannot create the cache directory '" + directory.string() + "'");
+    }
+    checkOwned(directory, true);
+
+    if (!std::filesystem::exists(library)) {
+        // Built under names of this process and renamed, so that concurrent loads never see a partial library
+        std::string unique = std::string(key) + "." + std::to_string(getpid());
+        std::filesystem::path sourcePath = directory / (unique + ".cpp");
+        std::filesystem::path temporary = directory / (unique + ".so");
+        {
+            std::ofstream output(sourcePath);
+            output << code;
+        }
+        int status = std::system((command + " \"" + sourcePath.string() + "\" -o \"" + temporary.string() + "\"").c_str());
+        std::filesystem::remove(sourcePath);
+        if (status != 0) {
+            std::filesystem::remove(temporary);
+            throw DiffException("Compiling the derivatives of '" + name + "' failed with status " +
+                                std::to_string(status));
+        }
+        std::filesystem::rename(temporary, library);
+    }
+    checkOwned(library, false);
+
+    void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        throw DiffException("Loading '" + library.string() + "' failed: " + dlerror());
+    }
+    return std::make_shared<Module>(handle, library.string());
+}
+
+std::string Jit::runtimeHeaders() const {
+    // In the order of their names, so that the key does not depend on the one of the directory
+    std::set<std::filesystem::path> headers;
+    std::error_code error;
+    for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(includeDirectory, error)) {
+        std::string file = entry.path().filename().string();
+        if (file.rfind("diff_", 0) == 0 && entry.path().extension() == ".h") {
+            headers.insert(entry.path());
+        }
+    }
+    std::string result;
+    for (const std::filesystem::path &header: headers) {
+        std::ifstream input(header);
+        std::ostringstream content;
+        content << input.rdbuf();
+        result += header.filename().string() + "\n" + content.str() + "\n";
+    }
+    return result;
+}
+
+void Jit::checkOwned(const std::filesystem::path &path, bool directory) {
+    struct stat status{};
+    if (lstat(path.c_str(), &status) != 0) {
+        throw DiffException("Cannot access '" + path.string() + "'");
+    }
+    bool type = directory ? S_ISDIR(status.st_mode) : S_ISREG(status.st_mode);
+    // The directory must be private, the library only unwritable by the others as the compiler sets its mode
+    mode_t forbidden = directory ? (S_IRWXG | S_IRWXO) : (S_IWGRP | S_IWOTH);
+    if (!type || status.st_uid != geteuid() || (status.st_mode & forbidden) != 0) {
+        throw DiffException("'" + path.string() + "' is not " + (directory ? "a directory private to" :
+                            "a file writable only by") + " the current user");
+    }
+}
+
+uint64_t Jit::hash(const std::string &value) {
+    uint64_t result = 14695981039346656037ull;
+    for (unsigned char c: value) {
+        result = (result ^ c) * 1099511628211ull;
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef FINAL_PROJECT_JIT_H
+#define FINAL_PROJECT_JIT_H
+
+#include "Diff.h"
+#include <filesystem>
+
+// Differentiates a model given as source in memory and loads its generated functions in the running process.
+// The source and its derivatives are compiled by the system compiler into a shared object named by the hash of
+// the code, the command, the runtime headers and the generator version, in the cache directory, so a model compiled
+// before is only loaded again. The cache directory is private to the user, created with mode 0700, and the
+// directory and the library are checked to belong to the user before anything is loaded from them.
+class Jit {
+public:
+    static const std::string SYMBOL_PREFIX;
+
+    // A loaded shared object, unloaded with the last reference to it
+    class Module {
+    protected:
+        void *handle;
+
+    public:
+        const std::string path;
+
+        Module(void *handle, std::string path): handle(handle), path(std::move(path)) {}
+        Module(const Module &o) = delete;
+        ~Module();
+
+        // The generated function, as F *function<F>("d_f") with F its type, which the caller must match.
+        // Throws a DiffException when the module has no such function.
+        template<typename F>
+        F *function(const std::string &name) const {
+            return *static_cast<F **>(symbol(name));
+        }
+
+        void *symbol(const std::string &name) const;
+    };
+
+    std::string cacheDirectory;
+    std::string compiler = "c++";
+    std::string flags = "-O3 -shared -fPIC -std=c++17";
+    // Holds the runtime headers the generated code includes
+    std::string includeDirectory;
+    Diff::Options options;
+
+    explicit Jit(std::string cacheDirectory=defaultCacheDirectory());
+
+    // Throws a ParsingException for invalid sources and a DiffException when the compiler fails
+    std::shared_ptr<Module> load(const std::string &name, const std::string &source);
+
+    // The generated code for the source, with the table of the functions the module exports
+    std::string generate(const std::string &name, const std::string &source) const;
+
+    // $XDG_CACHE_HOME/differentiator-jit, or ~/.cache/differentiator-jit
+    static std::string defaultCacheDirectory();
+
+protected:
+    // The names and contents of the diff_*.h headers of includeDirectory, which the generated code may include
+    std::string runtimeHeaders() const;
+    // Throws a DiffException unless path, a directory or else a regular file, belongs to the effective user and no
+    // one else can write to it. The others cannot read the directory either.
+    static void checkOwned(const std::filesystem::path &path, bool directory);
+    // FNV-1a, stable across runs and compilers unlike std::hash
+    static uint64_t hash(const std::string &value);
+};
+
+#endif //FINAL_PROJECT_JIT_H
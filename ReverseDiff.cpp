@@ -0,0 +1,509 @@
+#include "ReverseDiff.h"
+#include "FunctionDiffStorage.h"
+
+const std::string ReverseDiff::GRADIENT_FUNCTION_PREFIX = "grad_";
+const std::string ReverseDiff::ADJOINT_PREFIX = "b_";
+const std::string ReverseDiff::SAVED_PREFIX = "_s";
+const std::string ReverseDiff::CONDITION_PREFIX = "_c";
+const std::string ReverseDiff::ADJOINT_TEMPORARY_PREFIX = "_a";
+const std::string ReverseDiff::LOOP_TYPE_PREFIX = "_Loop";
+const std::string ReverseDiff::LOOP_START_PREFIX = "_loop";
+const std::string ReverseDiff::LOOP_STEPS_PREFIX = "_steps";
+const std::string ReverseDiff::LOOP_STATE = "_state";
+
+std::shared_ptr<FunctionDeclaration> ReverseDiff::diff(std::shared_ptr<FunctionDeclaration> decl) {
+    std::string name = GRADIENT_FUNCTION_PREFIX + decl->name;
+    Type returnType = decl->returnType;
+    size_t nArgs = decl->getDifferentiatedParams().size();
+    if (nArgs > 1) {
+        returnType = Type("std::array", std::vector<Type>{decl->returnType, Type(std::to_string(nArgs))});
+    }
+    return std::make_shared<FunctionDeclaration>(name, returnType, decl->params);
+}
+
+std::shared_ptr<Function> ReverseDiff::diff(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage) {
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    if (!isActive(decl->returnType)) {
+        throw DiffException("Only functions returning double or float are supported in reverse mode");
+    }
+    Statements &statements = function->block->statements;
+    if (statements.empty() || statements.back()->getType() != Statement::RETURN) {
+        throw DiffException("The function has to end with its only return statement in reverse mode");
+    }
+
+    context = std::make_shared<DiffContext>(function, storage);
+    Scope scope;
+    for (std::shared_ptr<Variable> &param: decl->params) {
+        if (!isScalar(param->type)) {
+            throw DiffException("Only scalar parameters are supported in reverse mode");
+        }
+        scope.locals[param->symbol] = param;
+        if (isActive(param->type)) {
+            std::shared_ptr<Variable> paramAdjoint = adjoint(param);
+            scope.declarations.push_back(assign(std::make_shared<Variable>(param->type, paramAdjoint->symbol, true),
+                                                std::make_shared<Number>(0)));
+        }
+    }
+
+    Statements forward, reverse;
+    for (size_t i = 0; i + 1 < statements.size(); ++i) {
+        sweep(statements[i], scope, forward, reverse);
+    }
+    std::shared_ptr<Expression> returned = std::dynamic_pointer_cast<ReturnStatement>(statements.back())->expr;
+    std::shared_ptr<Expression> value;
+    if (withValue) {
+        // Saved before the reverse sweep restores the overwritten values
+        value = declare(SAVED_PREFIX, decl->returnType, scope);
+        forward.push_back(assign(value, returned));
+    }
+    // The adjoint of the returned value is one
+    Statements seed;
+    accumulate(returned, std::make_shared<Number>(1), seed);
+    reverse.insert(reverse.begin(), seed.begin(), seed.end());
+
+    Statements body = scope.declarations;
+    body.insert(body.end(), forward.begin(), forward.end());
+    body.insert(body.end(), reverse.begin(), reverse.end());
+
+    Tangents gradient;
+    for (std::shared_ptr<Variable> &param: decl->getDifferentiatedParams()) {
+        if (isActive(param->type)) {
+            gradient.push_back(adjoint(param));
+        } else {
+            gradient.push_back(std::make_shared<Number>(0));
+        }
+    }
+
+    std::shared_ptr<FunctionDeclaration> gradDecl = diff(decl);
+    if (gradient.size() == 1) {
+        body.push_back(makeReturn(value, gradient[0]));
+    } else {
+        Symbol returnName = SymbolTable::global().intern(DERIVATIVE_VAR_PREFIX + "return");
+        std::shared_ptr<Variable> returnVariable = std::make_shared<Variable>(gradDecl->returnType, returnName);
+        body.push_back(std::make_shared<ExpressionStatement>(
+                std::make_shared<Variable>(gradDecl->returnType, returnName, true)));
+        for (int i = 0; i < gradient.size(); ++i) {
+            body.push_back(assign(std::make_shared<BinaryOperator>(BinaryOperator::INDEXING, returnVariable,
+                                                                   std::make_shared<Number>(i)), gradient[i]));
+        }
+        body.push_back(makeReturn(value, returnVariable));
+    }
+
+    return std::make_shared<Function>(context->funcContext, gradDecl, std::make_shared<BlockStatement>(body));
+}
+
+void ReverseDiff::sweep(std::shared_ptr<Statement> statement, Scope &scope, Statements &forward, Statements &reverse) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+            if (expr->getType() == Expression::VARIABLE_DECLARATION) {
+                declareLocal(std::dynamic_pointer_cast<Variable>(expr), scope);
+                return;
+            } else if (expr->getType() == Expression::UNARY_OPERATOR) {
+                std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expr);
+                std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(op->expr);
+                if (variable != nullptr && (op->op == UnaryOperator::PLUS_PLUS || op->op == UnaryOperator::MINUS_MINUS)) {
+                    BinaryOperator::Operation step = op->op == UnaryOperator::PLUS_PLUS ? BinaryOperator::PLUS
+                            : BinaryOperator::MINUS;
+                    sweepAssignment(variable, std::make_shared<BinaryOperator>(step, variable, std::make_shared<Number>(1)),
+                                    scope, forward, reverse);
+                    return;
+                }
+            } else if (expr->getType() == Expression::BINARY_OPERATOR) {
+                std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expr);
+                std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(op->left);
+                std::shared_ptr<Expression> value = op->right;
+                // The value before the first declaration in the scope is never used, so it is not saved
+                bool declaration = variable != nullptr && variable->declaration &&
+                        !scope.locals.count(variable->symbol);
+                if (variable != nullptr && variable->declaration) {
+                    variable = declareLocal(variable, scope);
+                }
+                switch (op->op) {
+                    case BinaryOperator::PLUS_EQUALS:
+                        value = Expression::add(variable, value);
+                        break;
+                    case BinaryOperator::MINUS_EQUALS:
+                        value = Expression::subtract(variable, value);
+                        break;
+                    case BinaryOperator::MULTIPLY_EQUALS:
+                        value = Expression::multiply(variable, value);
+                        break;
+                    case BinaryOperator::DIVIDE_EQUALS:
+                        value = Expression::divide(variable, value);
+                        break;
+                    case BinaryOperator::EQUALS:
+                        break;
+                    default:
+                        variable = nullptr;
+                }
+                if (variable != nullptr) {
+                    sweepAssignment(variable, value, scope, forward, reverse, declaration);
+                    return;
+                }
+            }
+            if (!isPure(expr)) {
+                throw DiffException("Only assignments to scalar variables are supported in reverse mode: '" +
+                                    statement->to_string() + "'");
+            }
+            forward.push_back(statement);
+            return;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &blockStatement: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                sweep(blockStatement, scope, forward, reverse);
+            }
+            return;
+        case Statement::IF: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            if (!isPure(conditional->condition)) {
+                throw DiffException("Conditions with side effects are not supported in reverse mode");
+            }
+            // The branch taken is remembered for the reverse sweep
+            std::shared_ptr<Variable> condition = declare(CONDITION_PREFIX, Type("bool"), scope,
+                                                          std::make_shared<Number>(0));
+            forward.push_back(assign(condition, conditional->condition));
+
+            Statements thenForward, thenReverse, elseForward, elseReverse;
+            sweep(conditional->statement, scope, thenForward, thenReverse);
+            std::shared_ptr<Statement> forwardElse, reverseElse;
+            if (conditional->elseStatement != nullptr) {
+                sweep(conditional->elseStatement, scope, elseForward, elseReverse);
+                forwardElse = std::make_shared<BlockStatement>(elseForward);
+                reverseElse = std::make_shared<BlockStatement>(elseReverse);
+            }
+            forward.push_back(std::make_shared<ConditionalStatement>(
+                    false, condition, std::make_shared<BlockStatement>(thenForward), forwardElse));
+            reverse.insert(reverse.begin(), std::make_shared<ConditionalStatement>(
+                    false, condition, std::make_shared<BlockStatement>(thenReverse), reverseElse));
+            return;
+        }
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> loop = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            Statements body;
+            if (loop->statement->getType() == Statement::BLOCK) {
+                body = std::dynamic_pointer_cast<BlockStatement>(loop->statement)->statements;
+            } else {
+                body.push_back(loop->statement);
+            }
+            sweepLoop(loop->condition, body, scope, forward, reverse);
+            return;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            if (loop->condition == nullptr) {
+                throw DiffException("Loops without a condition are not supported in reverse mode");
+            }
+            // The loop variables are declared before the loop, so that they can be a part of its state
+            sweep(loop->definition, scope, forward, reverse);
+            Statements body;
+            if (loop->statement->getType() == Statement::BLOCK) {
+                body = std::dynamic_pointer_cast<BlockStatement>(loop->statement)->statements;
+            } else {
+                body.push_back(loop->statement);
+            }
+            if (loop->expr != nullptr) {
+                body.push_back(std::make_shared<ExpressionStatement>(loop->expr));
+            }
+            sweepLoop(loop->condition, body, scope, forward, reverse);
+            return;
+        }
+        case Statement::COMMENT:
+            forward.push_back(statement);
+            return;
+        default:
+            throw DiffException("Statement is not supported in reverse mode: '" + statement->to_string() + "'");
+    }
+}
+
+void ReverseDiff::sweepAssignment(std::shared_ptr<Variable> variable, std::shared_ptr<Expression> value, Scope &scope,
+                                  Statements &forward, Statements &reverse, bool declaration) {
+    if (!isScalar(variable->type)) {
+        throw DiffException("Only scalar variables are supported in reverse mode: '" + variable->name + "'");
+    }
+    if (!isPure(value)) {
+        throw DiffException("Assigned values with side effects are not supported in reverse mode");
+    }
+
+    // The overwritten value is saved, so that it can be restored before the adjoint of the assignment
+    Statements adjointStatements;
+    if (!declaration) {
+        std::shared_ptr<Variable> saved = declare(SAVED_PREFIX, variable->type, scope);
+        forward.push_back(assign(saved, variable));
+        adjointStatements.push_back(assign(variable, saved));
+    }
+    forward.push_back(assign(variable, value));
+
+    if (isActive(variable->type)) {
+        Statements block;
+        Symbol adjointValue = unique(ADJOINT_TEMPORARY_PREFIX);
+        accumulate(value, std::make_shared<Variable>(variable->type, adjointValue), block);
+        if (block.empty()) {
+            adjointStatements.push_back(assign(adjoint(variable), std::make_shared<Number>(0)));
+        } else {
+            block.insert(block.begin(), assign(adjoint(variable), std::make_shared<Number>(0)));
+            block.insert(block.begin(), assign(std::make_shared<Variable>(variable->type, adjointValue, true),
+                                               adjoint(variable)));
+            adjointStatements.push_back(std::make_shared<BlockStatement>(block));
+        }
+    }
+    reverse.insert(reverse.begin(), adjointStatements.begin(), adjointStatements.end());
+}
+
+void ReverseDiff::sweepLoop(std::shared_ptr<Expression> condition, Statements body, Scope &scope,
+                            Statements &forward, Statements &reverse) {
+    if (!isPure(condition)) {
+        throw DiffException("Conditions with side effects are not supported in reverse mode");
+    }
+
+    // The state of an iteration are the variables assigned in the loop that outlive it
+    WrtList assigned, state;
+    std::unordered_set<Symbol> declared;
+    for (std::shared_ptr<Statement> &statement: body) {
+        findAssigned(statement, assigned, declared);
+    }
+    std::vector<std::shared_ptr<Variable>> fields;
+    for (std::shared_ptr<Variable> &variable: assigned) {
+        if (!declared.count(variable->symbol)) {
+            state.push_back(variable);
+            fields.push_back(std::make_shared<Variable>(variable->type, variable->symbol, true));
+        }
+    }
+
+    Type stateType(SymbolTable::global().name(unique(LOOP_TYPE_PREFIX)));
+    scope.declarations.push_back(std::make_shared<StructDeclaration>(stateType.name, fields));
+    std::shared_ptr<Variable> start = declare(LOOP_START_PREFIX, stateType, scope);
+    std::shared_ptr<Variable> steps = declare(LOOP_STEPS_PREFIX, Type("int"), scope, std::make_shared<Number>(0));
+
+    // The forward sweep only remembers the state before the loop and counts the iterations
+    for (std::shared_ptr<Variable> &variable: state) {
+        forward.push_back(assign(member(start, variable), variable));
+    }
+    forward.push_back(assign(steps, std::make_shared<Number>(0)));
+    Statements counted = body;
+    counted.push_back(assign(steps, std::make_shared<Number>(1), BinaryOperator::PLUS_EQUALS));
+    forward.push_back(std::make_shared<ConditionalStatement>(true, condition, std::make_shared<BlockStatement>(counted)));
+
+    // Both lambdas work on the state of an iteration instead of the variables
+    std::shared_ptr<Variable> stateVariable = std::make_shared<Variable>(stateType, LOOP_STATE);
+    Statements references;
+    for (std::shared_ptr<Variable> &variable: state) {
+        Type reference(variable->type.name + "&");
+        references.push_back(assign(std::make_shared<Variable>(reference, variable->symbol, true),
+                                    member(stateVariable, variable)));
+    }
+
+    Statements advance = references;
+    advance.insert(advance.end(), body.begin(), body.end());
+
+    Scope iterationScope;
+    Statements iterationForward, iterationReverse;
+    for (std::shared_ptr<Statement> &statement: body) {
+        sweep(statement, iterationScope, iterationForward, iterationReverse);
+    }
+    Statements iterationAdjoint = references;
+    iterationAdjoint.insert(iterationAdjoint.end(), iterationScope.declarations.begin(), iterationScope.declarations.end());
+    iterationAdjoint.insert(iterationAdjoint.end(), iterationForward.begin(), iterationForward.end());
+    iterationAdjoint.insert(iterationAdjoint.end(), iterationReverse.begin(), iterationReverse.end());
+
+    std::vector<std::shared_ptr<Variable>> advanceParams{
+        std::make_shared<Variable>(Type(stateType.name + "&"), LOOP_STATE, true)};
+    std::vector<std::shared_ptr<Variable>> adjointParams{std::make_shared<Variable>(stateType, LOOP_STATE, true)};
+    FunctionSignature reverseLoop("reverseLoop");
+    std::vector<std::shared_ptr<Expression>> args{
+        start, steps, std::make_shared<Number>(options.checkpoints),
+        std::make_shared<Lambda>(advanceParams, std::make_shared<BlockStatement>(advance)),
+        std::make_shared<Lambda>(adjointParams, std::make_shared<BlockStatement>(iterationAdjoint))};
+
+    // The earlier adjoints see the variables as they were before the loop
+    Statements loopReverse{std::make_shared<ExpressionStatement>(std::make_shared<Call>(reverseLoop, args))};
+    for (std::shared_ptr<Variable> &variable: state) {
+        loopReverse.push_back(assign(variable, member(start, variable)));
+    }
+    reverse.insert(reverse.begin(), loopReverse.begin(), loopReverse.end());
+}
+
+void ReverseDiff::accumulate(std::shared_ptr<Expression> value, std::shared_ptr<Expression> adjointValue,
+                             Statements &statements) {
+    WrtList variables, active;
+    findVariables(value, variables);
+    for (std::shared_ptr<Variable> &variable: variables) {
+        // Every variable is independent for the partial derivatives
+        if (!context->arguments.count(variable->symbol)) {
+            context->arguments[variable->symbol] = variable;
+        }
+        if (isActive(variable->type)) {
+            active.push_back(variable);
+        }
+    }
+    if (active.empty()) {
+        return;
+    }
+
+    Tangents partials = diff(value, context, active);
+    takeTemporaries(context, statements);
+    for (int i = 0; i < active.size(); ++i) {
+        std::shared_ptr<Expression> increment = simplify(Expression::multiply(partials[i], adjointValue));
+        std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(increment);
+        if (number != nullptr && number->isZero()) {
+            continue;
+        }
+        statements.push_back(assign(adjoint(active[i]), increment, BinaryOperator::PLUS_EQUALS));
+    }
+}
+
+Symbol ReverseDiff::unique(const std::string &prefix) {
+    Symbol name;
+    do {
+        name = SymbolTable::global().intern(prefix + std::to_string(generatedCount++));
+    } while (context->funcContext->isVariablePresent(name));
+    context->funcContext->addVariable(name, std::make_shared<Variable>(Type("auto"), name));
+    return name;
+}
+
+std::shared_ptr<Variable> ReverseDiff::declareLocal(std::shared_ptr<Variable> variable, Scope &scope) {
+    auto found = scope.locals.find(variable->symbol);
+    if (found != scope.locals.end()) {
+        if (found->second->type.name != variable->type.name) {
+            throw DiffException("Variable '" + variable->name + "' is declared with different types, "
+                                "which is not supported in reverse mode");
+        }
+        return found->second;
+    }
+    if (!isScalar(variable->type) || variable->constructorCall != nullptr) {
+        throw DiffException("Only scalar variables are supported in reverse mode: '" + variable->name + "'");
+    }
+
+    // Locals are declared at the start, as the reverse sweep uses them outside of their blocks
+    std::shared_ptr<Variable> local = std::make_shared<Variable>(variable->type, variable->symbol);
+    scope.locals[local->symbol] = local;
+    scope.declarations.push_back(assign(std::make_shared<Variable>(local->type, local->symbol, true),
+                                        std::make_shared<Number>(0)));
+    if (isActive(local->type)) {
+        scope.declarations.push_back(assign(std::make_shared<Variable>(local->type, adjoint(local)->symbol, true),
+                                            std::make_shared<Number>(0)));
+    }
+    return local;
+}
+
+std::shared_ptr<Variable> ReverseDiff::declare(const std::string &prefix, Type type, Scope &scope,
+                                               std::shared_ptr<Expression> value) {
+    Symbol name = unique(prefix);
+    std::shared_ptr<Expression> declaration = std::make_shared<Variable>(type, name, true);
+    if (value != nullptr) {
+        declaration = std::make_shared<BinaryOperator>(BinaryOperator::EQUALS, declaration, value);
+    }
+    scope.declarations.push_back(std::make_shared<ExpressionStatement>(declaration));
+    return std::make_shared<Variable>(type, name);
+}
+
+std::shared_ptr<Variable> ReverseDiff::adjoint(std::shared_ptr<Variable> variable) {
+    Symbol name = SymbolTable::global().intern(ADJOINT_PREFIX + variable->name);
+    if (context->funcContext->isVariablePresent(name)) {
+        throw DiffException("Variable '" + SymbolTable::global().name(name) + "' conflicts with an adjoint");
+    }
+    return std::make_shared<Variable>(variable->type, name);
+}
+
+bool ReverseDiff::isActive(const Type &type) {
+    return type.name == "double" || type.name == "float";
+}
+
+bool ReverseDiff::isScalar(const Type &type) {
+    return type.generics.empty() && (type.name == "double" || type.name == "float" || type.name == "int");
+}
+
+void ReverseDiff::findVariables(std::shared_ptr<Expression> expression, WrtList &found) {
+    switch (expression->getType()) {
+        case Expression::VARIABLE: {
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+            for (std::shared_ptr<Variable> &other: found) {
+                if (other->symbol == variable->symbol) return;
+            }
+            found.push_back(variable);
+            return;
+        }
+        case Expression::UNARY_OPERATOR:
+            findVariables(std::dynamic_pointer_cast<UnaryOperator>(expression)->expr, found);
+            return;
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            if (op->op == BinaryOperator::INDEXING || op->op == BinaryOperator::POINT) {
+                throw DiffException("Only scalar variables are supported in reverse mode: '" + op->to_string() + "'");
+            }
+            findVariables(op->left, found);
+            findVariables(op->right, found);
+            return;
+        }
+        case Expression::CALL:
+            for (std::shared_ptr<Expression> &arg: std::dynamic_pointer_cast<Call>(expression)->args) {
+                findVariables(arg, found);
+            }
+            return;
+        default:
+            return;
+    }
+}
+
+void ReverseDiff::findAssigned(std::shared_ptr<Statement> statement, WrtList &assigned,
+                               std::unordered_set<Symbol> &declared) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION: {
+            std::shared_ptr<Expression> expr = std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr;
+            std::shared_ptr<Variable> variable;
+            if (expr->getType() == Expression::UNARY_OPERATOR) {
+                variable = std::dynamic_pointer_cast<Variable>(std::dynamic_pointer_cast<UnaryOperator>(expr)->expr);
+            } else if (expr->getType() == Expression::BINARY_OPERATOR) {
+                variable = std::dynamic_pointer_cast<Variable>(std::dynamic_pointer_cast<BinaryOperator>(expr)->left);
+            } else {
+                variable = std::dynamic_pointer_cast<Variable>(expr);
+            }
+            if (variable == nullptr) {
+                return;
+            } else if (variable->declaration) {
+                declared.insert(variable->symbol);
+                return;
+            }
+            for (std::shared_ptr<Variable> &other: assigned) {
+                if (other->symbol == variable->symbol) return;
+            }
+            assigned.push_back(variable);
+            return;
+        }
+        case Statement::BLOCK:
+            for (std::shared_ptr<Statement> &blockStatement: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                findAssigned(blockStatement, assigned, declared);
+            }
+            return;
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            findAssigned(conditional->statement, assigned, declared);
+            if (conditional->elseStatement != nullptr) {
+                findAssigned(conditional->elseStatement, assigned, declared);
+            }
+            return;
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            findAssigned(loop->definition, assigned, declared);
+            findAssigned(loop->statement, assigned, declared);
+            if (loop->expr != nullptr) {
+                findAssigned(std::make_shared<ExpressionStatement>(loop->expr), assigned, declared);
+            }
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+std::shared_ptr<Expression> ReverseDiff::member(std::shared_ptr<Variable> object, std::shared_ptr<Variable> field) {
+    return std::make_shared<BinaryOperator>(BinaryOperator::POINT, object,
+                                            std::make_shared<Variable>(field->type, field->symbol));
+}
+
+std::shared_ptr<Statement> ReverseDiff::assign(std::shared_ptr<Expression> left, std::shared_ptr<Expression> right,
+                                               BinaryOperator::Operation op) {
+    return std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(op, std::move(left), std::move(right)));
+}
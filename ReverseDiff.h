@@ -0,0 +1,72 @@
+#ifndef FINAL_PROJECT_REVERSE_DIFF_H
+#define FINAL_PROJECT_REVERSE_DIFF_H
+
+#include "Diff.h"
+#include <unordered_set>
+
+// Generates grad_<name> functions computing the gradient of functions returning a scalar in reverse mode.
+// The function is run forward, saving every overwritten value, then the statements are undone in reverse order
+// while the adjoints (b_<name>) are accumulated. Loops are reversed by diff_checkpointing.h, which recomputes the
+// iteration states from a bounded number of checkpoints instead of storing all of them.
+// Only scalar variables are supported, other functions throw a DiffException.
+class ReverseDiff: public Diff {
+protected:
+    static const std::string GRADIENT_FUNCTION_PREFIX;
+    static const std::string ADJOINT_PREFIX;
+    static const std::string SAVED_PREFIX;
+    static const std::string CONDITION_PREFIX;
+    static const std::string ADJOINT_TEMPORARY_PREFIX;
+    static const std::string LOOP_TYPE_PREFIX;
+    static const std::string LOOP_START_PREFIX;
+    static const std::string LOOP_STEPS_PREFIX;
+    static const std::string LOOP_STATE;
+
+    typedef std::vector<std::shared_ptr<Statement>> Statements;
+
+    // Declarations of a generated function body or loop adjoint, visible to both its forward and reverse parts
+    struct Scope {
+        Statements declarations;
+        std::unordered_map<Symbol, std::shared_ptr<Variable>> locals;
+    };
+
+    std::shared_ptr<DiffContext> context;
+    int generatedCount = 0;
+
+public:
+    using Diff::diff;
+
+    ReverseDiff() = default;
+    explicit ReverseDiff(Options options): Diff(options) {}
+
+    std::shared_ptr<FunctionDeclaration> diff(std::shared_ptr<FunctionDeclaration> decl) override;
+    std::shared_ptr<Function> diff(std::shared_ptr<Function> function, std::shared_ptr<FunctionDiffStorage> storage) override;
+
+protected:
+    // Appends the forward code of the statement to forward and prepends its adjoint to reverse
+    virtual void sweep(std::shared_ptr<Statement> statement, Scope &scope, Statements &forward, Statements &reverse);
+    virtual void sweepAssignment(std::shared_ptr<Variable> variable, std::shared_ptr<Expression> value, Scope &scope,
+                                 Statements &forward, Statements &reverse, bool declaration=false);
+    virtual void sweepLoop(std::shared_ptr<Expression> condition, Statements body, Scope &scope,
+                           Statements &forward, Statements &reverse);
+    // Adds adjoint times the partial derivative of value to the adjoints of the variables in value
+    virtual void accumulate(std::shared_ptr<Expression> value, std::shared_ptr<Expression> adjoint, Statements &statements);
+
+    // A new name starting with prefix that is not used in the function yet
+    Symbol unique(const std::string &prefix);
+    std::shared_ptr<Variable> declareLocal(std::shared_ptr<Variable> variable, Scope &scope);
+    std::shared_ptr<Variable> declare(const std::string &prefix, Type type, Scope &scope,
+                                      std::shared_ptr<Expression> value=nullptr);
+    std::shared_ptr<Variable> adjoint(std::shared_ptr<Variable> variable);
+
+    // Only floating point variables have adjoints
+    static bool isActive(const Type &type);
+    static bool isScalar(const Type &type);
+    static void findVariables(std::shared_ptr<Expression> expression, WrtList &found);
+    // Variables assigned in the statement, and the ones declared in it
+    static void findAssigned(std::shared_ptr<Statement> statement, WrtList &assigned, std::unordered_set<Symbol> &declared);
+    static std::shared_ptr<Expression> member(std::shared_ptr<Variable> object, std::shared_ptr<Variable> field);
+    static std::shared_ptr<Statement> assign(std::shared_ptr<Expression> left, std::shared_ptr<Expression> right,
+                                             BinaryOperator::Operation op=BinaryOperator::EQUALS);
+};
+
+#endif //FINAL_PROJECT_REVERSE_DIFF_H
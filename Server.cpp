@@ -0,0 +1,194 @@
+#include "Server.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+const size_t Server::MAX_SOURCE_SIZE = 64 << 20;
+const size_t Server::MAX_CONNECTIONS = 64;
+const size_t Server::MAX_SYMBOLS = 1 << 20;
+
+namespace {
+    // Buffers the reads of a descriptor, which may return the header and the source in any pieces
+    class Reader {
+    protected:
+        int fd;
+        char buffer[1 << 16];
+        size_t begin = 0, end = 0;
+
+        bool fill() {
+            ssize_t count;
+            do {
+                count = read(fd, buffer, sizeof(buffer));
+            } while (count < 0 && errno == EINTR);
+            begin = 0;
+            end = count > 0 ? (size_t) count : 0;
+            return count > 0;
+        }
+
+    public:
+        explicit Reader(int fd): fd(fd) {}
+
+        bool readLine(std::string &line) {
+            line.clear();
+            while (true) {
+                if (begin == end && !fill()) return false;
+                char c = buffer[begin++];
+                if (c == '\n') return true;
+                line += c;
+            }
+        }
+
+        // Whether bytes were read past the last request, which would be lost if the reading stopped
+        bool buffered() const {
+            return begin != end;
+        }
+
+        bool readBytes(size_t count, std::string &result) {
+            result.clear();
+            result.reserve(count);
+            while (result.size() < count) {
+                if (begin == end && !fill()) return false;
+                size_t chunk = std::min(end - begin, count - result.size());
+                result.append(buffer + begin, chunk);
+                begin += chunk;
+            }
+            return true;
+        }
+    };
+
+    bool writeAll(int fd, const std::string &data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t count = write(fd, data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            written += (size_t) count;
+        }
+        return true;
+    }
+}
+
+Server::Server(): differentiator(true) {}
+
+bool Server::exhausted() const {
+    return full;
+}
+
+bool Server::respond(const std::string &header, const std::string &source, std::string &response) {
+    std::istringstream words(header);
+    std::vector<std::string> args;
+    for (std::string word; words >> word;) {
+        args.push_back(word);
+    }
+    std::lock_guard<std::mutex> lock(differentiating);
+    bool ok = true;
+    try {
+        if (args.size() < 2) {
+            throw DiffException("Expected '<length> <name> [options]', got '" + header + "'");
+        }
+        Diff::Options options;
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (!Differentiator::parseOption(args, i, options)) {
+                throw DiffException("Unknown option '" + args[i] + "'");
+            }
+        }
+        differentiator.forget();
+        response = differentiator.generate(source, options, args[1]);
+    } catch (std::exception &exception) {
+        response = exception.what();
+        ok = false;
+    }
+    full = SymbolTable::global().size() > MAX_SYMBOLS;
+    return ok;
+}
+
+void Server::serve(int in, int out) {
+    Reader reader(in);
+    std::string header, source, response;
+    while (reader.readLine(header)) {
+        char *end;
+        unsigned long long length = std::strtoull(header.c_str(), &end, 10);
+        if (end == header.c_str() || length > MAX_SOURCE_SIZE) {
+            writeAll(out, "error 0\n");
+            return;
+        }
+        if (!reader.readBytes(length, source)) return;
+        bool ok = respond(header, source, response);
+        if (!writeAll(out, (ok ? "ok " : "error ") + std::to_string(response.size()) + "\n" + response)) return;
+        if (exhausted() && !reader.buffered()) return;
+    }
+}
+
+void Server::serveSocket(const std::string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw DiffException("The socket path '" + path + "' is too long");
+    }
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw DiffException("Creating a socket failed: " + std::string(std::strerror(errno)));
+    }
+    // Only a socket left by a previous server is replaced
+    struct stat status{};
+    if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            close(listener);
+            throw DiffException("'" + path + "' exists and is not a socket");
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listener, (sockaddr *) &address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        std::string error = std::strerror(errno);
+        close(listener);
+        throw DiffException("Listening on '" + path + "' failed: " + error);
+    }
+    // The clients closing their connection early only end their connection
+    std::signal(SIGPIPE, SIG_IGN);
+    std::string error;
+    while (!exhausted()) {
+        {
+            std::unique_lock<std::mutex> lock(connectionsMutex);
+            connectionEnded.wait(lock, [this]() { return connections < MAX_CONNECTIONS; });
+        }
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            // The connection exhausting the server shuts the listener down
+            if (!exhausted()) {
+                error = std::strerror(errno);
+            }
+            break;
+        }
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        ++connections;
+        std::thread([this, connection, listener]() {
+            serve(connection, connection);
+            close(connection);
+            if (exhausted()) {
+                shutdown(listener, SHUT_RDWR);
+            }
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            --connections;
+            connectionEnded.notify_all();
+        }).detach();
+    }
+
+    // The threads use the server until they end
+    std::unique_lock<std::mutex> lock(connectionsMutex);
+    connectionEnded.wait(lock, [this]() { return connections == 0; });
+    close(listener);
+    unlink(path.c_str());
+    if (!error.empty()) {
+        throw DiffException("Accepting on '" + path + "' failed: " + error);
+    }
+}
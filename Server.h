@@ -0,0 +1,52 @@
+#ifndef FINAL_PROJECT_SERVER_H
+#define FINAL_PROJECT_SERVER_H
+
+#include "Differentiator.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Differentiates the sources sent by other processes, so that the tools generating many versions of their models
+// do not start the generator, build its default context and differentiate the unchanged functions each time.
+// A request is a header line "<length> <name> [options]", with the options of the differentiator executable, then
+// the <length> bytes of the source. It is answered with "ok <length>\n" and the generated code, or with
+// "error <length>\n" and the message. Each source only sees the default functions, while the resolved signatures
+// and the derivatives of the functions already differentiated stay cached between the requests.
+// The identifiers of every source stay interned in the symbol table, so once it holds MAX_SYMBOLS of them the server
+// stops between two requests, for its process to be restarted.
+class Server {
+public:
+    static const size_t MAX_SOURCE_SIZE;
+    // Connections served at once by serveSocket, the next ones wait to be accepted
+    static const size_t MAX_CONNECTIONS;
+    static const size_t MAX_SYMBOLS;
+
+    Server();
+
+    // Answers the requests read from in on out until in is closed, sends an invalid header or the server is
+    // exhausted with no request pending
+    void serve(int in, int out);
+    // Listens on a Unix domain socket created at path, serving each connection in its own thread, until the server
+    // is exhausted and its connections have ended. Throws a DiffException when the socket cannot be created, or
+    // when something else than a socket exists at path.
+    void serveSocket(const std::string &path);
+
+    // Sets response to the code generated for a request, or to the error message returning false. The requests
+    // are differentiated one at a time.
+    bool respond(const std::string &header, const std::string &source, std::string &response);
+
+    // Whether the symbol table, which never shrinks, held more than MAX_SYMBOLS identifiers after a request
+    bool exhausted() const;
+
+protected:
+    Differentiator differentiator;
+    // Held by respond, as the differentiator and the symbol table are not thread safe
+    std::mutex differentiating;
+    std::atomic<bool> full{false};
+    // Guards connections
+    std::mutex connectionsMutex;
+    std::condition_variable connectionEnded;
+    size_t connections = 0;
+};
+
+#endif //FINAL_PROJECT_SERVER_H
@@ -0,0 +1,106 @@
+#include "Statistics.h"
+#include <sstream>
+
+#ifndef GENERATOR_VERSION
+#define GENERATOR_VERSION "unknown"
+#endif
+
+std::atomic<size_t> Statistics::allocations(0);
+
+Statistics &Statistics::global() {
+    static Statistics statistics;
+    return statistics;
+}
+
+const char *Statistics::phaseName(Phase phase) {
+    switch (phase) {
+        case PARSE: return "parse";
+        case DIFFERENTIATE: return "differentiate";
+        case SIMPLIFY: return "simplify";
+        case EMIT: return "emit";
+        default: return "";
+    }
+}
+
+void Statistics::beginFile(const std::string &name) {
+    if (!enabled) return;
+    files.emplace_back();
+    files.back().name = name;
+}
+
+void Statistics::setNodeCounts(size_t before, size_t after) {
+    if (!enabled || files.empty()) return;
+    files.back().nodesBefore = before;
+    files.back().nodesAfter = after;
+}
+
+void Statistics::addFunction(const std::string &name, size_t nodesBefore, size_t nodesAfter) {
+    if (!enabled || files.empty()) return;
+    files.back().functions.push_back({name, nodesBefore, nodesAfter});
+}
+
+void Statistics::begin(Phase phase) {
+    if (!enabled || files.empty()) return;
+    PhaseStatistics &stats = files.back().phases[phase];
+    if (stats.depth++ == 0) {
+        stats.calls++;
+        stats.startAllocations = allocations.load(std::memory_order_relaxed);
+        stats.start = std::chrono::steady_clock::now();
+    }
+}
+
+void Statistics::end(Phase phase) {
+    if (!enabled || files.empty()) return;
+    PhaseStatistics &stats = files.back().phases[phase];
+    if (--stats.depth == 0) {
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - stats.start;
+        stats.seconds += duration.count();
+        stats.allocations += allocations.load(std::memory_order_relaxed) - stats.startAllocations;
+    }
+}
+
+static std::string escapeJson(const std::string &value) {
+    std::string result = "\"";
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (c == '\n') {
+            result += "\\n";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            result += ' ';
+        } else {
+            result += c;
+        }
+    }
+    return result + '"';
+}
+
+std::string Statistics::to_json() {
+    std::ostringstream result;
+    result << "{\n\t\"generatorVersion\": " << escapeJson(GENERATOR_VERSION) << ",\n\t\"files\": [";
+    for (int i = 0; i < files.size(); ++i) {
+        FileStatistics &file = files[i];
+        result << (i != 0 ? "," : "") << "\n\t\t{\n\t\t\t\"name\": " << escapeJson(file.name) << ",\n";
+        result << "\t\t\t\"phases\": {";
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+            PhaseStatistics &stats = file.phases[phase];
+            result << (phase != 0 ? "," : "") << "\n\t\t\t\t" << escapeJson(phaseName(static_cast<Phase>(phase)))
+                   << ": {\"seconds\": " << stats.seconds << ", \"allocations\": " << stats.allocations
+                   << ", \"calls\": " << stats.calls << "}";
+        }
+        result << "\n\t\t\t},\n";
+        result << "\t\t\t\"nodes\": {\"before\": " << file.nodesBefore << ", \"after\": " << file.nodesAfter << "},\n";
+        result << "\t\t\t\"functions\": [";
+        for (int j = 0; j < file.functions.size(); ++j) {
+            FunctionStatistics &function = file.functions[j];
+            double growth = function.nodesBefore == 0 ? 0 : (double) function.nodesAfter / function.nodesBefore;
+            result << (j != 0 ? "," : "") << "\n\t\t\t\t{\"name\": " << escapeJson(function.name)
+                   << ", \"nodesBefore\": " << function.nodesBefore << ", \"nodesAfter\": " << function.nodesAfter
+                   << ", \"growth\": " << growth << "}";
+        }
+        result << "\n\t\t\t]\n\t\t}";
+    }
+    result << "\n\t]\n}\n";
+    return result.str();
+}
@@ -0,0 +1,78 @@
+#ifndef FINAL_PROJECT_STATISTICS_H
+#define FINAL_PROJECT_STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Collects timings and sizes of the generator phases when enabled (see the --stats flag of differentiator).
+// Nothing is recorded while disabled, so the calls can stay in the hot paths.
+class Statistics {
+public:
+    enum Phase {
+        PARSE,
+        DIFFERENTIATE,
+        SIMPLIFY,
+        EMIT,
+        PHASE_COUNT
+    };
+
+    struct PhaseStatistics {
+        double seconds = 0;
+        size_t allocations = 0;
+        size_t calls = 0;
+        int depth = 0;
+        std::chrono::steady_clock::time_point start;
+        size_t startAllocations = 0;
+    };
+
+    struct FunctionStatistics {
+        std::string name;
+        size_t nodesBefore;
+        size_t nodesAfter;
+    };
+
+    struct FileStatistics {
+        std::string name;
+        PhaseStatistics phases[PHASE_COUNT];
+        size_t nodesBefore = 0;
+        size_t nodesAfter = 0;
+        std::vector<FunctionStatistics> functions;
+    };
+
+    // Measures the enclosing scope as part of the phase. Nested timers of the same phase (e.g. the recursive
+    // Diff::simplify) are only counted once.
+    class Timer {
+        Phase phase;
+    public:
+        explicit Timer(Phase phase): phase(phase) {
+            global().begin(phase);
+        }
+        ~Timer() {
+            global().end(phase);
+        }
+        Timer(const Timer &o) = delete;
+        Timer &operator=(const Timer &o) = delete;
+    };
+
+    bool enabled = false;
+    std::vector<FileStatistics> files;
+
+    // Incremented by the operator new of the executable, if it provides one
+    static std::atomic<size_t> allocations;
+
+    void beginFile(const std::string &name);
+    void setNodeCounts(size_t before, size_t after);
+    void addFunction(const std::string &name, size_t nodesBefore, size_t nodesAfter);
+    std::string to_json();
+
+    static Statistics &global();
+    static const char *phaseName(Phase phase);
+
+private:
+    void begin(Phase phase);
+    void end(Phase phase);
+};
+
+#endif //FINAL_PROJECT_STATISTICS_H
@@ -0,0 +1,8 @@
+#include "SymbolTable.h"
+
+const Symbol SymbolTable::EMPTY;
+
+SymbolTable &SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
@@ -0,0 +1,51 @@
+#ifndef FINAL_PROJECT_SYMBOL_TABLE_H
+#define FINAL_PROJECT_SYMBOL_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Small integer id of an interned identifier. Equal identifiers always get the same id, so
+// comparing and hashing symbols does not touch the string.
+typedef uint32_t Symbol;
+
+class SymbolTable {
+private:
+    std::unordered_map<std::string, Symbol> ids;
+    std::vector<const std::string *> names;
+
+public:
+    // Id of the empty identifier, used by generic types
+    static const Symbol EMPTY = 0;
+
+    SymbolTable() {
+        intern("");
+    }
+
+    SymbolTable(const SymbolTable &o) = delete;
+    SymbolTable &operator=(const SymbolTable &o) = delete;
+
+    Symbol intern(const std::string &name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        auto symbol = static_cast<Symbol>(names.size());
+        it = ids.emplace(name, symbol).first;
+        names.push_back(&it->first);
+        return symbol;
+    }
+
+    const std::string &name(Symbol symbol) const {
+        return *names[symbol];
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+
+    static SymbolTable &global();
+};
+
+#endif //FINAL_PROJECT_SYMBOL_TABLE_H
@@ -7,6 +7,8 @@
 #include <memory>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <charconv>
 #include "Context.h"
 
 
@@ -35,6 +37,11 @@ struct SyntaxTreeNode {
 public:
     virtual std::string to_string() = 0;
 
+    // Number of syntax tree nodes in this subtree, including this one
+    virtual size_t countNodes() {
+        return 1;
+    }
+
     virtual SyntaxTreeNode *copy() = 0;
 
     static void indent(std::string& value) {
@@ -111,6 +118,14 @@ struct Call: virtual Expression {
         return to_string(false, false);
     }
 
+    size_t countNodes() override {
+        size_t result = 1;
+        for (auto &arg: args) {
+            result += arg->countNodes();
+        }
+        return result;
+    }
+
     Call *copy() override {
         std::vector<std::shared_ptr<Expression>> copyArgs;
         for (auto &arg: args) {
@@ -123,14 +138,22 @@ struct Call: virtual Expression {
 struct Variable: virtual Expression {
     Type type;
     std::string name;
+    Symbol symbol;
     bool declaration;
     std::shared_ptr<Call> constructorCall;
 
     Variable() = delete;
     Variable(Type type, std::string name, bool declaration=false):
-            type(std::move(type)), name(std::move(name)), declaration(declaration) {};
+            type(std::move(type)), name(std::move(name)), symbol(SymbolTable::global().intern(this->name)),
+            declaration(declaration) {};
     Variable(Type type, std::string name, bool declaration, std::shared_ptr<Call> constructorCall):
-            type(std::move(type)), name(std::move(name)), declaration(declaration), constructorCall(std::move(constructorCall)) {}
+            type(std::move(type)), name(std::move(name)), symbol(SymbolTable::global().intern(this->name)),
+            declaration(declaration), constructorCall(std::move(constructorCall)) {}
+    Variable(Type type, Symbol symbol, bool declaration=false):
+            type(std::move(type)), name(SymbolTable::global().name(symbol)), symbol(symbol), declaration(declaration) {};
+    Variable(Type type, Symbol symbol, bool declaration, std::shared_ptr<Call> constructorCall):
+            type(std::move(type)), name(SymbolTable::global().name(symbol)), symbol(symbol),
+            declaration(declaration), constructorCall(std::move(constructorCall)) {}
 
     ExpressionType getType() override {
         return declaration ? VARIABLE_DECLARATION : VARIABLE;
@@ -138,7 +161,10 @@ struct Variable: virtual Expression {
 
     std::string to_string() override {
         if (declaration) {
-            if (constructorCall != nullptr) {
+            if (constructorCall != nullptr && constructorCall->args.empty()) {
+                // Value initialized, as `T name()` would declare a function
+                return type.to_string() + " " + name + "{}";
+            } else if (constructorCall != nullptr) {
                 return type.to_string() + " " + name + constructorCall->to_string(false, true);
             }
             return type.to_string() + " " + name;
@@ -146,8 +172,12 @@ struct Variable: virtual Expression {
         return name;
     }
 
+    size_t countNodes() override {
+        return constructorCall == nullptr ? 1 : 1 + constructorCall->countNodes();
+    }
+
     Variable *copy() override {
-        return new Variable(type, name);
+        return new Variable(type, symbol);
     }
 };
 
@@ -159,18 +189,37 @@ struct ElementaryValue: virtual Expression {
 
 struct Number: virtual ElementaryValue {
     double value;
+    // Whether the literal has a floating point type, as `2.0` and unlike `2`
+    bool floating = false;
+    // The literal as written in the parsed file, empty for the computed numbers
+    std::string token;
+
+    explicit Number(double value, bool floating=false): value(value), floating(floating) {};
+    explicit Number(std::string token): token(std::move(token)) {
+        floating = this->token.find_first_of(".eE") != std::string::npos;
+        std::from_chars_result result = std::from_chars(this->token.data(), this->token.data() + this->token.size(), value);
+        if (result.ec != std::errc()) {
+            throw ParsingException("Invalid number '" + this->token + "'");
+        }
+    };
 
-    explicit Number(double value): value(value) {};
-    explicit Number(const std::string value): value(std::atof(value.c_str())){};
-
+    // The parsed literal, or the shortest one that reads back as the same value
     std::string to_string() override {
-        std::ostringstream output;
-        output << value;
-        return output.str();
+        if (!token.empty()) {
+            return token;
+        }
+        char buffer[32];
+        std::string result(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        if (floating && result.find_first_of(".en") == std::string::npos) {
+            result += ".0";
+        }
+        return result;
     };
 
     Number* copy() override {
-        return new Number(value);
+        Number *result = new Number(value, floating);
+        result->token = token;
+        return result;
     }
 
     bool isZero() {
@@ -268,9 +317,18 @@ struct UnaryOperator: virtual Operator {
         if (suffix) {
             return expr->to_string() + operatorToString(op);
         }
+        auto *exprOp = dynamic_cast<Operator *>(expr.get());
+        auto *number = dynamic_cast<Number *>(expr.get());
+        if ((exprOp != nullptr && comparePrecedence(this, exprOp) <= 0) || (number != nullptr && number->value < 0)) {
+            return operatorToString(op) + "(" + expr->to_string() + ")";
+        }
         return operatorToString(op) + expr->to_string();
     }
 
+    size_t countNodes() override {
+        return 1 + expr->countNodes();
+    }
+
     UnaryOperator *copy() override {
         return new UnaryOperator(op, std::shared_ptr<Expression>(expr->copy()), suffix);
     }
@@ -413,7 +471,8 @@ struct BinaryOperator: virtual Operator {
         }
         result << ' ' + operatorToString(op) + ' ';
         auto *rightOp = dynamic_cast<BinaryOperator *>(right.get());
-        if (rightOp != nullptr && comparePrecedence(this, rightOp) < 0) {
+        // Operators of the same precedence are applied from the left, so the right one needs braces
+        if (rightOp != nullptr && comparePrecedence(this, rightOp) <= 0) {
             result << '(' + rightOp->to_string() + ')';
         } else {
             result << right->to_string();
@@ -421,6 +480,10 @@ struct BinaryOperator: virtual Operator {
         return result.str();
     }
 
+    size_t countNodes() override {
+        return 1 + left->countNodes() + right->countNodes();
+    }
+
     BinaryOperator *copy() override {
         return new BinaryOperator(op, std::shared_ptr<Expression>(left->copy()), std::shared_ptr<Expression>(right->copy()));
     }
@@ -495,6 +558,10 @@ struct ExpressionStatement: virtual Statement {
         return expr->to_string() + ';';
     }
 
+    size_t countNodes() override {
+        return 1 + expr->countNodes();
+    }
+
     ExpressionStatement *copy() override {
         return new ExpressionStatement(std::shared_ptr<Expression>(expr->copy()));
     }
@@ -518,6 +585,10 @@ struct ReturnStatement: virtual Statement {
         return "return " + expr->to_string() + ';';
     }
 
+    size_t countNodes() override {
+        return 1 + expr->countNodes();
+    }
+
     ReturnStatement *copy() override {
         return new ReturnStatement(std::shared_ptr<Expression>(expr->copy()));
     }
@@ -549,6 +620,14 @@ struct BlockStatement: virtual Statement {
         return result.str();
     }
 
+    size_t countNodes() override {
+        size_t result = 1;
+        for (auto &statement: statements) {
+            result += statement->countNodes();
+        }
+        return result;
+    }
+
     BlockStatement *copy() override {
         std::vector<std::shared_ptr<Statement>> copyStatements;
         for (auto &statement: statements) {
@@ -558,6 +637,47 @@ struct BlockStatement: virtual Statement {
     }
 };
 
+// A lambda capturing everything by reference
+struct Lambda: virtual Expression {
+    std::vector<std::shared_ptr<Variable>> params;
+    std::shared_ptr<BlockStatement> block;
+
+    Lambda() = delete;
+    Lambda(std::vector<std::shared_ptr<Variable>> params, std::shared_ptr<BlockStatement> block):
+            params(std::move(params)), block(std::move(block)) {}
+
+    ExpressionType getType() override {
+        return OTHER;
+    }
+
+    std::string to_string() override {
+        std::ostringstream result;
+        result << "[&](";
+        for (int i = 0; i < params.size(); ++i) {
+            if (i != 0) result << ", ";
+            result << params[i]->to_string();
+        }
+        result << ") " << block->to_string();
+        return result.str();
+    }
+
+    size_t countNodes() override {
+        size_t result = 1 + block->countNodes();
+        for (auto &param: params) {
+            result += param->countNodes();
+        }
+        return result;
+    }
+
+    Lambda *copy() override {
+        std::vector<std::shared_ptr<Variable>> paramsCopy;
+        for (auto &param: params) {
+            paramsCopy.push_back(std::shared_ptr<Variable>(param->copy()));
+        }
+        return new Lambda(paramsCopy, std::shared_ptr<BlockStatement>(block->copy()));
+    }
+};
+
 struct ConditionalStatement: virtual Statement {
     bool repeat = false;
     std::shared_ptr<Expression> condition;
@@ -593,6 +713,11 @@ struct ConditionalStatement: virtual Statement {
         return result.str();
     }
 
+    size_t countNodes() override {
+        return 1 + condition->countNodes() + statement->countNodes() +
+               (elseStatement == nullptr ? 0 : elseStatement->countNodes());
+    }
+
     ConditionalStatement *copy() override {
         return new ConditionalStatement(repeat, std::shared_ptr<Expression>(condition->copy()),
             std::shared_ptr<Statement>(statement->copy()),
@@ -627,6 +752,11 @@ struct ForLoop: virtual Statement {
         return result.str();
     }
 
+    size_t countNodes() override {
+        return 1 + definition->countNodes() + (condition == nullptr ? 0 : condition->countNodes()) +
+               (expr == nullptr ? 0 : expr->countNodes()) + statement->countNodes();
+    }
+
     ForLoop *copy() override {
         return new ForLoop(std::shared_ptr<Statement>(definition->copy()),
                 std::shared_ptr<Expression>(condition->copy()),
@@ -668,6 +798,46 @@ struct Comment: virtual Statement {
     }
 };
 
+// A plain struct with the fields declared by the variables
+struct StructDeclaration: virtual Statement {
+    std::string name;
+    std::vector<std::shared_ptr<Variable>> fields;
+
+    StructDeclaration() = delete;
+    StructDeclaration(std::string name, std::vector<std::shared_ptr<Variable>> fields):
+            name(std::move(name)), fields(std::move(fields)) {}
+
+    StatementType getType() override {
+        return OTHER;
+    }
+
+    bool isFunctionStatement() override {
+        return true;
+    }
+
+    std::string to_string() override {
+        std::ostringstream result;
+        result << "struct " << name << " {\n";
+        for (auto &field: fields) {
+            result << '\t' << field->to_string() << ";\n";
+        }
+        result << "};";
+        return result.str();
+    }
+
+    size_t countNodes() override {
+        return 1 + fields.size();
+    }
+
+    StructDeclaration *copy() override {
+        std::vector<std::shared_ptr<Variable>> fieldsCopy;
+        for (auto &field: fields) {
+            fieldsCopy.push_back(std::make_shared<Variable>(field->type, field->symbol, field->declaration));
+        }
+        return new StructDeclaration(name, fieldsCopy);
+    }
+};
+
 struct Include: virtual Statement {
     std::string name;
     bool arrowInclude;
@@ -692,6 +862,9 @@ struct FunctionDeclaration: virtual Statement {
     std::string name;
     Type returnType;
     std::vector<std::shared_ptr<Variable>> params;
+    // Parameters named by the diff(...) annotation of the function, the only ones it is differentiated with
+    // respect to. Empty for all of them.
+    std::vector<Symbol> differentiated;
 
     FunctionDeclaration() = delete;
     FunctionDeclaration(std::string name, Type returnType):
@@ -707,6 +880,24 @@ struct FunctionDeclaration: virtual Statement {
         return {name, paramTypes};
     }
 
+    std::vector<std::shared_ptr<Variable>> getDifferentiatedParams() {
+        if (differentiated.empty()) {
+            return params;
+        }
+        std::vector<std::shared_ptr<Variable>> result;
+        for (auto &param: params) {
+            if (std::find(differentiated.begin(), differentiated.end(), param->symbol) != differentiated.end()) {
+                result.push_back(param);
+            }
+        }
+        return result;
+    }
+
+    // Calls are parsed without the argument types, so they are resolved to this signature
+    FunctionSignature getCallSignature() {
+        return {name, std::vector<Type>(params.size(), Type())};
+    }
+
     StatementType getType() override {
         return FUNCTION_DECLARATION;
     }
@@ -731,12 +922,22 @@ struct FunctionDeclaration: virtual Statement {
         return to_string(true);
     }
 
+    size_t countNodes() override {
+        size_t result = 1;
+        for (auto &param: params) {
+            result += param->countNodes();
+        }
+        return result;
+    }
+
     FunctionDeclaration *copy() override {
         std::vector<std::shared_ptr<Variable>> paramsCopy;
         for (auto &param: params) {
             paramsCopy.push_back(std::shared_ptr<Variable>(param->copy()));
         }
-        return new FunctionDeclaration(name, returnType, paramsCopy);
+        FunctionDeclaration *result = new FunctionDeclaration(name, returnType, paramsCopy);
+        result->differentiated = differentiated;
+        return result;
     }
 };
 
@@ -764,8 +965,12 @@ struct Function: virtual Statement {
         return result.str();
     }
 
+    size_t countNodes() override {
+        return 1 + declaration->countNodes() + block->countNodes();
+    }
+
     Function *copy() override {
-        std::shared_ptr<Context> contextCopy = std::make_shared<Context>(*context);
+        std::shared_ptr<Context> contextCopy = std::shared_ptr<Context>(context->copy());
         return new Function(contextCopy,
              std::shared_ptr<FunctionDeclaration>(declaration->copy()),
              std::shared_ptr<BlockStatement>(block->copy()));
@@ -795,12 +1000,20 @@ struct FileNode: virtual SyntaxTreeNode {
         return result;
     }
 
+    size_t countNodes() override {
+        size_t result = 1;
+        for (auto &statement: statements) {
+            result += statement->countNodes();
+        }
+        return result;
+    }
+
     FileNode *copy() override {
         std::vector<std::shared_ptr<Statement>> statementsCopy;
         for (auto &statement: statements) {
             statementsCopy.push_back(std::shared_ptr<Statement>(statement->copy()));
         }
-        std::shared_ptr<Context> contextCopy = std::make_shared<Context>(*context);
+        std::shared_ptr<Context> contextCopy = std::shared_ptr<Context>(context->copy());
         return new FileNode(contextCopy, name, statementsCopy);
     }
 };
@@ -0,0 +1,157 @@
+#include "TaylorMode.h"
+
+const std::string TaylorMode::FUNCTION_PREFIX = "taylor_";
+const std::string TaylorMode::DIRECTION_PREFIX = "v_";
+const std::string TaylorMode::SERIES_PREFIX = "_x_";
+const std::string TaylorMode::DEGREE_NAME = "K";
+const std::string TaylorMode::SERIES_TYPE = "taylor::Series";
+
+std::shared_ptr<Function> TaylorMode::generate(std::shared_ptr<Function> function) {
+    TaylorMode mode(Type(SERIES_TYPE), "taylor::", "Taylor mode");
+    std::shared_ptr<FunctionDeclaration> decl = function->declaration;
+    std::shared_ptr<Context> context = std::shared_ptr<Context>(function->context->copy());
+
+    std::vector<std::shared_ptr<Variable>> params = decl->params;
+    std::vector<std::shared_ptr<Variable>> differentiated = decl->getDifferentiatedParams();
+    std::vector<std::shared_ptr<Variable>> directions;
+    for (std::shared_ptr<Variable> &param: differentiated) {
+        if (param->type.name != "double" && param->type.name != "float") {
+            throw DiffException("Only scalar parameters are supported in Taylor mode");
+        }
+        directions.push_back(mode.declareParameter(context, DIRECTION_PREFIX + param->name, param->type));
+        params.push_back(std::make_shared<Variable>(param->type, directions.back()->symbol, true));
+    }
+    std::shared_ptr<Variable> degree = mode.declareParameter(context, DEGREE_NAME, Type("int"));
+    params.push_back(std::make_shared<Variable>(degree->type, degree->symbol, true));
+
+    // Each differentiated parameter x is read through the series x + t v_x
+    std::vector<std::shared_ptr<Statement>> statements;
+    Type seriesType(SERIES_TYPE);
+    FunctionSignature variable(SERIES_TYPE + "::variable");
+    for (size_t i = 0; i < differentiated.size(); ++i) {
+        std::shared_ptr<Variable> series = mode.declareParameter(context, SERIES_PREFIX + differentiated[i]->name, seriesType);
+        mode.seeded[differentiated[i]->symbol] = series;
+        std::shared_ptr<Call> seed = std::make_shared<Call>(variable, std::vector<std::shared_ptr<Expression>>{
+                std::make_shared<Variable>(differentiated[i]->type, differentiated[i]->symbol), directions[i], degree});
+        statements.push_back(std::make_shared<ExpressionStatement>(std::make_shared<BinaryOperator>(
+                BinaryOperator::EQUALS, std::make_shared<Variable>(seriesType, series->symbol, true), seed)));
+    }
+    for (std::shared_ptr<Statement> &statement: function->block->statements) {
+        statements.push_back(mode.rewrite(statement));
+    }
+
+    std::shared_ptr<FunctionDeclaration> taylorDecl = std::make_shared<FunctionDeclaration>(
+            FUNCTION_PREFIX + decl->name, mode.retype(decl->returnType), params);
+    return std::make_shared<Function>(context, taylorDecl, std::make_shared<BlockStatement>(statements));
+}
+
+std::shared_ptr<Statement> TaylorMode::rewrite(std::shared_ptr<Statement> statement) {
+    switch (statement->getType()) {
+        case Statement::EXPRESSION:
+            return std::make_shared<ExpressionStatement>(
+                    rewrite(std::dynamic_pointer_cast<ExpressionStatement>(statement)->expr));
+        case Statement::RETURN:
+            return std::make_shared<ReturnStatement>(rewrite(std::dynamic_pointer_cast<ReturnStatement>(statement)->expr));
+        case Statement::BLOCK: {
+            std::vector<std::shared_ptr<Statement>> statements;
+            for (std::shared_ptr<Statement> &inner: std::dynamic_pointer_cast<BlockStatement>(statement)->statements) {
+                statements.push_back(rewrite(inner));
+            }
+            return std::make_shared<BlockStatement>(statements);
+        }
+        case Statement::IF:
+        case Statement::WHILE_LOOP: {
+            std::shared_ptr<ConditionalStatement> conditional = std::dynamic_pointer_cast<ConditionalStatement>(statement);
+            if (conditional->elseStatement == nullptr) {
+                return std::make_shared<ConditionalStatement>(conditional->repeat, rewrite(conditional->condition),
+                                                              rewrite(conditional->statement));
+            }
+            return std::make_shared<ConditionalStatement>(conditional->repeat, rewrite(conditional->condition),
+                                                          rewrite(conditional->statement),
+                                                          rewrite(conditional->elseStatement));
+        }
+        case Statement::FOR_LOOP: {
+            std::shared_ptr<ForLoop> loop = std::dynamic_pointer_cast<ForLoop>(statement);
+            return std::make_shared<ForLoop>(rewrite(loop->definition),
+                                             loop->condition == nullptr ? nullptr : rewrite(loop->condition),
+                                             loop->expr == nullptr ? nullptr : rewrite(loop->expr),
+                                             rewrite(loop->statement));
+        }
+        case Statement::BREAK:
+        case Statement::COMMENT:
+            return statement;
+        default:
+            throw DiffException("Statement '" + statement->to_string() + "' is not supported in " + modeName);
+    }
+}
+
+std::shared_ptr<Expression> TaylorMode::rewrite(std::shared_ptr<Expression> expression) {
+    switch (expression->getType()) {
+        case Expression::VARIABLE:
+        case Expression::VARIABLE_DECLARATION: {
+            std::shared_ptr<Variable> variable = std::dynamic_pointer_cast<Variable>(expression);
+            auto series = seeded.find(variable->symbol);
+            if (series != seeded.end()) {
+                return series->second;
+            }
+            std::shared_ptr<Call> constructorCall;
+            if (variable->constructorCall != nullptr) {
+                constructorCall = std::dynamic_pointer_cast<Call>(rewrite(variable->constructorCall));
+            }
+            return std::make_shared<Variable>(retype(variable->type), variable->symbol, variable->declaration,
+                                              constructorCall);
+        }
+        case Expression::UNARY_OPERATOR: {
+            std::shared_ptr<UnaryOperator> op = std::dynamic_pointer_cast<UnaryOperator>(expression);
+            return std::make_shared<UnaryOperator>(op->op, rewrite(op->expr));
+        }
+        case Expression::BINARY_OPERATOR: {
+            std::shared_ptr<BinaryOperator> op = std::dynamic_pointer_cast<BinaryOperator>(expression);
+            return std::make_shared<BinaryOperator>(op->op, rewrite(op->left), rewrite(op->right));
+        }
+        case Expression::ELEMENTARY_VALUE:
+            return expression;
+        case Expression::CALL: {
+            std::shared_ptr<Call> call = std::dynamic_pointer_cast<Call>(expression);
+            std::vector<std::shared_ptr<Expression>> args;
+            for (std::shared_ptr<Expression> &arg: call->args) {
+                args.push_back(rewrite(arg));
+            }
+            const std::string &name = call->signature.name;
+            if (name == "std::sin" || name == "std::cos" || name == "std::exp" || name == "std::log" ||
+                    name == "std::pow" || name == "std::abs") {
+                FunctionSignature signature(mathNamespace + name.substr(5));
+                return std::make_shared<Call>(signature, args);
+            } else if (name.rfind("std::", 0) != 0) {
+                throw DiffException("Calls to '" + name + "' are not supported in " + modeName);
+            }
+            return std::make_shared<Call>(call->signature, args);
+        }
+        default:
+            throw DiffException("Expression '" + expression->to_string() + "' is not supported in " + modeName);
+    }
+}
+
+Type TaylorMode::retype(const Type &type) const {
+    if (type.isGeneric) {
+        return type;
+    } else if (type.name == "double" || type.name == "float") {
+        return valueType;
+    }
+    std::vector<Type> generics;
+    for (const Type &generic: type.generics) {
+        generics.push_back(retype(generic));
+    }
+    return Type(type.name, generics);
+}
+
+std::shared_ptr<Variable> TaylorMode::declareParameter(std::shared_ptr<Context> context, const std::string &name,
+                                                       Type type) const {
+    Symbol symbol = SymbolTable::global().intern(name);
+    if (context->isVariablePresent(symbol)) {
+        throw DiffException("Variable '" + name + "' conflicts with a parameter of the " + modeName);
+    }
+    std::shared_ptr<Variable> variable = std::make_shared<Variable>(std::move(type), symbol);
+    context->addVariable(symbol, variable);
+    return variable;
+}
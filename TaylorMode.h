@@ -0,0 +1,42 @@
+#ifndef FINAL_PROJECT_TAYLOR_MODE_H
+#define FINAL_PROJECT_TAYLOR_MODE_H
+
+#include "Diff.h"
+
+// Generates taylor_<name>(params..., v_<param>..., K) functions computing the Taylor coefficients up to degree K
+// of a function along the direction v of its differentiated parameters, with the taylor::Series arithmetic of
+// diff_taylor.h. The function is copied with its floating point values retyped to series and the calls of the
+// default context replaced by their series versions, so a single evaluation costs O(K^2) per operation.
+// Calls to other functions and lambdas throw a DiffException. DualMode rewrites the functions the same way.
+class TaylorMode {
+protected:
+    static const std::string FUNCTION_PREFIX;
+    static const std::string DIRECTION_PREFIX;
+    static const std::string SERIES_PREFIX;
+    static const std::string DEGREE_NAME;
+    static const std::string SERIES_TYPE;
+
+    // The type replacing the floating point values, and the namespace of its versions of the std functions
+    Type valueType;
+    std::string mathNamespace;
+    std::string modeName;
+    // The differentiated parameters, replaced in the body by their seeded values
+    std::unordered_map<Symbol, std::shared_ptr<Variable>> seeded;
+
+    TaylorMode(Type valueType, std::string mathNamespace, std::string modeName):
+            valueType(std::move(valueType)), mathNamespace(std::move(mathNamespace)), modeName(std::move(modeName)) {}
+
+public:
+    static std::shared_ptr<Function> generate(std::shared_ptr<Function> function);
+
+protected:
+    std::shared_ptr<Statement> rewrite(std::shared_ptr<Statement> statement);
+    std::shared_ptr<Expression> rewrite(std::shared_ptr<Expression> expression);
+
+    // The type with double and float replaced by the value type, also as the elements of arrays and vectors
+    Type retype(const Type &type) const;
+    std::shared_ptr<Variable> declareParameter(std::shared_ptr<Context> context, const std::string &name,
+                                               Type type) const;
+};
+
+#endif //FINAL_PROJECT_TAYLOR_MODE_H
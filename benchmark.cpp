@@ -0,0 +1,365 @@
+#include "function.h"
+#include "d_function.h"
+#include "diff_tape.h"
+#include "Jit.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Times the generated derivative functions against central finite differences, forward mode dual numbers, the
+// generated dual_ functions on the vector dual numbers of diff_dual.h and the reverse mode tape of diff_tape.h, and
+// checks that they all agree. The d_ function of system is also compiled at runtime with Jit from the source of
+// function.h and checked against the generated one. Usage: benchmark [iterations]
+
+typedef std::vector<std::vector<double>> Jacobian; // [input][output], the layout of the generated functions
+
+static volatile double sink;
+
+// A forward mode dual number with a single tangent, so a Jacobian takes one evaluation per input
+struct Dual {
+    double value;
+    double tangent;
+
+    Dual(double value=0, double tangent=0): value(value), tangent(tangent) {}
+};
+
+Dual operator+(Dual a, Dual b) { return {a.value + b.value, a.tangent + b.tangent}; }
+Dual operator-(Dual a, Dual b) { return {a.value - b.value, a.tangent - b.tangent}; }
+Dual operator*(Dual a, Dual b) { return {a.value * b.value, a.tangent * b.value + a.value * b.tangent}; }
+Dual operator/(Dual a, Dual b) {
+    return {a.value / b.value, (a.tangent * b.value - a.value * b.tangent) / (b.value * b.value)};
+}
+Dual sin(Dual a) { return {std::sin(a.value), std::cos(a.value) * a.tangent}; }
+Dual cos(Dual a) { return {std::cos(a.value), -std::sin(a.value) * a.tangent}; }
+Dual exp(Dual a) { double e = std::exp(a.value); return {e, e * a.tangent}; }
+Dual log(Dual a) { return {std::log(a.value), a.tangent / a.value}; }
+Dual abs(Dual a) { return {std::abs(a.value), ((a.value > 0) - (a.value < 0)) * a.tangent}; }
+Dual pow(Dual a, double b) { return {std::pow(a.value, b), b * std::pow(a.value, b - 1) * a.tangent}; }
+
+// The models of function.h, written generically so that they can be evaluated with Dual
+namespace generic {
+    using std::sin;
+    using std::cos;
+    using std::exp;
+    using std::abs;
+    using std::pow;
+
+    template <typename T>
+    std::array<T, 4> system(T x1, T x2, T x3, T u) {
+        std::array<T, 4> result;
+        result[0] = x2 + pow(x3, 2);
+        result[1] = (T(1) - T(2) * x3) * u + sin(x1) - x2 + x3 - x3 * x3;
+        result[2] = u;
+        result[3] = x1;
+        return result;
+    }
+
+    template <typename T>
+    std::array<T, 6> spaceVehicleSystem(T x, T y, T vx, T vy, T theta, T vTheta, T a, T aTheta) {
+        std::array<T, 6> result;
+        result[0] = vx;
+        result[1] = vy;
+        result[2] = cos(theta) * a;
+        result[3] = sin(theta) * a;
+        result[4] = vTheta;
+        result[5] = aTheta;
+        return result;
+    }
+
+    template <typename T>
+    std::vector<T> pendulumSystem(T theta, T dTheta) {
+        std::vector<T> result(2, T(0));
+        result[0] = dTheta;
+        result[1] = T(10) - sin(theta);
+        return result;
+    }
+
+    template <typename T>
+    std::array<T, 1> func2(T input) {
+        T a = T(exp(2.0)) + abs(input);
+        return {pow(input, 10) * a};
+    }
+
+    template <typename T>
+    std::array<T, 1> rotationTrace(T theta, T s) {
+        std::array<std::array<T, 2>, 2> m;
+        m[0][0] = s * cos(theta);
+        m[0][1] = s * sin(theta);
+        m[1][0] = exp(s) * theta;
+        m[1][1] = s * cos(theta);
+        return {m[0][0] * m[1][1] + m[0][1] * m[1][0]};
+    }
+}
+
+// Calls f with the elements of x as separate arguments
+template <typename F, typename T, size_t N, size_t... I>
+auto apply(F &f, const std::array<T, N> &x, std::index_sequence<I...>) {
+    return f(x[I]...);
+}
+
+template <typename F, typename T, size_t N>
+auto apply(F &f, const std::array<T, N> &x) {
+    return apply(f, x, std::make_index_sequence<N>());
+}
+
+template <size_t N, typename F>
+void centralDifferences(F &f, std::array<double, N> x, Jacobian &jacobian) {
+    for (size_t i = 0; i < N; ++i) {
+        double h = 1e-6 * std::max(1.0, std::abs(x[i]));
+        double original = x[i];
+        x[i] = original + h;
+        auto forward = apply(f, x);
+        x[i] = original - h;
+        auto backward = apply(f, x);
+        x[i] = original;
+        for (size_t j = 0; j < forward.size(); ++j) {
+            jacobian[i][j] = (forward[j] - backward[j]) / (2 * h);
+        }
+    }
+}
+
+template <size_t N, typename F>
+void dualJacobian(F &f, const std::array<double, N> &x, Jacobian &jacobian) {
+    std::array<Dual, N> dx;
+    for (size_t i = 0; i < N; ++i) {
+        dx[i] = Dual(x[i]);
+    }
+    for (size_t i = 0; i < N; ++i) {
+        dx[i].tangent = 1;
+        auto result = apply(f, dx);
+        dx[i].tangent = 0;
+        for (size_t j = 0; j < result.size(); ++j) {
+            jacobian[i][j] = result[j].tangent;
+        }
+    }
+}
+
+// Reads the Jacobian from the tangents of the result of a dual_ function
+template <typename R>
+void dualVectorJacobian(const R &result, Jacobian &jacobian) {
+    for (size_t j = 0; j < result.size(); ++j) {
+        for (size_t i = 0; i < jacobian.size(); ++i) {
+            jacobian[i][j] = result[j].tangent[i];
+        }
+    }
+}
+
+// Records one evaluation and sweeps the tape back once per output
+template <size_t N, typename F>
+void tapeJacobian(F &f, const std::array<double, N> &x, Jacobian &jacobian) {
+    tape::Tape &tape = tape::Tape::active();
+    tape.clear();
+    std::array<tape::Var, N> vx;
+    for (size_t i = 0; i < N; ++i) {
+        vx[i] = tape.variable(x[i]);
+    }
+    auto result = apply(f, vx);
+    for (size_t j = 0; j < result.size(); ++j) {
+        tape.gradient(result[j]);
+        for (size_t i = 0; i < N; ++i) {
+            jacobian[i][j] = tape.adjoint(vx[i]);
+        }
+    }
+}
+
+template <typename F>
+double nsPerCall(F f, size_t iterations) {
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        checksum += f(i);
+    }
+    std::chrono::duration<double, std::nano> duration = std::chrono::steady_clock::now() - start;
+    sink = checksum;
+    return duration.count() / iterations;
+}
+
+// Varies the input between calls so that the compiler cannot hoist the evaluation out of the loop
+template <size_t N>
+void perturb(std::array<double, N> &input, const std::array<double, N> &x, size_t i) {
+    for (size_t j = 0; j < N; ++j) {
+        input[j] = x[j] + (i & 1023) * 1e-9;
+    }
+}
+
+// Uses every entry of a Jacobian, so that none of them can be optimized away
+template <typename J>
+double sumEntries(const J &jacobian) {
+    double result = 0;
+    for (auto &column: jacobian) {
+        for (double entry: column) {
+            result += entry;
+        }
+    }
+    return result;
+}
+
+static double maxDifference(const Jacobian &a, const Jacobian &b) {
+    double result = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < a[i].size(); ++j) {
+            result = std::max(result, std::abs(a[i][j] - b[i][j]));
+        }
+    }
+    return result;
+}
+
+// Benchmarks one model at point x. generated is the d_ function, dual the dual_ function, value the original
+// function and generic its templated copy.
+template <size_t N, typename Generated, typename DualVector, typename Value, typename Generic>
+bool benchmark(const std::string &name, std::array<double, N> x, size_t outputs,
+               Generated generated, DualVector dual, Value value, Generic generic, size_t iterations) {
+    Jacobian reference(N, std::vector<double>(outputs)), jacobian = reference;
+    dualJacobian(generic, x, reference);
+
+    auto result = apply(generated, x);
+    for (size_t i = 0; i < N; ++i) {
+        for (size_t j = 0; j < outputs; ++j) {
+            jacobian[i][j] = result[i][j];
+        }
+    }
+    double generatedError = maxDifference(jacobian, reference);
+    centralDifferences(value, x, jacobian);
+    double differencesError = maxDifference(jacobian, reference);
+    dualVectorJacobian(apply(dual, x), jacobian);
+    double dualVectorError = maxDifference(jacobian, reference);
+    tapeJacobian(generic, x, jacobian);
+    double tapeError = maxDifference(jacobian, reference);
+
+    std::array<double, N> input = x;
+    double generatedTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        return sumEntries(apply(generated, input));
+    }, iterations);
+    double differencesTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        centralDifferences(value, input, jacobian);
+        return sumEntries(jacobian);
+    }, iterations);
+    double dualTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        dualJacobian(generic, input, jacobian);
+        return sumEntries(jacobian);
+    }, iterations);
+    double dualVectorTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        dualVectorJacobian(apply(dual, input), jacobian);
+        return sumEntries(jacobian);
+    }, iterations);
+    double tapeTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        tapeJacobian(generic, input, jacobian);
+        return sumEntries(jacobian);
+    }, iterations);
+
+    // Finite differences are only expected to match to about the square root of the machine precision
+    bool generatedAgrees = generatedError <= 1e-9;
+    bool differencesAgree = differencesError <= 1e-5;
+    bool dualVectorAgrees = dualVectorError <= 1e-9;
+    bool tapeAgrees = tapeError <= 1e-9;
+    std::printf("%-20s %-20s %12.1f %10s %12.3g %s\n", name.c_str(), "generated", generatedTime, "1.00x",
+                generatedError, generatedAgrees ? "ok" : "MISMATCH");
+    std::printf("%-20s %-20s %12.1f %9.2fx %12.3g %s\n", name.c_str(), "finite differences", differencesTime,
+                differencesTime / generatedTime, differencesError, differencesAgree ? "ok" : "MISMATCH");
+    std::printf("%-20s %-20s %12.1f %9.2fx %12s %s\n", name.c_str(), "dual numbers", dualTime,
+                dualTime / generatedTime, "reference", "ok");
+    std::printf("%-20s %-20s %12.1f %9.2fx %12.3g %s\n", name.c_str(), "generated dual", dualVectorTime,
+                dualVectorTime / generatedTime, dualVectorError, dualVectorAgrees ? "ok" : "MISMATCH");
+    std::printf("%-20s %-20s %12.1f %9.2fx %12.3g %s\n", name.c_str(), "tape reverse", tapeTime,
+                tapeTime / generatedTime, tapeError, tapeAgrees ? "ok" : "MISMATCH");
+    return generatedAgrees && differencesAgree && dualVectorAgrees && tapeAgrees;
+}
+
+// Loads the derivatives of function.h with Jit and times its d_system against the one of d_function.h
+static bool benchmarkJit(size_t iterations) {
+    std::ifstream file(FUNCTION_SOURCE);
+    std::ostringstream source;
+    source << file.rdbuf();
+    std::shared_ptr<Jit::Module> module;
+    try {
+        module = Jit().load("function.h", source.str());
+    } catch (DiffException &e) {
+        std::printf("%-20s %-20s %s\n", "system", "jit", e.what());
+        return false;
+    }
+    auto *jitted = module->function<decltype(d_system)>("d_system");
+
+    std::array<double, 4> x = {0.3, -1.2, 0.7, 2.1};
+    auto expected = d_system(x[0], x[1], x[2], x[3]);
+    auto result = jitted(x[0], x[1], x[2], x[3]);
+    double error = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        for (size_t j = 0; j < expected[i].size(); ++j) {
+            error = std::max(error, std::abs(result[i][j] - expected[i][j]));
+        }
+    }
+
+    std::array<double, 4> input = x;
+    double generatedTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        return sumEntries(d_system(input[0], input[1], input[2], input[3]));
+    }, iterations);
+    double jitTime = nsPerCall([&](size_t i) {
+        perturb(input, x, i);
+        return sumEntries(jitted(input[0], input[1], input[2], input[3]));
+    }, iterations);
+    bool agrees = error <= 1e-9;
+    std::printf("%-20s %-20s %12.1f %9.2fx %12.3g %s\n", "system", "jit", jitTime, jitTime / generatedTime, error,
+                agrees ? "ok" : "MISMATCH");
+    return agrees;
+}
+
+int main(int argc, char *argv[]) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("%-20s %-20s %12s %10s %12s\n", "function", "method", "ns/call", "speedup", "max error");
+    bool agree = true;
+    agree &= benchmark<4>("system", {0.3, -1.2, 0.7, 2.1}, 4,
+            [](double x1, double x2, double x3, double u) { return d_system(x1, x2, x3, u); },
+            [](double x1, double x2, double x3, double u) { return dual_system(x1, x2, x3, u); },
+            [](double x1, double x2, double x3, double u) { return system(x1, x2, x3, u); },
+            [](auto x1, auto x2, auto x3, auto u) { return generic::system(x1, x2, x3, u); },
+            iterations);
+    agree &= benchmark<8>("spaceVehicleSystem", {1, 2, 0.5, -0.5, 0.3, 0.1, 2, -1}, 6,
+            [](double x, double y, double vx, double vy, double theta, double vTheta, double a, double aTheta) {
+                return d_spaceVehicleSystem(x, y, vx, vy, theta, vTheta, a, aTheta);
+            },
+            [](double x, double y, double vx, double vy, double theta, double vTheta, double a, double aTheta) {
+                return dual_spaceVehicleSystem(x, y, vx, vy, theta, vTheta, a, aTheta);
+            },
+            [](double x, double y, double vx, double vy, double theta, double vTheta, double a, double aTheta) {
+                return spaceVehicleSystem(x, y, vx, vy, theta, vTheta, a, aTheta);
+            },
+            [](auto x, auto y, auto vx, auto vy, auto theta, auto vTheta, auto a, auto aTheta) {
+                return generic::spaceVehicleSystem(x, y, vx, vy, theta, vTheta, a, aTheta);
+            },
+            iterations);
+    agree &= benchmark<2>("pendulumSystem", {0.4, -0.2}, 2,
+            [](double theta, double dTheta) { return d_pendulumSystem(theta, dTheta); },
+            [](double theta, double dTheta) { return dual_pendulumSystem(theta, dTheta); },
+            [](double theta, double dTheta) { return pendulumSystem(theta, dTheta); },
+            [](auto theta, auto dTheta) { return generic::pendulumSystem(theta, dTheta); },
+            iterations);
+    agree &= benchmark<1>("func2", {1.3}, 1,
+            [](double input) { return std::array<std::array<double, 1>, 1>{{{d_func2(input)}}}; },
+            [](double input) { return std::array<dual::Dual<double, 1>, 1>{dual_func2(input)}; },
+            [](double input) { return std::array<double, 1>{func2(input)}; },
+            [](auto input) { return generic::func2(input); },
+            iterations);
+    agree &= benchmark<2>("rotationTrace", {0.6, 1.4}, 1,
+            [](double theta, double s) {
+                std::array<double, 2> d = d_rotationTrace(theta, s);
+                return std::array<std::array<double, 1>, 2>{{{d[0]}, {d[1]}}};
+            },
+            [](double theta, double s) { return std::array<dual::Dual<double, 2>, 1>{dual_rotationTrace(theta, s)}; },
+            [](double theta, double s) { return std::array<double, 1>{rotationTrace(theta, s)}; },
+            [](auto theta, auto s) { return generic::rotationTrace(theta, s); },
+            iterations);
+    agree &= benchmarkJit(iterations);
+
+    return agree ? 0 : 1;
+}
@@ -1,33 +1,22 @@
 #include <array>
+#include "diff_dual.h"
 #include <cmath>
 #include <vector>
+// d_system: forward mode, estimated cost: forward 272 (4 directions), reverse 427 (4 outputs); one evaluation: 9 flops, 2 transcendental calls, 20 memory accesses
 
 std::array<std::array<double, 4>, 4> d_system(double x1, double x2, double x3, double u) {
-	std::array<double, 4> d_x1_result;
-	std::array<double, 4> d_x2_result;
-	std::array<double, 4> d_x3_result;
-	std::array<double, 4> d_u_result;
-	std::array<double, 4> result;
-	d_x1_result[0] = 0;
+	std::array<double, 4> d_x1_result{};
+	std::array<double, 4> d_x2_result{};
+	std::array<double, 4> d_x3_result{};
+	std::array<double, 4> d_u_result{};
 	d_x2_result[0] = 1;
 	d_x3_result[0] = 2 * std::pow(x3, 1);
-	d_u_result[0] = 0;
-	result[0] = x2 + std::pow(x3, 2);
-	d_x1_result[1] = (0) * u + std::cos(x1);
-	d_x2_result[1] = (0) * u + 1;
-	d_x3_result[1] = (2) * u + 1 - x3 + x3;
-	d_u_result[1] = (0) * u + (1 - 2 * x3);
-	result[1] = (1 - 2 * x3) * u + std::sin(x1) - x2 + x3 - x3 * x3;
-	d_x1_result[2] = 0;
-	d_x2_result[2] = 0;
-	d_x3_result[2] = 0;
+	d_x1_result[1] = std::cos(x1);
+	d_x2_result[1] = -1;
+	d_x3_result[1] = -2 * u + 1 - (x3 + x3);
+	d_u_result[1] = (1 - 2 * x3);
 	d_u_result[2] = 1;
-	result[2] = u;
 	d_x1_result[3] = 1;
-	d_x2_result[3] = 0;
-	d_x3_result[3] = 0;
-	d_u_result[3] = 0;
-	result[3] = x1;
 	std::array<std::array<double, 4>, 4> _return;
 	_return[0] = d_x1_result;
 	_return[1] = d_x2_result;
@@ -35,72 +24,39 @@ std::array<std::array<double, 4>, 4> d_system(double x1, double x2, double x3, d
 	_return[3] = d_u_result;
 	return _return;
 }
+
+std::array<dual::Dual<double, 4>, 4> dual_system(double x1, double x2, double x3, double u) {
+	dual::Dual<double, 4> _x_x1 = dual::Dual<double, 4>::variable(x1, 0);
+	dual::Dual<double, 4> _x_x2 = dual::Dual<double, 4>::variable(x2, 1);
+	dual::Dual<double, 4> _x_x3 = dual::Dual<double, 4>::variable(x3, 2);
+	dual::Dual<double, 4> _x_u = dual::Dual<double, 4>::variable(u, 3);
+	std::array<dual::Dual<double, 4>, 4> result;
+	result[0] = _x_x2 + dual::pow(_x_x3, 2);
+	result[1] = (1 - 2 * _x_x3) * _x_u + dual::sin(_x_x1) - _x_x2 + _x_x3 - _x_x3 * _x_x3;
+	result[2] = _x_u;
+	result[3] = _x_x1;
+	return result;
+}
 // x and y, velocity x and y, angle theta, angular velocity, acceleration, angular acceleration
+// d_spaceVehicleSystem: forward mode, estimated cost: forward 166 (8 directions), reverse 509 (6 outputs); one evaluation: 2 flops, 2 transcendental calls, 21 memory accesses
 
 std::array<std::array<double, 6>, 8> d_spaceVehicleSystem(double x, double y, double vx, double vy, double theta, double vTheta, double a, double aTheta) {
-	std::array<double, 6> d_x_result;
-	std::array<double, 6> d_y_result;
-	std::array<double, 6> d_vx_result;
-	std::array<double, 6> d_vy_result;
-	std::array<double, 6> d_theta_result;
-	std::array<double, 6> d_vTheta_result;
-	std::array<double, 6> d_a_result;
-	std::array<double, 6> d_aTheta_result;
-	std::array<double, 6> result;
-	d_x_result[0] = 0;
-	d_y_result[0] = 0;
+	std::array<double, 6> d_x_result{};
+	std::array<double, 6> d_y_result{};
+	std::array<double, 6> d_vx_result{};
+	std::array<double, 6> d_vy_result{};
+	std::array<double, 6> d_theta_result{};
+	std::array<double, 6> d_vTheta_result{};
+	std::array<double, 6> d_a_result{};
+	std::array<double, 6> d_aTheta_result{};
 	d_vx_result[0] = 1;
-	d_vy_result[0] = 0;
-	d_theta_result[0] = 0;
-	d_vTheta_result[0] = 0;
-	d_a_result[0] = 0;
-	d_aTheta_result[0] = 0;
-	result[0] = vx;
-	d_x_result[1] = 0;
-	d_y_result[1] = 0;
-	d_vx_result[1] = 0;
 	d_vy_result[1] = 1;
-	d_theta_result[1] = 0;
-	d_vTheta_result[1] = 0;
-	d_a_result[1] = 0;
-	d_aTheta_result[1] = 0;
-	result[1] = vy;
-	d_x_result[2] = 0;
-	d_y_result[2] = 0;
-	d_vx_result[2] = 0;
-	d_vy_result[2] = 0;
 	d_theta_result[2] = -std::sin(theta) * a;
-	d_vTheta_result[2] = 0;
 	d_a_result[2] = std::cos(theta);
-	d_aTheta_result[2] = 0;
-	result[2] = std::cos(theta) * a;
-	d_x_result[3] = 0;
-	d_y_result[3] = 0;
-	d_vx_result[3] = 0;
-	d_vy_result[3] = 0;
 	d_theta_result[3] = std::cos(theta) * a;
-	d_vTheta_result[3] = 0;
 	d_a_result[3] = std::sin(theta);
-	d_aTheta_result[3] = 0;
-	result[3] = std::sin(theta) * a;
-	d_x_result[4] = 0;
-	d_y_result[4] = 0;
-	d_vx_result[4] = 0;
-	d_vy_result[4] = 0;
-	d_theta_result[4] = 0;
 	d_vTheta_result[4] = 1;
-	d_a_result[4] = 0;
-	d_aTheta_result[4] = 0;
-	result[4] = vTheta;
-	d_x_result[5] = 0;
-	d_y_result[5] = 0;
-	d_vx_result[5] = 0;
-	d_vy_result[5] = 0;
-	d_theta_result[5] = 0;
-	d_vTheta_result[5] = 0;
-	d_a_result[5] = 0;
 	d_aTheta_result[5] = 1;
-	result[5] = aTheta;
 	std::array<std::array<double, 6>, 8> _return;
 	_return[0] = d_x_result;
 	_return[1] = d_y_result;
@@ -113,24 +69,91 @@ std::array<std::array<double, 6>, 8> d_spaceVehicleSystem(double x, double y, do
 	return _return;
 }
 
+std::array<dual::Dual<double, 8>, 6> dual_spaceVehicleSystem(double x, double y, double vx, double vy, double theta, double vTheta, double a, double aTheta) {
+	dual::Dual<double, 8> _x_vx = dual::Dual<double, 8>::variable(vx, 2);
+	dual::Dual<double, 8> _x_vy = dual::Dual<double, 8>::variable(vy, 3);
+	dual::Dual<double, 8> _x_theta = dual::Dual<double, 8>::variable(theta, 4);
+	dual::Dual<double, 8> _x_vTheta = dual::Dual<double, 8>::variable(vTheta, 5);
+	dual::Dual<double, 8> _x_a = dual::Dual<double, 8>::variable(a, 6);
+	dual::Dual<double, 8> _x_aTheta = dual::Dual<double, 8>::variable(aTheta, 7);
+	std::array<dual::Dual<double, 8>, 6> result;
+	result[0] = _x_vx;
+	result[1] = _x_vy;
+	result[2] = dual::cos(_x_theta) * _x_a;
+	result[3] = dual::sin(_x_theta) * _x_a;
+	result[4] = _x_vTheta;
+	result[5] = _x_aTheta;
+	return result;
+}
+// d_pendulumSystem: forward mode, estimated cost: forward 51 (2 directions), reverse 89 (2 outputs); one evaluation: 1 flops, 1 transcendental calls, 7 memory accesses
+
 std::array<std::vector<double>, 2> d_pendulumSystem(double theta, double dTheta) {
 	std::vector<double> d_theta_result(2, 0);
 	std::vector<double> d_dTheta_result(2, 0);
-	std::vector<double> result(2, 0);
-	d_theta_result[0] = 0;
 	d_dTheta_result[0] = 1;
-	result[0] = dTheta;
-	d_theta_result[1] = std::cos(theta);
-	d_dTheta_result[1] = 0;
-	result[1] = 10 - std::sin(theta);
+	d_theta_result[1] = -std::cos(theta);
 	std::array<std::vector<double>, 2> _return;
 	_return[0] = d_theta_result;
 	_return[1] = d_dTheta_result;
 	return _return;
 }
 
+std::vector<dual::Dual<double, 2>> dual_pendulumSystem(double theta, double dTheta) {
+	dual::Dual<double, 2> _x_theta = dual::Dual<double, 2>::variable(theta, 0);
+	dual::Dual<double, 2> _x_dTheta = dual::Dual<double, 2>::variable(dTheta, 1);
+	std::vector<dual::Dual<double, 2>> result(2, 0);
+	result[0] = _x_dTheta;
+	result[1] = 10 - dual::sin(_x_theta);
+	return result;
+}
+// d_func2: forward mode, estimated cost: forward 95 (1 directions), reverse 104 (1 outputs); one evaluation: 3 flops, 2 transcendental calls, 4 memory accesses
+
 double d_func2(double input) {
 	double d_input_a = (input > 0) - (input < 0);
-	double a = std::exp(2) + std::abs(input);
+	double a = 7.38905609893065 + std::abs(input);
 	return 10 * std::pow(input, 9) * a + std::pow(input, 10) * d_input_a;
 }
+
+dual::Dual<double, 1> dual_func2(double input) {
+	dual::Dual<double, 1> _x_input = dual::Dual<double, 1>::variable(input, 0);
+	dual::Dual<double, 1> a = dual::exp(2) + dual::abs(_x_input);
+	return dual::pow(_x_input, 10) * a;
+}
+// The elements of a matrix held as nested arrays
+// d_rotationTrace: forward mode, estimated cost: forward 326 (2 directions), reverse 237 (1 outputs); one evaluation: 7 flops, 4 transcendental calls, 22 memory accesses, as the reverse mode is not supported: Only scalar variables are supported in reverse mode: 'm'
+
+std::array<double, 2> d_rotationTrace(double theta, double s) {
+	std::array<std::array<double, 2>, 2> d_theta_m{};
+	std::array<std::array<double, 2>, 2> d_s_m{};
+	std::array<std::array<double, 2>, 2> m;
+	d_theta_m[0][0] = s * -std::sin(theta);
+	d_s_m[0][0] = std::cos(theta);
+	m[0][0] = s * std::cos(theta);
+	d_theta_m[0][1] = s * std::cos(theta);
+	d_s_m[0][1] = std::sin(theta);
+	m[0][1] = s * std::sin(theta);
+	d_theta_m[1][0] = std::exp(s);
+	d_s_m[1][0] = std::exp(s) * theta;
+	m[1][0] = std::exp(s) * theta;
+	d_theta_m[1][1] = s * -std::sin(theta);
+	d_s_m[1][1] = std::cos(theta);
+	m[1][1] = s * std::cos(theta);
+	double d_theta_result = d_theta_m[0][0] * m[1][1] + m[0][0] * d_theta_m[1][1] + (d_theta_m[0][1] * m[1][0] + m[0][1] * d_theta_m[1][0]);
+	double d_s_result = d_s_m[0][0] * m[1][1] + m[0][0] * d_s_m[1][1] + (d_s_m[0][1] * m[1][0] + m[0][1] * d_s_m[1][0]);
+	std::array<double, 2> _return;
+	_return[0] = d_theta_result;
+	_return[1] = d_s_result;
+	return _return;
+}
+
+dual::Dual<double, 2> dual_rotationTrace(double theta, double s) {
+	dual::Dual<double, 2> _x_theta = dual::Dual<double, 2>::variable(theta, 0);
+	dual::Dual<double, 2> _x_s = dual::Dual<double, 2>::variable(s, 1);
+	std::array<std::array<dual::Dual<double, 2>, 2>, 2> m;
+	m[0][0] = _x_s * dual::cos(_x_theta);
+	m[0][1] = _x_s * dual::sin(_x_theta);
+	m[1][0] = dual::exp(_x_s) * _x_theta;
+	m[1][1] = _x_s * dual::cos(_x_theta);
+	dual::Dual<double, 2> result = m[0][0] * m[1][1] + m[0][1] * m[1][0];
+	return result;
+}
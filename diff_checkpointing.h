@@ -0,0 +1,60 @@
+#ifndef FINAL_PROJECT_DIFF_CHECKPOINTING_H
+#define FINAL_PROJECT_DIFF_CHECKPOINTING_H
+
+#include <algorithm>
+
+// Runtime support for the loops of the generated reverse mode (grad_) functions.
+// The adjoint of a loop needs the state before every iteration in reverse order. Instead of storing all of them,
+// the states are recomputed from at most `checkpoints` stored ones, placed by binomial checkpointing (revolve).
+// With c checkpoints and t forward repetitions up to (c + t choose c) iterations can be reversed.
+
+// (snapshots + repetitions) choose snapshots, saturated so that it cannot overflow
+inline long long checkpointedSteps(int snapshots, int repetitions) {
+    const long long limit = 1LL << 50;
+    long long result = 1;
+    for (int i = 1; i <= snapshots; ++i) {
+        result = result * (repetitions + i) / i;
+        if (result >= limit) {
+            return limit;
+        }
+    }
+    return result;
+}
+
+// Runs adjoint for the iterations [from, to) in reverse order, where state is the state before iteration from
+template <typename State, typename Advance, typename Adjoint>
+void reverseSteps(const State &state, long long from, long long to, int snapshots,
+                  Advance &advance, Adjoint &adjoint) {
+    while (to - from > 1 && snapshots > 0) {
+        long long steps = to - from;
+        int repetitions = 0;
+        while (checkpointedSteps(snapshots, repetitions) < steps) {
+            ++repetitions;
+        }
+        // The last part is reversed with one snapshot less, the rest with one repetition less
+        long long middle = to - std::min(checkpointedSteps(snapshots - 1, repetitions), steps - 1);
+        State checkpoint = state;
+        for (long long i = from; i < middle; ++i) {
+            advance(checkpoint);
+        }
+        reverseSteps(checkpoint, middle, to, snapshots - 1, advance, adjoint);
+        to = middle;
+    }
+
+    // Without snapshots left every iteration is recomputed from the first one
+    for (long long step = to - 1; step >= from; --step) {
+        State current = state;
+        for (long long i = from; i < step; ++i) {
+            advance(current);
+        }
+        adjoint(current);
+    }
+}
+
+// advance(State &) runs one iteration, adjoint(State) runs the adjoint of the iteration starting at the state
+template <typename State, typename Advance, typename Adjoint>
+void reverseLoop(const State &start, long long steps, int checkpoints, Advance advance, Adjoint adjoint) {
+    reverseSteps(start, 0, steps, checkpoints, advance, adjoint);
+}
+
+#endif //FINAL_PROJECT_DIFF_CHECKPOINTING_H
@@ -1,6 +1,10 @@
 #ifndef FINAL_PROJECT_DIFF_DEFINES_H
 #define FINAL_PROJECT_DIFF_DEFINES_H
 
-#define diff( differentiationVariables )
+// Placed before a function, selects the parameters the differentiator takes the derivatives with respect to:
+//     diff(a, aTheta)
+//     std::array<double, 6> spaceVehicleSystem(double x, ..., double a, double aTheta) { ... }
+// The other parameters are treated as constants. Expands to nothing for the compiler.
+#define diff( ... )
 
 #endif //FINAL_PROJECT_DIFF_DEFINES_H
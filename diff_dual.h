@@ -0,0 +1,142 @@
+#ifndef FINAL_PROJECT_DIFF_DUAL_H
+#define FINAL_PROJECT_DIFF_DUAL_H
+
+#include <cmath>
+#include <cstddef>
+
+// Runtime support for the generated dual_ functions, also usable on its own with templated code.
+// A Dual<T, N> is a value with its derivatives in N directions at once, the N tangents stored contiguously so that
+// the compiler vectorizes the loops over them. A function evaluated on duals seeded with the unit directions of its
+// N inputs gives its whole Jacobian in one evaluation, without the symbolic derivatives growing with the function.
+// The derivatives of the functions follow the generated ones (DefaultFunctionDiffStorage).
+namespace dual {
+
+template <typename T, size_t N>
+struct Dual {
+    typedef T Scalar;
+
+    T value;
+    T tangent[N];
+
+    Dual(T value=0): value(value), tangent{} {}
+
+    // The input of the given direction
+    static Dual variable(T value, size_t direction) {
+        Dual result(value);
+        result.tangent[direction] = 1;
+        return result;
+    }
+
+    // The operators are found through the arguments, so the numbers on either side are converted to constants
+    friend Dual operator+(const Dual &a, const Dual &b) {
+        Dual result(a.value + b.value);
+        for (size_t i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] + b.tangent[i];
+        }
+        return result;
+    }
+
+    friend Dual operator-(const Dual &a, const Dual &b) {
+        Dual result(a.value - b.value);
+        for (size_t i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] - b.tangent[i];
+        }
+        return result;
+    }
+
+    friend Dual operator*(const Dual &a, const Dual &b) {
+        Dual result(a.value * b.value);
+        for (size_t i = 0; i < N; ++i) {
+            result.tangent[i] = a.tangent[i] * b.value + a.value * b.tangent[i];
+        }
+        return result;
+    }
+
+    friend Dual operator/(const Dual &a, const Dual &b) {
+        Dual result(a.value / b.value);
+        T inverse = 1 / b.value;
+        for (size_t i = 0; i < N; ++i) {
+            result.tangent[i] = (a.tangent[i] - result.value * b.tangent[i]) * inverse;
+        }
+        return result;
+    }
+
+    friend Dual operator+(const Dual &a) { return a; }
+    friend Dual operator-(const Dual &a) { return a.scaled(-a.value, -1); }
+
+    Dual &operator+=(const Dual &o) { return *this = *this + o; }
+    Dual &operator-=(const Dual &o) { return *this = *this - o; }
+    Dual &operator*=(const Dual &o) { return *this = *this * o; }
+    Dual &operator/=(const Dual &o) { return *this = *this / o; }
+
+    // Comparisons, as the branches taken, only look at the values
+    friend bool operator<(const Dual &a, const Dual &b) { return a.value < b.value; }
+    friend bool operator>(const Dual &a, const Dual &b) { return a.value > b.value; }
+    friend bool operator<=(const Dual &a, const Dual &b) { return a.value <= b.value; }
+    friend bool operator>=(const Dual &a, const Dual &b) { return a.value >= b.value; }
+    friend bool operator==(const Dual &a, const Dual &b) { return a.value == b.value; }
+    friend bool operator!=(const Dual &a, const Dual &b) { return a.value != b.value; }
+
+    // f(this) for f with the value and the derivative at this value, by the chain rule
+    Dual scaled(T value, T derivative) const {
+        Dual result(value);
+        for (size_t i = 0; i < N; ++i) {
+            result.tangent[i] = derivative * tangent[i];
+        }
+        return result;
+    }
+};
+
+template <typename T, size_t N>
+Dual<T, N> sin(const Dual<T, N> &a) { return a.scaled(std::sin(a.value), std::cos(a.value)); }
+
+template <typename T, size_t N>
+Dual<T, N> cos(const Dual<T, N> &a) { return a.scaled(std::cos(a.value), -std::sin(a.value)); }
+
+template <typename T, size_t N>
+Dual<T, N> exp(const Dual<T, N> &a) {
+    T value = std::exp(a.value);
+    return a.scaled(value, value);
+}
+
+template <typename T, size_t N>
+Dual<T, N> log(const Dual<T, N> &a) { return a.scaled(std::log(a.value), 1 / a.value); }
+
+// The sign at 0 is 0
+template <typename T, size_t N>
+Dual<T, N> abs(const Dual<T, N> &a) { return a.scaled(std::abs(a.value), (T) ((a.value > 0) - (a.value < 0))); }
+
+template <typename T, size_t N>
+Dual<T, N> pow(const Dual<T, N> &a, typename Dual<T, N>::Scalar b) {
+    return a.scaled(std::pow(a.value, b), b * std::pow(a.value, b - 1));
+}
+
+// d/db is pow(a, b) log(a), like in the generated functions
+template <typename T, size_t N>
+Dual<T, N> pow(const Dual<T, N> &a, const Dual<T, N> &b) {
+    T value = std::pow(a.value, b.value);
+    T dA = b.value * std::pow(a.value, b.value - 1), dB = value * std::log(a.value);
+    Dual<T, N> result(value);
+    for (size_t i = 0; i < N; ++i) {
+        result.tangent[i] = dA * a.tangent[i] + dB * b.tangent[i];
+    }
+    return result;
+}
+
+template <typename T, size_t N>
+Dual<T, N> pow(typename Dual<T, N>::Scalar a, const Dual<T, N> &b) {
+    T value = std::pow(a, b.value);
+    return b.scaled(value, value * std::log(a));
+}
+
+// The constants keep the double functions
+inline double sin(double a) { return std::sin(a); }
+inline double cos(double a) { return std::cos(a); }
+inline double exp(double a) { return std::exp(a); }
+inline double log(double a) { return std::log(a); }
+inline double abs(double a) { return std::abs(a); }
+inline double pow(double a, double b) { return std::pow(a, b); }
+
+}
+
+#endif //FINAL_PROJECT_DIFF_DUAL_H
@@ -0,0 +1,169 @@
+#ifndef FINAL_PROJECT_DIFF_TAPE_H
+#define FINAL_PROJECT_DIFF_TAPE_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Runtime reverse mode for the code the generator cannot parse, such as templates and classes.
+// Every operation on a tape::Var records its local partial derivatives, with the rules the generator uses for the
+// same functions (DefaultFunctionDiffStorage), onto the thread's tape, and Tape::gradient propagates the adjoints of
+// an output back to all recorded values in one sweep. The tape lives in fixed size blocks that clear() keeps, so once
+// a first evaluation has grown it, recording allocates nothing.
+//
+//     tape::Tape &tape = tape::Tape::active();
+//     tape.clear();
+//     tape::Var x = tape.variable(0.5), y = tape.variable(2);
+//     tape::Var f = tape::sin(x) * y;
+//     tape.gradient(f);
+//     double dfdx = tape.adjoint(x), dfdy = tape.adjoint(y);
+namespace tape {
+
+class Var;
+
+class Tape {
+public:
+    // The operations have at most two arguments, the missing ones point at the constant entry 0
+    struct Entry {
+        uint32_t args[2];
+        double partials[2];
+    };
+
+    static const uint32_t BLOCK_BITS = 12;
+    static const uint32_t BLOCK_SIZE = 1u << BLOCK_BITS;
+
+    Tape() {
+        clear();
+    }
+
+    static Tape &active() {
+        thread_local Tape tape;
+        return tape;
+    }
+
+    // Forgets the recorded operations, keeping the memory for the next evaluation
+    void clear() {
+        used = 0;
+        push(0, 0, 0, 0);
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+    inline Var variable(double value);
+
+    uint32_t push(uint32_t a, double partialA, uint32_t b, double partialB) {
+        if (used == blocks.size() * BLOCK_SIZE) {
+            blocks.emplace_back(new Entry[BLOCK_SIZE]);
+        }
+        Entry &entry = blocks[used >> BLOCK_BITS][used & (BLOCK_SIZE - 1)];
+        entry.args[0] = a;
+        entry.args[1] = b;
+        entry.partials[0] = partialA;
+        entry.partials[1] = partialB;
+        return (uint32_t) used++;
+    }
+
+    // The adjoints of all recorded values for the output, read with adjoint
+    inline void gradient(const Var &output);
+    inline double adjoint(const Var &value) const;
+
+protected:
+    std::vector<std::unique_ptr<Entry[]>> blocks;
+    size_t used = 0;
+    std::vector<double> adjoints;
+};
+
+class Var {
+public:
+    double value;
+    // The tape entry of the value, 0 for the constants
+    uint32_t index;
+
+    Var(double value=0): value(value), index(0) {}
+    Var(double value, uint32_t index): value(value), index(index) {}
+
+    static Var record(double value, const Var &a, double partialA) {
+        return {value, Tape::active().push(a.index, partialA, 0, 0)};
+    }
+
+    static Var record(double value, const Var &a, double partialA, const Var &b, double partialB) {
+        return {value, Tape::active().push(a.index, partialA, b.index, partialB)};
+    }
+
+    Var &operator+=(const Var &o);
+    Var &operator-=(const Var &o);
+    Var &operator*=(const Var &o);
+    Var &operator/=(const Var &o);
+};
+
+inline Var Tape::variable(double value) {
+    return {value, push(0, 0, 0, 0)};
+}
+
+inline void Tape::gradient(const Var &output) {
+    adjoints.assign(used, 0);
+    adjoints[output.index] = 1;
+    for (size_t i = output.index; i > 0; --i) {
+        double adjoint = adjoints[i];
+        const Entry &entry = blocks[i >> BLOCK_BITS][i & (BLOCK_SIZE - 1)];
+        adjoints[entry.args[0]] += entry.partials[0] * adjoint;
+        adjoints[entry.args[1]] += entry.partials[1] * adjoint;
+    }
+}
+
+inline double Tape::adjoint(const Var &value) const {
+    return value.index == 0 || value.index >= adjoints.size() ? 0 : adjoints[value.index];
+}
+
+inline Var operator+(const Var &a, const Var &b) { return Var::record(a.value + b.value, a, 1, b, 1); }
+inline Var operator-(const Var &a, const Var &b) { return Var::record(a.value - b.value, a, 1, b, -1); }
+inline Var operator*(const Var &a, const Var &b) { return Var::record(a.value * b.value, a, b.value, b, a.value); }
+inline Var operator/(const Var &a, const Var &b) {
+    return Var::record(a.value / b.value, a, 1 / b.value, b, -a.value / (b.value * b.value));
+}
+inline Var operator+(const Var &a) { return a; }
+inline Var operator-(const Var &a) { return Var::record(-a.value, a, -1); }
+
+inline Var &Var::operator+=(const Var &o) { return *this = *this + o; }
+inline Var &Var::operator-=(const Var &o) { return *this = *this - o; }
+inline Var &Var::operator*=(const Var &o) { return *this = *this * o; }
+inline Var &Var::operator/=(const Var &o) { return *this = *this / o; }
+
+// Comparisons, as the branches taken, only look at the values
+inline bool operator<(const Var &a, const Var &b) { return a.value < b.value; }
+inline bool operator>(const Var &a, const Var &b) { return a.value > b.value; }
+inline bool operator<=(const Var &a, const Var &b) { return a.value <= b.value; }
+inline bool operator>=(const Var &a, const Var &b) { return a.value >= b.value; }
+inline bool operator==(const Var &a, const Var &b) { return a.value == b.value; }
+inline bool operator!=(const Var &a, const Var &b) { return a.value != b.value; }
+
+inline Var sin(const Var &a) { return Var::record(std::sin(a.value), a, std::cos(a.value)); }
+inline Var cos(const Var &a) { return Var::record(std::cos(a.value), a, -std::sin(a.value)); }
+inline Var log(const Var &a) { return Var::record(std::log(a.value), a, 1 / a.value); }
+
+inline Var exp(const Var &a) {
+    double value = std::exp(a.value);
+    return Var::record(value, a, value);
+}
+
+// The sign at 0 is 0
+inline Var abs(const Var &a) {
+    return Var::record(std::abs(a.value), a, (double) ((a.value > 0) - (a.value < 0)));
+}
+
+inline Var pow(const Var &a, double b) {
+    return Var::record(std::pow(a.value, b), a, b * std::pow(a.value, b - 1));
+}
+
+// d/db is pow(a, b) log(a), like in the generated functions
+inline Var pow(const Var &a, const Var &b) {
+    double value = std::pow(a.value, b.value);
+    return Var::record(value, a, b.value * std::pow(a.value, b.value - 1), b, value * std::log(a.value));
+}
+
+}
+
+#endif //FINAL_PROJECT_DIFF_TAPE_H
@@ -0,0 +1,220 @@
+#ifndef FINAL_PROJECT_DIFF_TAYLOR_H
+#define FINAL_PROJECT_DIFF_TAYLOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Runtime support for the generated Taylor mode (taylor_) functions.
+// A Series holds the Taylor coefficients of a value along the path x + t v of the inputs, coefficient k being
+// 1/k! d^k/dt^k at t = 0, truncated after the degree K the inputs are seeded with. Constants only hold their value.
+// Every operation computes all the coefficients of its result in O(K^2), with the recurrences of the derivative of
+// the elementary functions (Griewank and Walther, Evaluating Derivatives, chapter 13).
+namespace taylor {
+
+struct Series {
+    std::vector<double> c;
+
+    Series(double value=0): c(1, value) {}
+    explicit Series(size_t size): c(size, 0) {}
+
+    // The input x moving in the direction v, to the degree
+    static Series variable(double value, double direction, int degree) {
+        Series result((size_t) std::max(degree, 0) + 1);
+        result.c[0] = value;
+        if (degree > 0) {
+            result.c[1] = direction;
+        }
+        return result;
+    }
+
+    size_t size() const {
+        return c.size();
+    }
+
+    double operator[](size_t k) const {
+        return k < c.size() ? c[k] : 0;
+    }
+
+    double value() const {
+        return c[0];
+    }
+
+    // The k-th derivative along the direction
+    double derivative(int k) const {
+        double factorial = 1;
+        for (int i = 2; i <= k; ++i) {
+            factorial *= i;
+        }
+        return (*this)[k] * factorial;
+    }
+
+    Series &operator+=(const Series &o) {
+        c.resize(std::max(c.size(), o.c.size()), 0);
+        for (size_t k = 0; k < o.c.size(); ++k) {
+            c[k] += o.c[k];
+        }
+        return *this;
+    }
+
+    Series &operator-=(const Series &o) {
+        c.resize(std::max(c.size(), o.c.size()), 0);
+        for (size_t k = 0; k < o.c.size(); ++k) {
+            c[k] -= o.c[k];
+        }
+        return *this;
+    }
+
+    Series &operator*=(const Series &o);
+    Series &operator/=(const Series &o);
+};
+
+inline Series operator+(Series a, const Series &b) { return a += b; }
+inline Series operator-(Series a, const Series &b) { return a -= b; }
+inline Series operator+(const Series &a) { return a; }
+
+inline Series operator-(Series a) {
+    for (double &coefficient: a.c) {
+        coefficient = -coefficient;
+    }
+    return a;
+}
+
+inline Series operator*(const Series &a, const Series &b) {
+    Series result(std::max(a.size(), b.size()));
+    for (size_t k = 0; k < result.size(); ++k) {
+        for (size_t j = 0; j <= k && j < a.size(); ++j) {
+            result.c[k] += a.c[j] * b[k - j];
+        }
+    }
+    return result;
+}
+
+inline Series operator/(const Series &a, const Series &b) {
+    Series result(std::max(a.size(), b.size()));
+    for (size_t k = 0; k < result.size(); ++k) {
+        double sum = a[k];
+        for (size_t j = 1; j <= k && j < b.size(); ++j) {
+            sum -= b.c[j] * result.c[k - j];
+        }
+        result.c[k] = sum / b.c[0];
+    }
+    return result;
+}
+
+inline Series &Series::operator*=(const Series &o) { return *this = *this * o; }
+inline Series &Series::operator/=(const Series &o) { return *this = *this / o; }
+
+// Comparisons, as the branches taken, only look at the values
+inline bool operator<(const Series &a, const Series &b) { return a.value() < b.value(); }
+inline bool operator>(const Series &a, const Series &b) { return a.value() > b.value(); }
+inline bool operator<=(const Series &a, const Series &b) { return a.value() <= b.value(); }
+inline bool operator>=(const Series &a, const Series &b) { return a.value() >= b.value(); }
+inline bool operator==(const Series &a, const Series &b) { return a.value() == b.value(); }
+inline bool operator!=(const Series &a, const Series &b) { return a.value() != b.value(); }
+
+inline Series exp(const Series &u) {
+    Series result(u.size());
+    result.c[0] = std::exp(u.c[0]);
+    for (size_t k = 1; k < u.size(); ++k) {
+        double sum = 0;
+        for (size_t j = 1; j <= k; ++j) {
+            sum += j * u.c[j] * result.c[k - j];
+        }
+        result.c[k] = sum / k;
+    }
+    return result;
+}
+
+inline Series log(const Series &u) {
+    Series result(u.size());
+    result.c[0] = std::log(u.c[0]);
+    for (size_t k = 1; k < u.size(); ++k) {
+        double sum = k * u.c[k];
+        for (size_t j = 1; j < k; ++j) {
+            sum -= (k - j) * u.c[j] * result.c[k - j];
+        }
+        result.c[k] = sum / (k * u.c[0]);
+    }
+    return result;
+}
+
+// The sine and the cosine are computed together, the derivative of each being the other
+inline void sinCos(const Series &u, Series &sine, Series &cosine) {
+    sine = Series(u.size());
+    cosine = Series(u.size());
+    sine.c[0] = std::sin(u.c[0]);
+    cosine.c[0] = std::cos(u.c[0]);
+    for (size_t k = 1; k < u.size(); ++k) {
+        double sinSum = 0, cosSum = 0;
+        for (size_t j = 1; j <= k; ++j) {
+            sinSum += j * u.c[j] * cosine.c[k - j];
+            cosSum -= j * u.c[j] * sine.c[k - j];
+        }
+        sine.c[k] = sinSum / k;
+        cosine.c[k] = cosSum / k;
+    }
+}
+
+inline Series sin(const Series &u) {
+    Series sine, cosine;
+    sinCos(u, sine, cosine);
+    return sine;
+}
+
+inline Series cos(const Series &u) {
+    Series sine, cosine;
+    sinCos(u, sine, cosine);
+    return cosine;
+}
+
+// Like the derivative of std::abs in the generated functions, the sign at 0 is 0
+inline Series abs(const Series &u) {
+    return u * Series((double) ((u.value() > 0) - (u.value() < 0)));
+}
+
+inline Series pow(const Series &u, double b) {
+    if (u.c[0] == 0 && b >= 0 && b == std::floor(b)) {
+        // The recurrence divides by the value, integer powers of 0 are multiplied out by squaring
+        Series result(1.0), base = u;
+        for (long long n = (long long) b; n > 0; n /= 2) {
+            if (n % 2 == 1) {
+                result = result * base;
+            }
+            if (n > 1) {
+                base = base * base;
+            }
+        }
+        return result;
+    }
+    Series result(u.size());
+    result.c[0] = std::pow(u.c[0], b);
+    for (size_t k = 1; k < u.size(); ++k) {
+        double sum = 0;
+        for (size_t j = 1; j <= k; ++j) {
+            sum += (b * j - (double) (k - j)) * u.c[j] * result.c[k - j];
+        }
+        result.c[k] = sum / (k * u.c[0]);
+    }
+    return result;
+}
+
+inline Series pow(const Series &u, const Series &w) {
+    return w.size() == 1 ? pow(u, w.value()) : exp(w * log(u));
+}
+
+inline Series pow(double a, const Series &w) {
+    return exp(w * std::log(a));
+}
+
+// The constants keep the double functions
+inline double exp(double a) { return std::exp(a); }
+inline double log(double a) { return std::log(a); }
+inline double sin(double a) { return std::sin(a); }
+inline double cos(double a) { return std::cos(a); }
+inline double abs(double a) { return std::abs(a); }
+inline double pow(double a, double b) { return std::pow(a, b); }
+
+}
+
+#endif //FINAL_PROJECT_DIFF_TAYLOR_H
@@ -1,53 +1,174 @@
 #include <iostream>
-#include "CppParser.h"
-#include "Diff.h"
-#include "DefaultFunctionDiffStorage.h"
+#include "Differentiator.h"
+#include "Bytecode.h"
+#include "Server.h"
 #include <memory>
+#include <new>
+#include <cstdlib>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
 
-class DefaultContext: public Context {
-public:
-    DefaultContext() {
-        Type integer("int");
-        Type floating("float");
-        Type doubleFloating("double");
-        Type vector("std::vector");
-        Type array("std::array");
-        addType(integer.name, integer);
-        addType(floating.name, floating);
-        addType(doubleFloating.name, doubleFloating);
-        addType(vector.name, vector);
-        addType(array.name, array);
-
-        addFunction(FunctionSignature("std::cos", Type()));
-        addFunction(FunctionSignature("std::sin", Type()));
-        addFunction(FunctionSignature("std::pow", Type(), Type()));
-        addFunction(FunctionSignature("std::exp", Type()));
-        addFunction(FunctionSignature("std::log", Type()));
-        addFunction(FunctionSignature("std::vector", Type(), Type()));
-        addFunction(FunctionSignature("std::vector::size"));
-        addFunction(FunctionSignature("std::array", Type()));
-        addFunction(FunctionSignature("std::abs", Type()));
+// Counts the heap allocations for --stats
+void *operator new(std::size_t size) {
+    Statistics::allocations.fetch_add(1, std::memory_order_relaxed);
+    void *result = std::malloc(size == 0 ? 1 : size);
+    if (result == nullptr) {
+        throw std::bad_alloc();
     }
-};
+    return result;
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+// Runs the generated function with the bytecode interpreter, printing its result and the time of an evaluation
+static int evaluate(std::shared_ptr<FileNode> dFile, const std::string &name, const std::string &inputs,
+                    std::ostream &out) {
+    for (std::shared_ptr<Statement> &statement: dFile->statements) {
+        if (statement->getType() != Statement::FUNCTION ||
+                std::dynamic_pointer_cast<Function>(statement)->declaration->name != name) {
+            continue;
+        }
+        Bytecode program;
+        try {
+            program = Bytecode::compile(std::dynamic_pointer_cast<Function>(statement));
+        } catch (DiffException &e) {
+            std::cerr << "Cannot evaluate '" << name << "': " << e.what() << std::endl;
+            return 1;
+        }
+        std::vector<double> input;
+        for (size_t begin = 0; !inputs.empty() && begin <= inputs.size();) {
+            size_t end = std::min(inputs.find(',', begin), inputs.size());
+            std::string text = inputs.substr(begin, end - begin);
+            char *parsed = nullptr;
+            double value = std::strtod(text.c_str(), &parsed);
+            if (text.empty() || *parsed != '\0' || !std::isfinite(value)) {
+                std::cerr << "Input '" << text << "' of '" << name << "' is not a number" << std::endl;
+                return 1;
+            }
+            input.push_back(value);
+            begin = end + 1;
+        }
+        if (input.size() != program.inputCount) {
+            std::cerr << "'" << name << "' takes " << program.inputCount << " inputs" << std::endl;
+            return 1;
+        }
+
+        std::vector<double> output(program.outputCount), slots = program.initialSlots;
+        program.run(input.data(), output.data(), slots);
+        const size_t runs = 100000;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < runs; ++i) {
+            program.run(input.data(), output.data(), slots);
+        }
+        double time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+
+        out << name << " =";
+        for (double value: output) {
+            out << ' ' << value;
+        }
+        out << "\n" << program.code.size() << " instructions, " << slots.size() << " slots, "
+                  << time / runs << " ns per evaluation" << std::endl;
+        return 0;
+    }
+    std::cerr << "No function '" << name << "' was generated" << std::endl;
+    return 1;
+}
 
 int main(int argc, char *argv[]) {
-    std::cout << "Beginning parsing files" << std::endl;
-
-    std::shared_ptr<Context> defaultContext = std::make_shared<DefaultContext>();
-
-    for (int i = 1; i < argc; ++i) {
-        std::cout << "Parsing file '" + std::string(argv[i]) + "'" << std::endl;
-        std::shared_ptr<FileNode> file = CppParser::parseFile(std::string("../") + argv[i], defaultContext);
-        std::cout << "Parsed file: \n" << file->to_string() << std::endl;
-        std::shared_ptr<FunctionDiffStorage> diffStorage =
-                std::make_shared<DefaultFunctionDiffStorage>(defaultContext);
-        std::shared_ptr<FileNode> dFile = Diff::takeDiff(file, diffStorage);
-        std::cout << "Writing file '" + dFile->name + "'" << std::endl;
-        CppParser::writeFile(dFile);
+    Statistics &statistics = Statistics::global();
+    Diff::Options options;
+    std::vector<std::string> files;
+    // --eval name inputs, the generated function to run with the comma separated inputs
+    std::string evalName, evalInputs;
+    // --serve answers the requests of Server.h on the standard input and output, --socket PATH on a socket. An
+    // exhausted server is started again in a new process, which keeps the descriptors.
+    bool serve = false;
+    std::string socketPath;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (Differentiator::parseOption(args, i, options)) {
+            continue;
+        } else if (args[i] == "--stats") {
+            statistics.enabled = true;
+        } else if (args[i] == "--eval" && i + 2 < args.size()) {
+            evalName = args[++i];
+            evalInputs = args[++i];
+        } else if (args[i] == "--serve") {
+            serve = true;
+        } else if (args[i] == "--socket" && i + 1 < args.size()) {
+            socketPath = args[++i];
+        } else {
+            files.push_back(args[i]);
+        }
+    }
+    if (serve || !socketPath.empty()) {
+        Server server;
+        if (serve) {
+            server.serve(0, 1);
+        } else {
+            server.serveSocket(socketPath);
+        }
+        if (server.exhausted()) {
+            execv("/proc/self/exe", argv);
+            std::cerr << "Restarting the server failed: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    // With --stats the standard output only contains the JSON statistics
+    std::ostream &log = statistics.enabled ? std::clog : std::cout;
+
+    log << "Beginning parsing files" << std::endl;
+
+    // The files may call the functions of the files before them, and their derivatives
+    Differentiator differentiator;
+    std::shared_ptr<FileNode> dFile;
+
+    for (std::string &fileName: files) {
+        log << "Parsing file '" + fileName + "'" << std::endl;
+        statistics.beginFile(fileName);
+        std::string path = "../" + fileName;
+        std::ifstream input(path);
+        if (input.fail()) {
+            throw ParsingException("Error opening file '" + path + "'");
+        }
+        std::ostringstream source;
+        source << input.rdbuf();
+        std::shared_ptr<FileNode> file = differentiator.parse(source.str(), path);
+        log << "Parsed file: \n" << file->to_string() << std::endl;
+        dFile = differentiator.differentiate(file, options);
+        log << "Writing file '" + dFile->name + "'" << std::endl;
+        std::ofstream output(dFile->name);
+        Differentiator::emit(dFile, output);
+        if (statistics.enabled) {
+            statistics.setNodeCounts(file->countNodes(), dFile->countNodes());
+        }
 //         std::cout << "Diff file: \n" << diffFile.to_string() << std::endl;
     }
 
-    return 0;
-}
+    // The result goes to the log, so with --stats the JSON statistics are still the only standard output
+    int status = 0;
+    if (!evalName.empty()) {
+        if (dFile == nullptr) {
+            std::cerr << "No file was given to evaluate '" << evalName << "'" << std::endl;
+            status = 1;
+        } else {
+            status = evaluate(dFile, evalName, evalInputs, log);
+        }
+    }
 
+    if (statistics.enabled) {
+        std::cout << statistics.to_json();
+    }
 
+    return status;
+}
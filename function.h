@@ -38,3 +38,14 @@ double func2(double input) {
     return std::pow(input, 10) * a;
 }
 
+
+// The elements of a matrix held as nested arrays
+double rotationTrace(double theta, double s) {
+    std::array<std::array<double, 2>, 2> m;
+    m[0][0] = s * std::cos(theta);
+    m[0][1] = s * std::sin(theta);
+    m[1][0] = std::exp(s) * theta;
+    m[1][1] = s * std::cos(theta);
+    double result = m[0][0] * m[1][1] + m[0][1] * m[1][0];
+    return result;
+}